@@ -0,0 +1,1018 @@
+/*
+ * libgpiod v2 backend for the gpiod Lua wrapper
+ * Implements the subset of the libgpiod v1 API used by gpiod_lua.c on top
+ * of libgpiod v2 (build with make BACKEND=v2)
+ */
+
+#ifndef GPIOD_BACKEND_V2_H
+#define GPIOD_BACKEND_V2_H
+
+#include <gpiod.h>
+#include <linux/gpio.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define GPIOD_LINE_BULK_MAX_LINES 64
+
+// Line directions and biases reuse the v2 enums; v1 calls this one DISABLE
+#define GPIOD_LINE_BIAS_DISABLE GPIOD_LINE_BIAS_DISABLED
+
+enum {
+    GPIOD_LINE_ACTIVE_STATE_HIGH = 1,
+    GPIOD_LINE_ACTIVE_STATE_LOW
+};
+
+enum {
+    GPIOD_LINE_REQUEST_DIRECTION_AS_IS = 1,
+    GPIOD_LINE_REQUEST_DIRECTION_INPUT,
+    GPIOD_LINE_REQUEST_DIRECTION_OUTPUT,
+    GPIOD_LINE_REQUEST_EVENT_FALLING_EDGE,
+    GPIOD_LINE_REQUEST_EVENT_RISING_EDGE,
+    GPIOD_LINE_REQUEST_EVENT_BOTH_EDGES
+};
+
+enum {
+    GPIOD_LINE_REQUEST_FLAG_OPEN_DRAIN = 1 << 0,
+    GPIOD_LINE_REQUEST_FLAG_OPEN_SOURCE = 1 << 1,
+    GPIOD_LINE_REQUEST_FLAG_ACTIVE_LOW = 1 << 2,
+    GPIOD_LINE_REQUEST_FLAG_BIAS_DISABLE = 1 << 3,
+    GPIOD_LINE_REQUEST_FLAG_BIAS_PULL_DOWN = 1 << 4,
+    GPIOD_LINE_REQUEST_FLAG_BIAS_PULL_UP = 1 << 5
+};
+
+enum {
+    GPIOD_LINE_EVENT_RISING_EDGE = 1,
+    GPIOD_LINE_EVENT_FALLING_EDGE
+};
+
+struct gpiod_line_request_config {
+    const char *consumer;
+    int request_type;
+    int flags;
+};
+
+struct gpiod_line_event {
+    struct timespec ts;
+    int event_type;
+};
+
+struct gpiod_lua_chip;
+
+struct gpiod_line;
+
+// A v2 request shared by the lines requested together. The kernel only
+// frees its lines once every line holding it has been released
+struct gpiod_lua_request {
+    struct gpiod_line_request *request;
+    unsigned int refs;
+    bool events;
+    unsigned int num_lines;
+    struct gpiod_line *lines[GPIOD_LINE_BULK_MAX_LINES];
+};
+
+// v1 style line handle, owned by its chip. The line info is cached like
+// v1 does and refreshed by gpiod_line_update(). The requested config,
+// kernel debounce period and last output value are kept to rebuild the
+// request on reconfiguration
+struct gpiod_line {
+    struct gpiod_lua_chip *chip;
+    unsigned int offset;
+    struct gpiod_lua_request *req;
+    int request_type;
+    int flags;
+    int value;
+    unsigned long debounce_us; // Kernel debounce period, 0 = off
+    bool event_clock_realtime; // Stamp events with CLOCK_REALTIME
+    char name[GPIO_MAX_NAME_SIZE];
+    char consumer[GPIO_MAX_NAME_SIZE];
+    int direction;
+    int bias;
+    int drive;
+    bool active_low;
+    bool used;
+};
+
+struct gpiod_lua_chip {
+    struct gpiod_chip *chip;
+    char name[GPIO_MAX_NAME_SIZE];
+    char label[GPIO_MAX_NAME_SIZE];
+    unsigned int num_lines;
+    struct gpiod_line *lines;
+};
+
+struct gpiod_line_bulk {
+    struct gpiod_line *lines[GPIOD_LINE_BULK_MAX_LINES];
+    unsigned int num_lines;
+};
+
+struct gpiod_chip_iter {
+    struct dirent **entries;
+    int num_entries;
+    int index;
+};
+
+// ============================================================================
+// Line bulks
+// ============================================================================
+
+static inline void gpiod_line_bulk_init(struct gpiod_line_bulk *bulk) {
+    bulk->num_lines = 0;
+}
+
+static inline void gpiod_line_bulk_add(struct gpiod_line_bulk *bulk, struct gpiod_line *line) {
+    bulk->lines[bulk->num_lines++] = line;
+}
+
+static inline struct gpiod_line *gpiod_line_bulk_get_line(struct gpiod_line_bulk *bulk, unsigned int index) {
+    return bulk->lines[index];
+}
+
+static inline unsigned int gpiod_line_bulk_num_lines(struct gpiod_line_bulk *bulk) {
+    return bulk->num_lines;
+}
+
+// ============================================================================
+// Line info
+// ============================================================================
+
+static inline int gpiod_line_update(struct gpiod_line *line) {
+    struct gpiod_line_info *info = gpiod_chip_get_line_info(line->chip->chip, line->offset);
+    if (!info) {
+        return -1;
+    }
+
+    const char *name = gpiod_line_info_get_name(info);
+    const char *consumer = gpiod_line_info_get_consumer(info);
+    snprintf(line->name, sizeof(line->name), "%s", name ? name : "");
+    snprintf(line->consumer, sizeof(line->consumer), "%s", consumer ? consumer : "");
+    line->direction = gpiod_line_info_get_direction(info);
+    line->bias = gpiod_line_info_get_bias(info);
+    line->drive = gpiod_line_info_get_drive(info);
+    line->active_low = gpiod_line_info_is_active_low(info);
+    line->used = gpiod_line_info_is_used(info);
+
+    gpiod_line_info_free(info);
+    return 0;
+}
+
+static inline unsigned int gpiod_line_offset(struct gpiod_line *line) {
+    return line->offset;
+}
+
+static inline const char *gpiod_line_name(struct gpiod_line *line) {
+    return line->name[0] ? line->name : NULL;
+}
+
+static inline const char *gpiod_line_consumer(struct gpiod_line *line) {
+    return line->consumer[0] ? line->consumer : NULL;
+}
+
+static inline int gpiod_line_direction(struct gpiod_line *line) {
+    return line->direction;
+}
+
+static inline int gpiod_line_active_state(struct gpiod_line *line) {
+    return line->active_low ? GPIOD_LINE_ACTIVE_STATE_LOW : GPIOD_LINE_ACTIVE_STATE_HIGH;
+}
+
+static inline int gpiod_line_bias(struct gpiod_line *line) {
+    return line->bias;
+}
+
+static inline bool gpiod_line_is_used(struct gpiod_line *line) {
+    return line->used;
+}
+
+static inline bool gpiod_line_is_open_drain(struct gpiod_line *line) {
+    return line->drive == GPIOD_LINE_DRIVE_OPEN_DRAIN;
+}
+
+static inline bool gpiod_line_is_open_source(struct gpiod_line *line) {
+    return line->drive == GPIOD_LINE_DRIVE_OPEN_SOURCE;
+}
+
+// ============================================================================
+// Chips
+// ============================================================================
+
+static inline struct gpiod_lua_chip *gpiod_lua_chip_open_path(const char *path) {
+    struct gpiod_lua_chip *chip = calloc(1, sizeof(*chip));
+    if (!chip) {
+        return NULL;
+    }
+
+    chip->chip = gpiod_chip_open(path);
+    if (!chip->chip) {
+        free(chip);
+        return NULL;
+    }
+
+    struct gpiod_chip_info *info = gpiod_chip_get_info(chip->chip);
+    if (info) {
+        snprintf(chip->name, sizeof(chip->name), "%s", gpiod_chip_info_get_name(info));
+        snprintf(chip->label, sizeof(chip->label), "%s", gpiod_chip_info_get_label(info));
+        chip->num_lines = gpiod_chip_info_get_num_lines(info);
+        gpiod_chip_info_free(info);
+        chip->lines = calloc(chip->num_lines ? chip->num_lines : 1, sizeof(struct gpiod_line));
+    }
+
+    if (!chip->lines) {
+        int saved_errno = errno;
+        gpiod_chip_close(chip->chip);
+        free(chip);
+        errno = saved_errno;
+        return NULL;
+    }
+
+    for (unsigned int i = 0; i < chip->num_lines; i++) {
+        chip->lines[i].chip = chip;
+        chip->lines[i].offset = i;
+    }
+    return chip;
+}
+
+static inline struct gpiod_lua_chip *gpiod_chip_open_by_name(const char *name) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/dev/%s", name);
+    return gpiod_lua_chip_open_path(path);
+}
+
+static inline struct gpiod_lua_chip *gpiod_chip_open_by_number(unsigned int num) {
+    char path[64];
+    snprintf(path, sizeof(path), "/dev/gpiochip%u", num);
+    return gpiod_lua_chip_open_path(path);
+}
+
+static inline const char *gpiod_chip_name(struct gpiod_lua_chip *chip) {
+    return chip->name;
+}
+
+static inline const char *gpiod_chip_label(struct gpiod_lua_chip *chip) {
+    return chip->label;
+}
+
+static inline unsigned int gpiod_chip_num_lines(struct gpiod_lua_chip *chip) {
+    return chip->num_lines;
+}
+
+static inline struct gpiod_line *gpiod_chip_get_line(struct gpiod_lua_chip *chip, unsigned int offset) {
+    if (offset >= chip->num_lines) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct gpiod_line *line = &chip->lines[offset];
+    if (gpiod_line_update(line) < 0) {
+        return NULL;
+    }
+    return line;
+}
+
+static inline int gpiod_chip_get_lines(struct gpiod_lua_chip *chip, unsigned int *offsets,
+                                       unsigned int num_offsets, struct gpiod_line_bulk *bulk) {
+    if (num_offsets > GPIOD_LINE_BULK_MAX_LINES) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    gpiod_line_bulk_init(bulk);
+    for (unsigned int i = 0; i < num_offsets; i++) {
+        struct gpiod_line *line = gpiod_chip_get_line(chip, offsets[i]);
+        if (!line) {
+            return -1;
+        }
+        gpiod_line_bulk_add(bulk, line);
+    }
+    return 0;
+}
+
+static inline int gpiod_chip_get_all_lines(struct gpiod_lua_chip *chip, struct gpiod_line_bulk *bulk) {
+    unsigned int offsets[GPIOD_LINE_BULK_MAX_LINES];
+
+    if (chip->num_lines > GPIOD_LINE_BULK_MAX_LINES) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < chip->num_lines; i++) {
+        offsets[i] = i;
+    }
+    return gpiod_chip_get_lines(chip, offsets, chip->num_lines, bulk);
+}
+
+// ============================================================================
+// Requests
+// ============================================================================
+
+// Translate a v1 request type and flags into v2 line settings
+static inline int gpiod_lua_apply_config(struct gpiod_line_settings *settings, int request_type, int flags) {
+    int direction = GPIOD_LINE_DIRECTION_INPUT;
+    int edge = GPIOD_LINE_EDGE_NONE;
+    int bias = GPIOD_LINE_BIAS_AS_IS;
+    int drive = GPIOD_LINE_DRIVE_PUSH_PULL;
+
+    switch (request_type) {
+        case GPIOD_LINE_REQUEST_DIRECTION_AS_IS:
+            direction = GPIOD_LINE_DIRECTION_AS_IS;
+            break;
+        case GPIOD_LINE_REQUEST_DIRECTION_INPUT:
+            break;
+        case GPIOD_LINE_REQUEST_DIRECTION_OUTPUT:
+            direction = GPIOD_LINE_DIRECTION_OUTPUT;
+            break;
+        case GPIOD_LINE_REQUEST_EVENT_FALLING_EDGE:
+            edge = GPIOD_LINE_EDGE_FALLING;
+            break;
+        case GPIOD_LINE_REQUEST_EVENT_RISING_EDGE:
+            edge = GPIOD_LINE_EDGE_RISING;
+            break;
+        case GPIOD_LINE_REQUEST_EVENT_BOTH_EDGES:
+            edge = GPIOD_LINE_EDGE_BOTH;
+            break;
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+
+    if ((flags & GPIOD_LINE_REQUEST_FLAG_OPEN_DRAIN) && (flags & GPIOD_LINE_REQUEST_FLAG_OPEN_SOURCE)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (flags & GPIOD_LINE_REQUEST_FLAG_OPEN_DRAIN) {
+        drive = GPIOD_LINE_DRIVE_OPEN_DRAIN;
+    } else if (flags & GPIOD_LINE_REQUEST_FLAG_OPEN_SOURCE) {
+        drive = GPIOD_LINE_DRIVE_OPEN_SOURCE;
+    }
+
+    if (flags & GPIOD_LINE_REQUEST_FLAG_BIAS_DISABLE) {
+        bias = GPIOD_LINE_BIAS_DISABLED;
+    } else if (flags & GPIOD_LINE_REQUEST_FLAG_BIAS_PULL_DOWN) {
+        bias = GPIOD_LINE_BIAS_PULL_DOWN;
+    } else if (flags & GPIOD_LINE_REQUEST_FLAG_BIAS_PULL_UP) {
+        bias = GPIOD_LINE_BIAS_PULL_UP;
+    }
+
+    if (gpiod_line_settings_set_direction(settings, direction) < 0 ||
+        gpiod_line_settings_set_edge_detection(settings, edge) < 0 ||
+        gpiod_line_settings_set_bias(settings, bias) < 0) {
+        return -1;
+    }
+    // The kernel rejects a drive setting on inputs
+    if (direction == GPIOD_LINE_DIRECTION_OUTPUT && gpiod_line_settings_set_drive(settings, drive) < 0) {
+        return -1;
+    }
+    gpiod_line_settings_set_active_low(settings, flags & GPIOD_LINE_REQUEST_FLAG_ACTIVE_LOW);
+    return 0;
+}
+
+// Request lines of one chip as a single v2 request
+static inline int gpiod_lua_request_lines(struct gpiod_line **lines, unsigned int num_lines,
+                                          const struct gpiod_line_request_config *config,
+                                          const int *default_vals) {
+    struct gpiod_line_settings *settings = gpiod_line_settings_new();
+    struct gpiod_line_config *line_cfg = gpiod_line_config_new();
+    struct gpiod_request_config *req_cfg = gpiod_request_config_new();
+    struct gpiod_lua_request *req = calloc(1, sizeof(*req));
+    int ret = -1;
+
+    if (!settings || !line_cfg || !req_cfg || !req) {
+        errno = ENOMEM;
+        goto out;
+    }
+    if (gpiod_lua_apply_config(settings, config->request_type, config->flags) < 0) {
+        goto out;
+    }
+
+    for (unsigned int i = 0; i < num_lines; i++) {
+        if (config->request_type == GPIOD_LINE_REQUEST_DIRECTION_OUTPUT) {
+            gpiod_line_settings_set_output_value(settings, (default_vals && default_vals[i]) ?
+                                                 GPIOD_LINE_VALUE_ACTIVE : GPIOD_LINE_VALUE_INACTIVE);
+        }
+        if (config->request_type >= GPIOD_LINE_REQUEST_EVENT_FALLING_EDGE) {
+            gpiod_line_settings_set_event_clock(settings, lines[i]->event_clock_realtime ?
+                                                GPIOD_LINE_CLOCK_REALTIME : GPIOD_LINE_CLOCK_MONOTONIC);
+        }
+        if (gpiod_line_config_add_line_settings(line_cfg, &lines[i]->offset, 1, settings) < 0) {
+            goto out;
+        }
+    }
+
+    if (config->consumer) {
+        gpiod_request_config_set_consumer(req_cfg, config->consumer);
+    }
+    req->request = gpiod_chip_request_lines(lines[0]->chip->chip, req_cfg, line_cfg);
+    if (!req->request) {
+        goto out;
+    }
+
+    req->refs = num_lines;
+    req->events = config->request_type >= GPIOD_LINE_REQUEST_EVENT_FALLING_EDGE;
+    req->num_lines = num_lines;
+    for (unsigned int i = 0; i < num_lines; i++) {
+        req->lines[i] = lines[i];
+        lines[i]->req = req;
+        lines[i]->request_type = config->request_type;
+        lines[i]->flags = config->flags;
+        lines[i]->value = default_vals ? !!default_vals[i] : 0;
+        gpiod_line_update(lines[i]);
+    }
+    req = NULL;
+    ret = 0;
+
+out:;
+    int saved_errno = errno;
+    free(req);
+    gpiod_request_config_free(req_cfg);
+    gpiod_line_config_free(line_cfg);
+    gpiod_line_settings_free(settings);
+    errno = saved_errno;
+    return ret;
+}
+
+static inline void gpiod_line_release(struct gpiod_line *line) {
+    struct gpiod_lua_request *req = line->req;
+    if (!req) {
+        return;
+    }
+
+    line->req = NULL;
+    line->debounce_us = 0;
+    line->event_clock_realtime = false;
+    if (--req->refs == 0) {
+        gpiod_line_request_release(req->request);
+        free(req);
+    }
+}
+
+// Select the clock (CLOCK_MONOTONIC or CLOCK_REALTIME) the kernel stamps
+// the events of the next event request of a line with
+static inline void gpiod_lua_line_set_event_clock(struct gpiod_line *line, int clock) {
+    if (!line->req) {
+        line->event_clock_realtime = clock == CLOCK_REALTIME;
+    }
+}
+
+static inline void gpiod_line_release_bulk(struct gpiod_line_bulk *bulk) {
+    for (unsigned int i = 0; i < bulk->num_lines; i++) {
+        gpiod_line_release(bulk->lines[i]);
+    }
+}
+
+// Value lines share one request, so bulk reads and writes are one ioctl.
+// Event lines get a request each, keeping one event fd per line as in v1
+static inline int gpiod_line_request_bulk(struct gpiod_line_bulk *bulk,
+                                          const struct gpiod_line_request_config *config,
+                                          const int *default_vals) {
+    unsigned int num_lines = bulk->num_lines;
+
+    if (num_lines == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (unsigned int i = 0; i < num_lines; i++) {
+        if (bulk->lines[i]->chip != bulk->lines[0]->chip) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (bulk->lines[i]->req) {
+            errno = EBUSY;
+            return -1;
+        }
+    }
+
+    if (config->request_type < GPIOD_LINE_REQUEST_EVENT_FALLING_EDGE) {
+        return gpiod_lua_request_lines(bulk->lines, num_lines, config, default_vals);
+    }
+
+    for (unsigned int i = 0; i < num_lines; i++) {
+        if (gpiod_lua_request_lines(&bulk->lines[i], 1, config, NULL) < 0) {
+            int saved_errno = errno;
+            while (i-- > 0) {
+                gpiod_line_release(bulk->lines[i]);
+            }
+            errno = saved_errno;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static inline int gpiod_lua_request_line(struct gpiod_line *line, const char *consumer,
+                                         int request_type, int flags, int default_val) {
+    struct gpiod_line_request_config config = { consumer, request_type, flags };
+    struct gpiod_line_bulk bulk;
+
+    gpiod_line_bulk_init(&bulk);
+    gpiod_line_bulk_add(&bulk, line);
+    return gpiod_line_request_bulk(&bulk, &config, &default_val);
+}
+
+static inline int gpiod_line_request_input_flags(struct gpiod_line *line, const char *consumer, int flags) {
+    return gpiod_lua_request_line(line, consumer, GPIOD_LINE_REQUEST_DIRECTION_INPUT, flags, 0);
+}
+
+static inline int gpiod_line_request_output_flags(struct gpiod_line *line, const char *consumer,
+                                                  int flags, int default_val) {
+    return gpiod_lua_request_line(line, consumer, GPIOD_LINE_REQUEST_DIRECTION_OUTPUT, flags, default_val);
+}
+
+static inline int gpiod_line_request_rising_edge_events_flags(struct gpiod_line *line, const char *consumer, int flags) {
+    return gpiod_lua_request_line(line, consumer, GPIOD_LINE_REQUEST_EVENT_RISING_EDGE, flags, 0);
+}
+
+static inline int gpiod_line_request_falling_edge_events_flags(struct gpiod_line *line, const char *consumer, int flags) {
+    return gpiod_lua_request_line(line, consumer, GPIOD_LINE_REQUEST_EVENT_FALLING_EDGE, flags, 0);
+}
+
+static inline int gpiod_line_request_both_edges_events_flags(struct gpiod_line *line, const char *consumer, int flags) {
+    return gpiod_lua_request_line(line, consumer, GPIOD_LINE_REQUEST_EVENT_BOTH_EDGES, flags, 0);
+}
+
+static inline int gpiod_line_request_rising_edge_events(struct gpiod_line *line, const char *consumer) {
+    return gpiod_line_request_rising_edge_events_flags(line, consumer, 0);
+}
+
+static inline int gpiod_line_request_falling_edge_events(struct gpiod_line *line, const char *consumer) {
+    return gpiod_line_request_falling_edge_events_flags(line, consumer, 0);
+}
+
+static inline int gpiod_line_request_both_edges_events(struct gpiod_line *line, const char *consumer) {
+    return gpiod_line_request_both_edges_events_flags(line, consumer, 0);
+}
+
+static inline int gpiod_line_request_bulk_input_flags(struct gpiod_line_bulk *bulk, const char *consumer, int flags) {
+    struct gpiod_line_request_config config = { consumer, GPIOD_LINE_REQUEST_DIRECTION_INPUT, flags };
+    return gpiod_line_request_bulk(bulk, &config, NULL);
+}
+
+static inline int gpiod_line_request_bulk_output_flags(struct gpiod_line_bulk *bulk, const char *consumer,
+                                                       int flags, const int *default_vals) {
+    struct gpiod_line_request_config config = { consumer, GPIOD_LINE_REQUEST_DIRECTION_OUTPUT, flags };
+    return gpiod_line_request_bulk(bulk, &config, default_vals);
+}
+
+// ============================================================================
+// Values
+// ============================================================================
+
+static inline int gpiod_line_get_value(struct gpiod_line *line) {
+    if (!line->req) {
+        errno = EPERM;
+        return -1;
+    }
+
+    enum gpiod_line_value value = gpiod_line_request_get_value(line->req->request, line->offset);
+    return value == GPIOD_LINE_VALUE_ERROR ? -1 : (int)value;
+}
+
+static inline int gpiod_line_set_value(struct gpiod_line *line, int value) {
+    if (!line->req) {
+        errno = EPERM;
+        return -1;
+    }
+
+    int ret = gpiod_line_request_set_value(line->req->request, line->offset,
+                                           value ? GPIOD_LINE_VALUE_ACTIVE : GPIOD_LINE_VALUE_INACTIVE);
+    if (ret == 0) {
+        line->value = !!value;
+    }
+    return ret;
+}
+
+// Lines sharing a request are read with one GPIO_V2_LINE_GET_VALUES ioctl;
+// a bulk spanning several requests takes one ioctl per run of lines
+static inline int gpiod_line_get_value_bulk(struct gpiod_line_bulk *bulk, int *values) {
+    unsigned int offsets[GPIOD_LINE_BULK_MAX_LINES];
+    enum gpiod_line_value vals[GPIOD_LINE_BULK_MAX_LINES];
+    unsigned int i = 0;
+
+    while (i < bulk->num_lines) {
+        struct gpiod_lua_request *req = bulk->lines[i]->req;
+        if (!req) {
+            errno = EPERM;
+            return -1;
+        }
+
+        unsigned int start = i, n = 0;
+        while (i < bulk->num_lines && bulk->lines[i]->req == req) {
+            offsets[n++] = bulk->lines[i++]->offset;
+        }
+        if (gpiod_line_request_get_values_subset(req->request, n, offsets, vals) < 0) {
+            return -1;
+        }
+        for (unsigned int j = 0; j < n; j++) {
+            values[start + j] = vals[j];
+        }
+    }
+    return 0;
+}
+
+static inline int gpiod_line_set_value_bulk(struct gpiod_line_bulk *bulk, const int *values) {
+    unsigned int offsets[GPIOD_LINE_BULK_MAX_LINES];
+    enum gpiod_line_value vals[GPIOD_LINE_BULK_MAX_LINES];
+    unsigned int i = 0;
+
+    while (i < bulk->num_lines) {
+        struct gpiod_lua_request *req = bulk->lines[i]->req;
+        if (!req) {
+            errno = EPERM;
+            return -1;
+        }
+
+        unsigned int n = 0;
+        while (i < bulk->num_lines && bulk->lines[i]->req == req) {
+            vals[n] = values[i] ? GPIOD_LINE_VALUE_ACTIVE : GPIOD_LINE_VALUE_INACTIVE;
+            offsets[n++] = bulk->lines[i++]->offset;
+        }
+        if (gpiod_line_request_set_values_subset(req->request, n, offsets, vals) < 0) {
+            return -1;
+        }
+    }
+
+    for (i = 0; i < bulk->num_lines; i++) {
+        bulk->lines[i]->value = !!values[i];
+    }
+    return 0;
+}
+
+// ============================================================================
+// Reconfiguration
+// ============================================================================
+
+// Apply the cached config of every line of a request with one
+// GPIO_V2_LINE_SET_CONFIG ioctl. v2 replaces the whole config, so lines
+// outside the reconfigured bulk are passed their current settings
+static inline int gpiod_lua_reconfigure(struct gpiod_lua_request *req) {
+    struct gpiod_line_settings *settings = gpiod_line_settings_new();
+    struct gpiod_line_config *line_cfg = gpiod_line_config_new();
+    int ret = -1;
+
+    if (!settings || !line_cfg) {
+        errno = ENOMEM;
+        goto out;
+    }
+
+    for (unsigned int i = 0; i < req->num_lines; i++) {
+        struct gpiod_line *line = req->lines[i];
+
+        gpiod_line_settings_reset(settings);
+        if (gpiod_lua_apply_config(settings, line->request_type, line->flags) < 0) {
+            goto out;
+        }
+        if (line->request_type == GPIOD_LINE_REQUEST_DIRECTION_OUTPUT) {
+            gpiod_line_settings_set_output_value(settings, line->value ?
+                                                 GPIOD_LINE_VALUE_ACTIVE : GPIOD_LINE_VALUE_INACTIVE);
+        } else {
+            gpiod_line_settings_set_debounce_period_us(settings, line->debounce_us);
+        }
+        if (line->request_type >= GPIOD_LINE_REQUEST_EVENT_FALLING_EDGE) {
+            gpiod_line_settings_set_event_clock(settings, line->event_clock_realtime ?
+                                                GPIOD_LINE_CLOCK_REALTIME : GPIOD_LINE_CLOCK_MONOTONIC);
+        }
+        if (gpiod_line_config_add_line_settings(line_cfg, &line->offset, 1, settings) < 0) {
+            goto out;
+        }
+    }
+
+    ret = gpiod_line_request_reconfigure_lines(req->request, line_cfg);
+    if (ret == 0) {
+        for (unsigned int i = 0; i < req->num_lines; i++) {
+            gpiod_line_update(req->lines[i]);
+        }
+    }
+
+out:;
+    int saved_errno = errno;
+    gpiod_line_config_free(line_cfg);
+    gpiod_line_settings_free(settings);
+    errno = saved_errno;
+    return ret;
+}
+
+// Update the cached config of a bulk and reconfigure each request it spans.
+// A negative direction or flags keeps the line's current one; values may be
+// NULL to keep the current output levels. The cached config is restored if
+// the kernel rejects the new one
+static inline int gpiod_lua_set_config_bulk(struct gpiod_line_bulk *bulk, int direction,
+                                            int flags, const int *values) {
+    struct {
+        int request_type;
+        int flags;
+        int value;
+    } saved[GPIOD_LINE_BULK_MAX_LINES];
+
+    if (bulk->num_lines == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (unsigned int i = 0; i < bulk->num_lines; i++) {
+        struct gpiod_line *line = bulk->lines[i];
+        if (!line->req || line->req->events) {
+            errno = EPERM;
+            return -1;
+        }
+    }
+
+    for (unsigned int i = 0; i < bulk->num_lines; i++) {
+        struct gpiod_line *line = bulk->lines[i];
+        saved[i].request_type = line->request_type;
+        saved[i].flags = line->flags;
+        saved[i].value = line->value;
+        if (direction >= 0) {
+            line->request_type = direction;
+        }
+        if (flags >= 0) {
+            line->flags = flags;
+        }
+        if (values) {
+            line->value = !!values[i];
+        }
+    }
+
+    for (unsigned int i = 0; i < bulk->num_lines; i++) {
+        struct gpiod_lua_request *req = bulk->lines[i]->req;
+        bool done = false;
+        for (unsigned int j = 0; j < i; j++) {
+            done = done || bulk->lines[j]->req == req;
+        }
+        if (!done && gpiod_lua_reconfigure(req) < 0) {
+            int saved_errno = errno;
+            for (unsigned int j = 0; j < bulk->num_lines; j++) {
+                bulk->lines[j]->request_type = saved[j].request_type;
+                bulk->lines[j]->flags = saved[j].flags;
+                bulk->lines[j]->value = saved[j].value;
+            }
+            // Put the requests already reconfigured back as they were
+            for (unsigned int j = 0; j < i; j++) {
+                if (bulk->lines[j]->req != req) {
+                    gpiod_lua_reconfigure(bulk->lines[j]->req);
+                }
+            }
+            errno = saved_errno;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Set the kernel debounce period of every line of a bulk requested as
+// input or for events, and reconfigure the requests it spans. The cached
+// periods are restored if the kernel rejects the new config
+static inline int gpiod_lua_set_debounce_bulk(struct gpiod_line_bulk *bulk, const unsigned long *period_us) {
+    unsigned long saved[GPIOD_LINE_BULK_MAX_LINES];
+
+    if (bulk->num_lines == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (unsigned int i = 0; i < bulk->num_lines; i++) {
+        struct gpiod_line *line = bulk->lines[i];
+        if (!line->req || line->request_type == GPIOD_LINE_REQUEST_DIRECTION_OUTPUT) {
+            errno = EPERM;
+            return -1;
+        }
+    }
+
+    for (unsigned int i = 0; i < bulk->num_lines; i++) {
+        saved[i] = bulk->lines[i]->debounce_us;
+        bulk->lines[i]->debounce_us = period_us[i];
+    }
+
+    for (unsigned int i = 0; i < bulk->num_lines; i++) {
+        struct gpiod_lua_request *req = bulk->lines[i]->req;
+        bool done = false;
+        for (unsigned int j = 0; j < i; j++) {
+            done = done || bulk->lines[j]->req == req;
+        }
+        if (!done && gpiod_lua_reconfigure(req) < 0) {
+            int saved_errno = errno;
+            for (unsigned int j = 0; j < bulk->num_lines; j++) {
+                bulk->lines[j]->debounce_us = saved[j];
+            }
+            // Put the requests already reconfigured back as they were
+            for (unsigned int j = 0; j < i; j++) {
+                if (bulk->lines[j]->req != req) {
+                    gpiod_lua_reconfigure(bulk->lines[j]->req);
+                }
+            }
+            errno = saved_errno;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static inline int gpiod_line_set_config_bulk(struct gpiod_line_bulk *bulk, int direction,
+                                             int flags, const int *values) {
+    if (direction != GPIOD_LINE_REQUEST_DIRECTION_AS_IS &&
+        direction != GPIOD_LINE_REQUEST_DIRECTION_INPUT &&
+        direction != GPIOD_LINE_REQUEST_DIRECTION_OUTPUT) {
+        errno = EINVAL;
+        return -1;
+    }
+    return gpiod_lua_set_config_bulk(bulk, direction, flags, values);
+}
+
+static inline int gpiod_line_set_flags_bulk(struct gpiod_line_bulk *bulk, int flags) {
+    return gpiod_lua_set_config_bulk(bulk, -1, flags, NULL);
+}
+
+static inline int gpiod_line_set_direction_input_bulk(struct gpiod_line_bulk *bulk) {
+    return gpiod_lua_set_config_bulk(bulk, GPIOD_LINE_REQUEST_DIRECTION_INPUT, -1, NULL);
+}
+
+static inline int gpiod_line_set_direction_output_bulk(struct gpiod_line_bulk *bulk, const int *values) {
+    return gpiod_lua_set_config_bulk(bulk, GPIOD_LINE_REQUEST_DIRECTION_OUTPUT, -1, values);
+}
+
+static inline int gpiod_line_set_config(struct gpiod_line *line, int direction, int flags, int value) {
+    struct gpiod_line_bulk bulk;
+
+    gpiod_line_bulk_init(&bulk);
+    gpiod_line_bulk_add(&bulk, line);
+    return gpiod_line_set_config_bulk(&bulk, direction, flags, &value);
+}
+
+static inline int gpiod_line_set_flags(struct gpiod_line *line, int flags) {
+    struct gpiod_line_bulk bulk;
+
+    gpiod_line_bulk_init(&bulk);
+    gpiod_line_bulk_add(&bulk, line);
+    return gpiod_line_set_flags_bulk(&bulk, flags);
+}
+
+static inline int gpiod_line_set_direction_input(struct gpiod_line *line) {
+    struct gpiod_line_bulk bulk;
+
+    gpiod_line_bulk_init(&bulk);
+    gpiod_line_bulk_add(&bulk, line);
+    return gpiod_line_set_direction_input_bulk(&bulk);
+}
+
+static inline int gpiod_line_set_direction_output(struct gpiod_line *line, int value) {
+    struct gpiod_line_bulk bulk;
+
+    gpiod_line_bulk_init(&bulk);
+    gpiod_line_bulk_add(&bulk, line);
+    return gpiod_line_set_direction_output_bulk(&bulk, &value);
+}
+
+// ============================================================================
+// Edge events
+// ============================================================================
+
+static inline int gpiod_line_event_get_fd(struct gpiod_line *line) {
+    if (!line->req || !line->req->events) {
+        errno = EPERM;
+        return -1;
+    }
+    return gpiod_line_request_get_fd(line->req->request);
+}
+
+static inline int gpiod_line_event_wait(struct gpiod_line *line, const struct timespec *timeout) {
+    if (!line->req || !line->req->events) {
+        errno = EPERM;
+        return -1;
+    }
+
+    int64_t timeout_ns = timeout ? (int64_t)timeout->tv_sec * 1000000000LL + timeout->tv_nsec : -1;
+    return gpiod_line_request_wait_edge_events(line->req->request, timeout_ns);
+}
+
+static inline int gpiod_line_event_wait_bulk(struct gpiod_line_bulk *bulk, const struct timespec *timeout,
+                                             struct gpiod_line_bulk *event_bulk) {
+    struct pollfd fds[GPIOD_LINE_BULK_MAX_LINES];
+
+    for (unsigned int i = 0; i < bulk->num_lines; i++) {
+        fds[i].fd = gpiod_line_event_get_fd(bulk->lines[i]);
+        if (fds[i].fd < 0) {
+            return -1;
+        }
+        fds[i].events = POLLIN | POLLPRI;
+        fds[i].revents = 0;
+    }
+
+    // poll() takes milliseconds: round up so a short timeout still waits
+    int timeout_ms = -1;
+    if (timeout) {
+        timeout_ms = timeout->tv_sec * 1000 + (timeout->tv_nsec + 999999) / 1000000;
+    }
+
+    int ret = poll(fds, bulk->num_lines, timeout_ms);
+    if (ret <= 0) {
+        return ret;
+    }
+
+    if (event_bulk) {
+        gpiod_line_bulk_init(event_bulk);
+        for (unsigned int i = 0; i < bulk->num_lines; i++) {
+            if (fds[i].revents) {
+                gpiod_line_bulk_add(event_bulk, bulk->lines[i]);
+            }
+        }
+    }
+    return 1;
+}
+
+// Reads kernel v2 events straight from a line's request fd (at most 16
+// per call, like v1). Timestamps use the clock the line was requested with
+static inline int gpiod_line_event_read_fd_multiple(int fd, struct gpiod_line_event *events,
+                                                    unsigned int num_events) {
+    struct gpio_v2_line_event raw[16];
+
+    if (num_events > 16) {
+        num_events = 16;
+    }
+
+    ssize_t rd = read(fd, raw, num_events * sizeof(raw[0]));
+    if (rd < 0) {
+        return -1;
+    }
+    if (rd == 0 || rd % sizeof(raw[0])) {
+        errno = EIO;
+        return -1;
+    }
+
+    int count = rd / sizeof(raw[0]);
+    for (int i = 0; i < count; i++) {
+        events[i].ts.tv_sec = raw[i].timestamp_ns / 1000000000ULL;
+        events[i].ts.tv_nsec = raw[i].timestamp_ns % 1000000000ULL;
+        events[i].event_type = raw[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE ?
+                               GPIOD_LINE_EVENT_RISING_EDGE : GPIOD_LINE_EVENT_FALLING_EDGE;
+    }
+    return count;
+}
+
+// ============================================================================
+// Chip iteration and version
+// ============================================================================
+
+static inline int gpiod_lua_chip_filter(const struct dirent *entry) {
+    char path[64 + sizeof(entry->d_name)];
+
+    if (strncmp(entry->d_name, "gpiochip", 8) != 0) {
+        return 0;
+    }
+    snprintf(path, sizeof(path), "/dev/%s", entry->d_name);
+    return gpiod_is_gpiochip_device(path);
+}
+
+static inline struct gpiod_chip_iter *gpiod_chip_iter_new(void) {
+    struct gpiod_chip_iter *iter = calloc(1, sizeof(*iter));
+    if (!iter) {
+        return NULL;
+    }
+
+    iter->num_entries = scandir("/dev", &iter->entries, gpiod_lua_chip_filter, alphasort);
+    if (iter->num_entries < 0) {
+        free(iter);
+        return NULL;
+    }
+    return iter;
+}
+
+static inline struct gpiod_lua_chip *gpiod_chip_iter_next_noclose(struct gpiod_chip_iter *iter) {
+    while (iter->index < iter->num_entries) {
+        struct gpiod_lua_chip *chip = gpiod_chip_open_by_name(iter->entries[iter->index++]->d_name);
+        if (chip) {
+            return chip;
+        }
+    }
+    return NULL;
+}
+
+static inline void gpiod_chip_iter_free_noclose(struct gpiod_chip_iter *iter) {
+    for (int i = 0; i < iter->num_entries; i++) {
+        free(iter->entries[i]);
+    }
+    free(iter->entries);
+    free(iter);
+}
+
+static inline const char *gpiod_version_string(void) {
+    return gpiod_api_version();
+}
+
+static inline void gpiod_lua_chip_close(struct gpiod_lua_chip *chip) {
+    for (unsigned int i = 0; i < chip->num_lines; i++) {
+        gpiod_line_release(&chip->lines[i]);
+    }
+    free(chip->lines);
+    gpiod_chip_close(chip->chip);
+    free(chip);
+}
+
+// From here on the wrapper's v1 chip type and close call refer to the
+// backend's own chip handle
+#define gpiod_chip gpiod_lua_chip
+#define gpiod_chip_close gpiod_lua_chip_close
+
+#endif
@@ -0,0 +1,280 @@
+#!/usr/bin/env lua
+--[[
+Microbenchmarks for the gpiod Lua binding
+Measures call overhead of the value accessors and edge event delivery
+latency on a simulated chip, and prints the results as JSON
+
+Needs a gpio-sim or gpio-mockup chip with at least 4 lines, e.g.:
+    sudo modprobe gpio-mockup gpio_mockup_ranges=-1,64
+(gpio-mockup edges are driven through debugfs, which must be mounted)
+
+Usage: lua gpiod_bench.lua [chip] [iterations] [output.json]
+]]
+
+local gpiod = require("gpiod")
+
+local chip_arg = arg[1] ~= "" and arg[1] or nil
+local iterations = tonumber(arg[2]) or 200000
+local output = arg[3]
+local latency_samples = math.max(iterations // 100, 1000)
+
+-- Find a simulated chip: returns chip, kind
+local function find_sim_chip()
+    if chip_arg then
+        local chip = gpiod.chip_open(chip_arg)
+        local kind = chip:label():match("^gpio%-mockup") and "mockup" or "sim"
+        return chip, kind
+    end
+
+    local iter = gpiod.chip_iter()
+    while true do
+        local chip = iter:next_noclose()
+        if not chip then
+            break
+        end
+        local label = chip:label()
+        if label:match("^gpio%-mockup") then
+            iter:close()
+            return chip, "mockup"
+        elseif label:match("^gpio%-sim") then
+            iter:close()
+            return chip, "sim"
+        end
+        chip:close()
+    end
+    iter:close()
+    return nil
+end
+
+-- Find the file that drives the simulated input level of a line
+local function pull_path(chip, kind, offset)
+    local pattern
+    if kind == "mockup" then
+        pattern = "/sys/kernel/debug/gpio-mockup/" .. chip:name() .. "/" .. offset
+    else
+        pattern = "/sys/devices/platform/gpio-sim.*/" .. chip:name() .. "/sim_gpio" .. offset .. "/pull"
+    end
+
+    local ls = io.popen("ls -d " .. pattern .. " 2>/dev/null")
+    local path = ls:read("*l")
+    ls:close()
+    return path
+end
+
+local function pull_writer(chip, kind, offset)
+    local path = pull_path(chip, kind, offset)
+    if not path then
+        return nil
+    end
+
+    local high = kind == "mockup" and "1" or "pull-up"
+    local low = kind == "mockup" and "0" or "pull-down"
+    return function(value)
+        local f = assert(io.open(path, "w"))
+        f:write(value ~= 0 and high or low)
+        f:close()
+    end
+end
+
+-- Time fn(n) and return calls per second
+local function rate(n, fn)
+    fn(n // 10) -- warm up
+    local start = gpiod.now_ns()
+    fn(n)
+    local elapsed = gpiod.now_ns() - start
+    return n * 1e9 / elapsed
+end
+
+local function percentile(sorted, p)
+    local index = math.max(1, math.ceil(#sorted * p))
+    return sorted[index]
+end
+
+local json_escapes = {
+    ['"'] = '\\"', ["\\"] = "\\\\",
+    ["\b"] = "\\b", ["\f"] = "\\f", ["\n"] = "\\n", ["\r"] = "\\r", ["\t"] = "\\t",
+}
+
+-- JSON string literal: quotes, backslashes and control characters escaped
+local function json_string(s)
+    local escaped = s:gsub('[%c"\\]', function(c)
+        return json_escapes[c] or string.format("\\u%04x", c:byte())
+    end)
+    return '"' .. escaped .. '"'
+end
+
+-- Minimal JSON encoder for nested tables of numbers and strings
+local function to_json(value, indent)
+    indent = indent or ""
+    local t = type(value)
+    if t == "number" then
+        if math.type(value) == "integer" then
+            return tostring(value)
+        end
+        -- JSON has no inf or nan
+        if value ~= value or value == math.huge or value == -math.huge then
+            return "null"
+        end
+        return string.format("%.3f", value)
+    elseif t == "string" then
+        return json_string(value)
+    elseif t == "boolean" then
+        return tostring(value)
+    end
+
+    local keys = {}
+    for k in pairs(value) do
+        keys[#keys + 1] = k
+    end
+    table.sort(keys)
+
+    local inner = indent .. "  "
+    local parts = {}
+    for _, k in ipairs(keys) do
+        parts[#parts + 1] = inner .. json_string(tostring(k)) .. ": " .. to_json(value[k], inner)
+    end
+    return "{\n" .. table.concat(parts, ",\n") .. "\n" .. indent .. "}"
+end
+
+local chip, kind = find_sim_chip()
+if not chip then
+    io.stderr:write("No gpio-sim or gpio-mockup chip found\n")
+    os.exit(1)
+end
+
+local num_lines = chip:num_lines()
+assert(num_lines >= 4, "simulated chip needs at least 4 lines")
+
+local results = {
+    version = gpiod.version(),
+    chip = chip:name(),
+    chip_kind = kind,
+    iterations = iterations,
+    calls_per_sec = {},
+    events = {},
+}
+
+-- Single line accessors
+local input = chip:get_line(0)
+input:request_input("bench")
+results.calls_per_sec.get_value = rate(iterations, function(n)
+    for _ = 1, n do
+        input:get_value()
+    end
+end)
+local get = input:getter()
+results.calls_per_sec.get_value_getter = rate(iterations, function(n)
+    for _ = 1, n do
+        get()
+    end
+end)
+input:release()
+
+local output_line = chip:get_line(1)
+output_line:request_output("bench", 0)
+results.calls_per_sec.set_value = rate(iterations, function(n)
+    for i = 1, n do
+        output_line:set_value(i & 1)
+    end
+end)
+local set = output_line:setter()
+results.calls_per_sec.set_value_setter = rate(iterations, function(n)
+    for i = 1, n do
+        set(i & 1)
+    end
+end)
+output_line:release()
+
+-- Bulk setters at several widths
+for _, width in ipairs({1, 8, 32, 64}) do
+    if width <= num_lines then
+        local offsets, zeros, ones = {}, {}, {}
+        for i = 1, width do
+            offsets[i] = i - 1
+            zeros[i] = 0
+            ones[i] = 1
+        end
+
+        local bulk = chip:get_lines(offsets)
+        bulk:request_output("bench", zeros)
+        results.calls_per_sec["bulk_set_values_" .. width] = rate(iterations // 4, function(n)
+            for i = 1, n do
+                bulk:set_values((i & 1) == 0 and zeros or ones)
+            end
+        end)
+        local all = (width == 64) and -1 or ((1 << width) - 1)
+        results.calls_per_sec["bulk_set_mask_" .. width] = rate(iterations // 4, function(n)
+            for i = 1, n do
+                bulk:set_mask((i & 1) == 0 and 0 or all)
+            end
+        end)
+        bulk:release()
+    end
+end
+
+-- Edge events driven through the simulator
+local drive = pull_writer(chip, kind, 2)
+if drive then
+    local line = chip:get_line(2)
+    line:request_both_edges_events("bench")
+    drive(0)
+    while line:event_wait(0.01) do
+        line:event_read_multiple()
+    end
+
+    -- Edge-to-Lua latency: kernel timestamp to delivery in Lua
+    local level = 0
+    local function toggle()
+        level = 1 - level
+        drive(level)
+    end
+
+    local latencies = {}
+    for i = 1, latency_samples do
+        toggle()
+        local event = line:event_read()
+        latencies[i] = gpiod.now_ns() - event:timestamp_ns()
+    end
+    table.sort(latencies)
+    results.events.latency_ns = {
+        samples = latency_samples,
+        min = latencies[1],
+        p50 = percentile(latencies, 0.50),
+        p99 = percentile(latencies, 0.99),
+        p999 = percentile(latencies, 0.999),
+        max = latencies[#latencies],
+    }
+
+    -- Read throughput: queue a burst of edges, then drain them
+    local buffer = gpiod.event_buffer(16)
+    local burst = 16
+    local read_ns, read_events = 0, 0
+    for _ = 1, latency_samples // burst do
+        for _ = 1, burst do
+            toggle()
+        end
+        local start = gpiod.now_ns()
+        local pending = burst
+        while pending > 0 do
+            pending = pending - line:event_read_into(buffer)
+        end
+        read_ns = read_ns + gpiod.now_ns() - start
+        read_events = read_events + burst
+    end
+    results.events.read_into_per_sec = read_events * 1e9 / read_ns
+
+    line:release()
+else
+    results.events.skipped = "no simulator pull file found for line 2"
+end
+
+chip:close()
+
+local json = to_json(results) .. "\n"
+if output then
+    local f = assert(io.open(output, "w"))
+    f:write(json)
+    f:close()
+else
+    io.write(json)
+end
@@ -6,40 +6,279 @@
 #include <lua.h>
 #include <lauxlib.h>
 #include <lualib.h>
+#ifdef GPIOD_LUA_BACKEND_V2
+#include "gpiod_backend_v2.h"
+#else
 #include <gpiod.h>
+#endif
 #include <unistd.h>
 #include <time.h>
 #include <string.h>
 #include <errno.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <linux/gpio.h>
+#include <sched.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 // Metatable names
 #define GPIOD_CHIP_MT "gpiod.chip"
 #define GPIOD_LINE_MT "gpiod.line"
 #define GPIOD_LINE_BULK_MT "gpiod.line_bulk"
+#define GPIOD_LINE_GROUP_MT "gpiod.line_group"
 #define GPIOD_LINE_EVENT_MT "gpiod.line_event"
 #define GPIOD_CHIP_ITER_MT "gpiod.chip_iter"
+#define GPIOD_CHIP_REGISTRY_MT "gpiod.chip_registry"
+#define GPIOD_SHARED_INPUT_MT "gpiod.shared_input"
+#define GPIOD_EVENT_LOOP_MT "gpiod.event_loop"
+#define GPIOD_EVENT_BUFFER_MT "gpiod.event_buffer"
+#define GPIOD_CAPTURE_MT "gpiod.capture"
+#define GPIOD_RECORDING_MT "gpiod.recording"
+#define GPIOD_WAVEFORM_MT "gpiod.waveform"
+#define GPIOD_TICKER_MT "gpiod.ticker"
+#define GPIOD_COUNTER_MT "gpiod.counter"
+#define GPIOD_ENCODER_MT "gpiod.encoder"
+#define GPIOD_SAMPLER_MT "gpiod.sampler"
+#define GPIOD_LINE_INFO_MT "gpiod.line_info"
+#define GPIOD_INFO_WATCH_MT "gpiod.info_watch"
+
+// Maximum number of events drained from one line per read call
+// (matches the per-read limit of gpiod_line_event_read_multiple)
+#define GPIOD_LUA_MAX_EVENTS 16
+
+// Maximum number of ready file descriptors handled per epoll_wait
+#define GPIOD_LUA_MAX_READY_FDS 64
+
+// Maximum capacity of a preallocated event buffer
+#define GPIOD_LUA_MAX_BUFFER_EVENTS (1 << 20)
+
+// Default and maximum capacity of a background capture ring
+#define GPIOD_LUA_CAPTURE_DEFAULT_EVENTS 4096
+#define GPIOD_LUA_CAPTURE_MAX_EVENTS (1 << 22)
+
+// Maximum number of samples taken by one bulk:sample() call
+#define GPIOD_LUA_MAX_SAMPLES (1 << 24)
+
+// Default and maximum capacity of a background sampler ring
+#define GPIOD_LUA_SAMPLER_DEFAULT_SAMPLES 4096
+#define GPIOD_LUA_SAMPLER_MAX_SAMPLES (1 << 22)
+
+// Default and maximum number of records of a capture file
+#define GPIOD_LUA_RECORDING_DEFAULT_RECORDS (1 << 20)
+#define GPIOD_LUA_RECORDING_MAX_RECORDS (1 << 26)
+
+// Capture file format identification and header flags
+#define GPIOD_LUA_RECORDING_MAGIC "GPIODREC"
+#define GPIOD_LUA_RECORDING_VERSION 1
+#define GPIOD_LUA_RECORDING_RING 0x1
+
+// Number of debounce windows a non-blocking read waits for a bouncing line
+// to settle before returning
+#define GPIOD_LUA_DEBOUNCE_MAX_SETTLE 8
+
+// Hot/cold layout hints: the value accessors are kept together in the hot
+// text section, their error paths are moved out of line
+#if defined(__GNUC__)
+#define GPIOD_LUA_HOT __attribute__((hot))
+#define GPIOD_LUA_COLD __attribute__((cold, noinline))
+#define GPIOD_LUA_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define GPIOD_LUA_HOT
+#define GPIOD_LUA_COLD
+#define GPIOD_LUA_UNLIKELY(x) (x)
+#endif
+
+// Built with -DGPIOD_LUA_FAST (make fast), the argument checks of the value
+// accessors are reduced to asserts, so a wrong argument type is undefined
+// behaviour once NDEBUG is set. Errors reported by libgpiod and released
+// lines are still raised as Lua errors.
+#ifdef GPIOD_LUA_FAST
+#include <assert.h>
+#define GPIOD_LUA_CHECK_UDATA(L, arg, tname) \
+    (assert(luaL_testudata((L), (arg), (tname))), lua_touserdata((L), (arg)))
+#define GPIOD_LUA_CHECK_INTEGER(L, arg) \
+    (assert(lua_isinteger((L), (arg))), lua_tointeger((L), (arg)))
+#define GPIOD_LUA_CHECK_TYPE(L, arg, t) assert(lua_type((L), (arg)) == (t))
+#else
+#define GPIOD_LUA_CHECK_UDATA(L, arg, tname) luaL_checkudata((L), (arg), (tname))
+#define GPIOD_LUA_CHECK_INTEGER(L, arg) luaL_checkinteger((L), (arg))
+#define GPIOD_LUA_CHECK_TYPE(L, arg, t) luaL_checktype((L), (arg), (t))
+#endif
+
+#ifdef GPIOD_LUA_STATS
+// Instrumentation of one class of operations
+typedef struct {
+    _Atomic uint64_t calls;
+    _Atomic uint64_t total_ns;
+    _Atomic uint64_t max_ns;
+} OpStats;
+
+enum {
+    GPIOD_LUA_OP_GET,
+    GPIOD_LUA_OP_SET,
+    GPIOD_LUA_OP_WAIT,
+    GPIOD_LUA_OP_READ,
+    GPIOD_LUA_NUM_OPS
+};
+
+// Per-object instrumentation (relaxed atomics: several Lua states may
+// update the process-wide totals concurrently)
+typedef struct {
+    OpStats ops[GPIOD_LUA_NUM_OPS];
+    _Atomic uint64_t events;
+    _Atomic uint64_t queue_high_water; // Most events drained from a line by one read
+} ObjStats;
+#endif
 
 // Chip structure
+// The user value is a table holding the per-chip caches:
+//   lines: weak table offset -> LuaLine userdata
+//   names: table line name -> offset (built on the first name lookup)
+//   threads: weak-keyed table of objects owning a background thread that
+//            uses the chip's lines -> line or bulk the thread works on
 typedef struct {
     struct gpiod_chip *chip;
+#ifdef GPIOD_LUA_STATS
+    ObjStats stats;          // Totals of the chip's lines and bulks
+#endif
 } LuaChip;
 
-// Line structure
+// Software PWM engine
+// A binding-owned thread drives all channels of a bulk with a common,
+// phase-aligned period: every channel with a non-zero duty goes high at the
+// start of the period and low after its own on-time.
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;   // Signalled to stop the thread early
+    int stop;                // Protected by lock
+    struct gpiod_line_bulk bulk;
+    int64_t period_ns;
+    _Atomic int64_t high_ns[GPIOD_LINE_BULK_MAX_LINES];
+    _Atomic int error;
+} SoftPwm;
+
+// Debounce filter state of one event-requested line
+// Edges closer together than window_ns form a burst; a burst is delivered
+// as a single edge once the line has been stable for window_ns
+typedef struct {
+    int64_t window_ns;   // Minimum stable time, 0 = filter disabled
+    int stable_type;     // Type of the last delivered edge, -1 = none yet
+    int in_burst;
+    int last_type;       // Type of the latest edge of the current burst
+    int64_t last_ns;     // Timestamp of the latest edge of the current burst
+    int clock;           // Clock of the burst's timestamps
+    struct gpiod_line_event first; // First edge of the current burst
+    uint64_t delivered;
+    uint64_t suppressed;
+    int64_t kernel_window_ns; // Window debounced by the kernel (v2 backend)
+} LineDebounce;
+
+// Log-linear latency histogram (HDR style): values below 16 ns have exact
+// buckets, above that every power of two is split into 8 linear
+// sub-buckets, i.e. a relative error of at most 12.5%
+#define GPIOD_LUA_LATENCY_SUB_BITS 3
+#define GPIOD_LUA_LATENCY_BUCKETS 320 // Up to 2^40 ns; the last bucket takes the rest
+
+typedef struct {
+    uint64_t counts[GPIOD_LUA_LATENCY_BUCKETS];
+    uint64_t total;
+    uint64_t negative;  // Samples below zero (clock stepped), counted as 0
+    int64_t min_ns;
+    int64_t max_ns;
+    uint64_t sum_ns;
+} LatencyHistogram;
+
+// Line structure (user value: owning LuaChip)
 typedef struct {
     struct gpiod_line *line;
     struct gpiod_chip *chip; // Keep reference to chip
+    int event_clock;         // Clock reported in event timestamps
+    SoftPwm *pwm;            // Running software PWM, if any
+    LineDebounce debounce;
+    LatencyHistogram *latency; // Delivery latency, allocated by track_latency
+#ifdef GPIOD_LUA_STATS
+    ObjStats stats;
+    LuaChip *owner;          // Kept alive by the user value
+#endif
 } LuaLine;
 
-// Line Bulk structure
+// Line Bulk structure (user values: owning LuaChip, loaded waveform)
 typedef struct {
     struct gpiod_line_bulk bulk;
     struct gpiod_chip *chip; // Keep reference to chip
+    int event_clock;         // Clock reported in event timestamps
+    SoftPwm *pwm;            // Running software PWM, if any
+    LineDebounce *debounce;  // One entry per line, allocated by set_debounce
+    LatencyHistogram *latency; // One entry per line, allocated by track_latency
+    int epfd;                // epoll fd over the event fds, see bulk:pollfd()
+#ifdef GPIOD_LUA_STATS
+    ObjStats stats;
+    LuaChip *owner;          // Kept alive by the first user value
+#endif
 } LuaLineBulk;
 
+// Member bulk of a line group
+typedef struct {
+    LuaLineBulk *bulk;      // Kept alive by the group's user value
+    unsigned int shift;     // Group mask bit of the bulk's first line
+    unsigned int index;     // Position in the gpiod.group() arguments
+    int64_t avg_ns;         // Moving average of the bulk's set ioctl time
+} GroupMember;
+
+// Line Group structure
+// Bulks of any number of chips driven as one mask. Members are kept in
+// issue order: slowest set first, so that the value changes of all chips
+// land as close together as possible.
+typedef struct {
+    unsigned int num_members;
+    unsigned int num_lines;
+    uint64_t sets;
+    int64_t last_skew_ns;   // First to last completed set of the last call
+    int64_t max_skew_ns;
+    GroupMember members[];
+} LuaLineGroup;
+
+// Waveform step: bulk values followed by a delay before the next step
+typedef struct {
+    uint64_t mask;
+    int64_t delay_ns;
+} WaveformStep;
+
+// Waveform structure (stored as the second user value of a line bulk)
+typedef struct {
+    unsigned int num_steps;
+    WaveformStep steps[];
+} LuaWaveform;
+
+// Ticker structure
+// Periodic timer tracking an absolute CLOCK_MONOTONIC deadline
+typedef struct {
+    int64_t period_ns;
+    int64_t spin_ns;      // Busy-wait this long before each deadline
+    int64_t deadline_ns;  // Next deadline
+    uint64_t ticks;
+    uint64_t overruns;    // Periods skipped because a deadline was missed
+    int64_t late_total_ns;
+    int64_t late_max_ns;
+} LuaTicker;
+
 // Line Event structure
 typedef struct {
     struct gpiod_line_event event;
+    unsigned int offset; // Offset of the line the event was read from
 } LuaLineEvent;
 
 // Chip Iterator structure
@@ -47,6 +286,258 @@ typedef struct {
     struct gpiod_chip_iter *iter;
 } LuaChipIter;
 
+// Process-wide shared chip
+// Lives in the shared_chips list while shared requests use it
+typedef struct SharedChip {
+    struct SharedChip *next;
+    char name[32];
+    struct gpiod_chip *chip;
+    unsigned int refs;          // Protected by shared_lock
+} SharedChip;
+
+// Process-wide shared input request
+// Created, looked up and released under shared_lock; the kernel request is
+// made once and shared by every Lua state that asks for the same lines.
+// The last values read are published with a sequence lock (seq is odd
+// while an update is in progress) so that snapshot reads take no lock.
+typedef struct SharedRequest {
+    struct SharedRequest *next;
+    SharedChip *chip;
+    unsigned int offsets[GPIOD_LINE_BULK_MAX_LINES];
+    unsigned int num_lines;
+    int flags;
+    struct gpiod_line_bulk bulk;
+    unsigned int refs;          // Protected by shared_lock
+    
+    pthread_mutex_t refresh_lock; // Serializes snapshot updates
+    _Atomic uint64_t seq;
+    _Atomic uint64_t mask;
+    _Atomic int64_t timestamp_ns; // CLOCK_MONOTONIC time of the read, 0 = never
+    _Atomic uint64_t reads;       // Kernel reads
+    _Atomic uint64_t snapshot_hits; // Snapshot reads served without a kernel read
+} SharedRequest;
+
+// Shared Input structure (one per Lua state and gpiod.shared_input() call)
+typedef struct {
+    SharedRequest *req; // NULL once released
+} LuaSharedInput;
+
+// Line Info Watch structure
+// Owns a chip fd of its own: the kernel delivers line info changes of the
+// lines watched through an fd on that fd only
+typedef struct {
+    int fd; // -1 once closed
+    unsigned int num_lines;
+} LuaInfoWatch;
+
+// Chip Registry structure
+// One per Lua state. The user value holds the open chips:
+//   chips: chip name -> chip userdata
+//   labels: chip label -> chip userdata (first chip of a label)
+typedef struct {
+    int fd; // inotify fd watching /dev, -1 once closed
+} LuaChipRegistry;
+
+// Line info of one line as captured by a snapshot
+// Records are zero-padded so that two of them compare with memcmp()
+#define GPIOD_LUA_LINE_INFO_NAME_SIZE 32 // GPIO_MAX_NAME_SIZE of the uAPI
+
+enum {
+    GPIOD_LUA_INFO_USED = 1 << 0,
+    GPIOD_LUA_INFO_OPEN_DRAIN = 1 << 1,
+    GPIOD_LUA_INFO_OPEN_SOURCE = 1 << 2,
+};
+
+typedef struct {
+    char name[GPIOD_LUA_LINE_INFO_NAME_SIZE];     // Empty if unnamed
+    char consumer[GPIOD_LUA_LINE_INFO_NAME_SIZE]; // Empty if unused
+    uint8_t direction;
+    uint8_t active_state;
+    uint8_t bias;
+    uint8_t flags;                                // GPIOD_LUA_INFO_*
+} LineInfoRecord;
+
+// Line Info Snapshot structure
+// Info of all lines of a chip, indexed by offset, in one allocation
+typedef struct {
+    int64_t timestamp_ns;
+    char chip_name[GPIOD_LUA_LINE_INFO_NAME_SIZE];
+    unsigned int num_lines;
+    LineInfoRecord lines[];
+} LuaLineInfo;
+
+// Event Buffer structure
+// Fixed-capacity storage filled in place by the read calls; events and
+// offsets share the userdata allocation
+typedef struct {
+    unsigned int capacity;
+    unsigned int count;
+    unsigned int *offsets; // Points past the end of events[]
+    struct gpiod_line_event events[];
+} LuaEventBuffer;
+
+// Event decoded by a background capture thread
+typedef struct {
+    int64_t timestamp_ns;
+    unsigned int offset;
+    unsigned int index; // Index of the line in the captured object
+    int event_type;
+} CaptureRecord;
+
+// Capture file record
+typedef struct {
+    int64_t timestamp_ns;
+    uint32_t offset;
+    uint8_t index;
+    uint8_t event_type;
+    uint16_t reserved;
+} RecordingRecord;
+
+// Capture file header, followed by capacity records. written is updated
+// with release semantics after the records it covers, so a reader may
+// follow a linear file while it is being recorded
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t record_size;
+    uint32_t flags;
+    uint64_t capacity;
+    _Atomic uint64_t written;   // Records written (exceeds capacity once a ring wraps)
+    _Atomic uint64_t dropped;   // Records lost because a linear file was full
+    int32_t event_clock;
+    uint32_t num_lines;
+    int64_t start_ns;           // Capture start, in the event clock
+    uint64_t initial_mask;      // Line levels at start (bit i = line index i)
+    uint32_t offsets[GPIOD_LINE_BULK_MAX_LINES];
+    char names[GPIOD_LINE_BULK_MAX_LINES][32];
+} RecordingHeader;
+
+// Background Capture structure
+// A capture thread reads the event fds of its lines and pushes decoded
+// events into a single-producer/single-consumer ring drained from Lua.
+// head is only written by the capture thread, tail only by Lua.
+typedef struct {
+    pthread_t thread;
+    int started;
+    int stop_fd;        // eventfd used to wake the thread up for shutdown
+    int event_clock;
+    unsigned int num_lines;
+    int fds[GPIOD_LINE_BULK_MAX_LINES]; // Duplicates owned by the capture, -1 = none
+    unsigned int offsets[GPIOD_LINE_BULK_MAX_LINES];
+    LineDebounce debounce[GPIOD_LINE_BULK_MAX_LINES]; // Copied from the source
+    
+    unsigned int mask;  // Ring capacity - 1 (capacity is a power of two)
+    _Atomic unsigned int head;
+    _Atomic unsigned int tail;
+    _Atomic unsigned int high_water;
+    _Atomic uint64_t received;
+    _Atomic uint64_t overflows;
+    _Atomic int error;  // errno of a failure that stopped the thread
+    
+    RecordingHeader *file; // Mapped capture file written instead of the ring
+    size_t file_size;
+    int file_fd;
+    uint64_t file_capacity;
+    CaptureRecord ring[];
+} LuaCapture;
+
+// Capture File Reader structure
+typedef struct {
+    int fd;
+    const RecordingHeader *header; // Read-only mapping, NULL once closed
+    size_t size;
+    uint64_t position;             // Next record to read (counted like written)
+} LuaRecording;
+
+// Edge Counter structure
+// A counter thread reads the events of one line and accumulates edge counts
+// and same-type edge intervals (periods) under lock
+typedef struct {
+    pthread_t thread;
+    int started;
+    int stop_fd;        // eventfd used to wake the thread up for shutdown
+    int fd;             // Duplicate of the counted line's event fd, -1 = none
+    LineDebounce debounce; // Copied from the line
+    _Atomic int error;
+    
+    pthread_mutex_t lock; // Protects the fields below
+    uint64_t rising;
+    uint64_t falling;
+    int64_t last_ns[2];   // Previous rising / falling edge, -1 = none
+    uint64_t intervals;
+    int64_t interval_total_ns;
+    int64_t interval_min_ns;
+    int64_t interval_max_ns;
+    uint64_t window_intervals; // Since the last frequency() call
+    int64_t window_total_ns;
+} LuaCounter;
+
+// Quadrature Encoder structure
+// An encoder thread reads both-edges events of the A and B phase lines,
+// merges them in timestamp order and runs the quadrature state machine
+typedef struct {
+    pthread_t thread;
+    int started;
+    int stop_fd;        // eventfd used to wake the thread up for shutdown
+    struct gpiod_line_bulk bulk; // A and B lines, empty once released
+    int fds[2];         // Duplicates of the lines' event fds, -1 = none
+    int state;          // (A << 1) | B, owned by the thread
+    int event_clock;    // Clock of the kernel's timestamps, -1 until the first edge
+    _Atomic int64_t position;
+    _Atomic uint64_t edges;
+    _Atomic uint64_t errors;  // Illegal transitions (missed edges)
+    _Atomic int error;        // errno of a failure that stopped the thread
+    int64_t sample_position;  // Last velocity() sample (Lua side)
+    int64_t sample_ns;
+} LuaEncoder;
+
+// Sample taken by a background sampler
+typedef struct {
+    int64_t timestamp_ns;
+    uint64_t mask;
+} SampleRecord;
+
+// Background Sampler structure
+// A sampler thread reads a bulk on an absolute-deadline period grid and
+// pushes samples into a single-producer/single-consumer ring drained from
+// Lua. head is only written by the sampler thread, tail only by Lua.
+typedef struct {
+    pthread_t thread;
+    int started;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup; // Signalled to stop the thread early
+    int stop;              // Protected by lock
+    struct gpiod_line_bulk bulk;
+    int64_t period_ns;
+    
+    unsigned int mask;  // Ring capacity - 1 (capacity is a power of two)
+    _Atomic unsigned int head;
+    _Atomic unsigned int tail;
+    _Atomic uint64_t samples;
+    _Atomic uint64_t overflows; // Samples dropped because the ring was full
+    _Atomic uint64_t missed;    // Periods skipped because the thread ran late
+    _Atomic int64_t max_late_ns;
+    _Atomic int error;  // errno of a failure that stopped the thread
+    SampleRecord ring[];
+} LuaSampler;
+
+// Event Loop structure
+// Registrations live in the userdata's user value: a table mapping
+// event fd -> { callback, object, offset, event_buffer or false, event_clock,
+//               index of the line in the object, kind = EVENT_LOOP_LINE }
+// or, for a line info watch, fd -> { callback, watch, kind = EVENT_LOOP_WATCH }
+typedef struct {
+    int epfd;
+    int running; // Cleared by loop:stop()
+} LuaEventLoop;
+
+// Kinds of event loop registrations
+enum {
+    EVENT_LOOP_LINE,
+    EVENT_LOOP_WATCH
+};
+
 // Helper function: precise sleep
 static void sleep_precise(double seconds) {
     struct timespec ts;
@@ -55,872 +546,7199 @@ static void sleep_precise(double seconds) {
     nanosleep(&ts, NULL);
 }
 
-// ============================================================================
-// Chip related functions
-// ============================================================================
+// Helper function: convert timespec to integer nanoseconds
+static inline lua_Integer timespec_to_ns(const struct timespec *ts) {
+    return (lua_Integer)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
 
-// gpiod.chip_open(name_or_number)
-static int chip_open(lua_State *L) {
-    const char *name = luaL_checkstring(L, 1);
+// Helper function: get the current time of a clock in ns
+static inline int64_t clock_now_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return timespec_to_ns(&ts);
+}
+
+// Helper function: current CLOCK_MONOTONIC time in nanoseconds
+static inline int64_t monotonic_ns(void) {
+    return clock_now_ns(CLOCK_MONOTONIC);
+}
+
+// Helper function: sleep until an absolute CLOCK_MONOTONIC deadline
+// The last spin_ns before the deadline are busy-waited to hide wakeup latency
+static void sleep_until_ns(int64_t deadline_ns, int64_t spin_ns) {
+    int64_t wake_ns = deadline_ns - spin_ns;
+    struct timespec ts;
+    ts.tv_sec = wake_ns / 1000000000;
+    ts.tv_nsec = wake_ns % 1000000000;
     
-    LuaChip *chip = (LuaChip *)lua_newuserdata(L, sizeof(LuaChip));
-    chip->chip = NULL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
     
-    // Try to open by name
-    chip->chip = gpiod_chip_open_by_name(name);
-    if (!chip->chip) {
-        // Try to open by number
-        char *endptr;
-        unsigned int num = strtoul(name, &endptr, 10);
-        if (*endptr == '\0') {
-            chip->chip = gpiod_chip_open_by_number(num);
+    if (spin_ns > 0) {
+        while (monotonic_ns() < deadline_ns) {
         }
     }
-    
-    if (!chip->chip) {
-        return luaL_error(L, "Failed to open GPIO chip: %s", name);
+}
+
+// Helper function: convert optional Lua timeout (seconds, negative = forever)
+static struct timespec *timeout_to_timespec(lua_Number timeout, struct timespec *ts) {
+    if (timeout < 0) {
+        return NULL;
     }
     
-    luaL_getmetatable(L, GPIOD_CHIP_MT);
-    lua_setmetatable(L, -2);
+    ts->tv_sec = (time_t)timeout;
+    ts->tv_nsec = (long)((timeout - ts->tv_sec) * 1000000000);
+    return ts;
+}
+
+// Helper function: read an event clock argument
+static int check_event_clock(lua_State *L, int arg) {
+    int clock = luaL_optinteger(L, arg, CLOCK_MONOTONIC);
     
-    return 1;
+    luaL_argcheck(L, clock == CLOCK_MONOTONIC || clock == CLOCK_REALTIME, arg,
+                  "expected gpiod.CLOCK_MONOTONIC or gpiod.CLOCK_REALTIME");
+    return clock;
 }
 
-// chip:get_line(offset)
-static int chip_get_line(lua_State *L) {
-    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
-    unsigned int offset = luaL_checkinteger(L, 2);
+// Helper function: have the kernel stamp the events of the next event
+// request of a line with clock. The v1 uAPI has no such choice, its
+// timestamps are converted when read instead
+static inline void request_event_clock(struct gpiod_line *line, int clock) {
+#ifdef GPIOD_LUA_BACKEND_V2
+    gpiod_lua_line_set_event_clock(line, clock);
+#else
+    (void)line;
+    (void)clock;
+#endif
+}
+
+// Helper function: clock of a kernel event timestamp, whichever of
+// CLOCK_MONOTONIC and CLOCK_REALTIME it is closest to. Kernels before 5.7
+// stamp v1 events with CLOCK_REALTIME, later ones with CLOCK_MONOTONIC;
+// v2 events carry the clock they were requested with
+static int event_timestamp_clock(int64_t timestamp_ns) {
+    int64_t mono_ns = monotonic_ns();
+    int64_t real_ns = clock_now_ns(CLOCK_REALTIME);
+    int64_t to_mono = timestamp_ns > mono_ns ? timestamp_ns - mono_ns : mono_ns - timestamp_ns;
+    int64_t to_real = timestamp_ns > real_ns ? timestamp_ns - real_ns : real_ns - timestamp_ns;
+    
+    return to_real < to_mono ? CLOCK_REALTIME : CLOCK_MONOTONIC;
+}
+
+// Helper function: check a gpiod.DIRECTION_* argument and return the
+// matching request direction
+static int check_direction(lua_State *L, int arg) {
+    int direction = luaL_checkinteger(L, arg);
     
-    if (!chip->chip) {
-        return luaL_error(L, "Chip is closed");
+    if (direction == GPIOD_LINE_DIRECTION_INPUT) {
+        return GPIOD_LINE_REQUEST_DIRECTION_INPUT;
+    }
+    if (direction == GPIOD_LINE_DIRECTION_OUTPUT) {
+        return GPIOD_LINE_REQUEST_DIRECTION_OUTPUT;
+    }
+    return luaL_argerror(L, arg, "expected gpiod.DIRECTION_INPUT or gpiod.DIRECTION_OUTPUT");
+}
+
+// Helper function: convert event timestamps to the requested clock
+// Timestamps the kernel took with the other clock are shifted by the
+// current offset between both clocks
+static void convert_event_clock(struct gpiod_line_event *events, int num_events, int clock) {
+    if (num_events <= 0 || event_timestamp_clock(timespec_to_ns(&events[0].ts)) == clock) {
+        return;
     }
     
-    LuaLine *line = (LuaLine *)lua_newuserdata(L, sizeof(LuaLine));
-    line->line = gpiod_chip_get_line(chip->chip, offset);
-    line->chip = chip->chip;
+    struct timespec mono_before, real, mono_after;
+    clock_gettime(CLOCK_MONOTONIC, &mono_before);
+    clock_gettime(CLOCK_REALTIME, &real);
+    clock_gettime(CLOCK_MONOTONIC, &mono_after);
     
-    if (!line->line) {
-        return luaL_error(L, "Failed to get GPIO line: %d", offset);
+    lua_Integer mono = (timespec_to_ns(&mono_before) + timespec_to_ns(&mono_after)) / 2;
+    lua_Integer delta = timespec_to_ns(&real) - mono;
+    if (clock == CLOCK_MONOTONIC) {
+        delta = -delta;
+    }
+    
+    for (int i = 0; i < num_events; i++) {
+        lua_Integer ns = timespec_to_ns(&events[i].ts) + delta;
+        events[i].ts.tv_sec = ns / 1000000000;
+        events[i].ts.tv_nsec = ns % 1000000000;
+    }
+}
+
+// Helper function: unpack a bitmask into per-line values (bit i = line i)
+static inline void mask_to_values(uint64_t mask, int *values, unsigned int num_lines) {
+    for (unsigned int i = 0; i < num_lines; i++) {
+        values[i] = (mask >> i) & 1;
+    }
+}
+
+// Helper function: pack per-line values into a bitmask (bit i = line i)
+static inline uint64_t values_to_mask(const int *values, unsigned int num_lines) {
+    uint64_t mask = 0;
+    
+    for (unsigned int i = 0; i < num_lines; i++) {
+        if (values[i]) {
+            mask |= (uint64_t)1 << i;
+        }
     }
+    return mask;
+}
+
+// Helper function: push a line event userdata
+static void push_line_event(lua_State *L, const struct gpiod_line_event *ev, unsigned int offset) {
+    LuaLineEvent *event = (LuaLineEvent *)lua_newuserdata(L, sizeof(LuaLineEvent));
+    event->event = *ev;
+    event->offset = offset;
     
-    luaL_getmetatable(L, GPIOD_LINE_MT);
+    luaL_getmetatable(L, GPIOD_LINE_EVENT_MT);
     lua_setmetatable(L, -2);
+}
+
+// ============================================================================
+// Instrumentation
+// ============================================================================
+// Built with -DGPIOD_LUA_STATS, call counts and ioctl times are recorded per
+// line, bulk and chip and process-wide; gpiod.stats_enable() toggles the
+// recording at run time. Without it the macros below compile to nothing.
+
+#ifdef GPIOD_LUA_STATS
+static _Atomic int stats_enabled = 1;
+static ObjStats global_stats;
+
+#define GPIOD_LUA_STATS_BEGIN(start) int64_t start = stats_begin()
+#define GPIOD_LUA_STATS_END(obj, op, start) stats_end(&(obj)->stats, (obj)->owner, op, start)
+#define GPIOD_LUA_STATS_EVENTS(obj, count) stats_events(&(obj)->stats, (obj)->owner, count)
+
+// Helper function: start timestamp of an instrumented call, 0 when disabled
+static inline int64_t stats_begin(void) {
+    return atomic_load_explicit(&stats_enabled, memory_order_relaxed) ? monotonic_ns() : 0;
+}
+
+static inline void stats_max(_Atomic uint64_t *max, uint64_t value) {
+    if (value > atomic_load_explicit(max, memory_order_relaxed)) {
+        atomic_store_explicit(max, value, memory_order_relaxed);
+    }
+}
+
+static void stats_add(ObjStats *stats, int op, uint64_t elapsed_ns) {
+    OpStats *ops = &stats->ops[op];
     
-    return 1;
+    atomic_fetch_add_explicit(&ops->calls, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&ops->total_ns, elapsed_ns, memory_order_relaxed);
+    stats_max(&ops->max_ns, elapsed_ns);
 }
 
-// chip:get_lines(offsets_table)
-static int chip_get_lines(lua_State *L) {
-    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
-    luaL_checktype(L, 2, LUA_TTABLE);
+// Helper function: record one call in the object, its chip and the totals
+static void stats_end(ObjStats *stats, LuaChip *owner, int op, int64_t start_ns) {
+    if (!start_ns) {
+        return;
+    }
     
-    if (!chip->chip) {
-        return luaL_error(L, "Chip is closed");
+    uint64_t elapsed_ns = monotonic_ns() - start_ns;
+    stats_add(stats, op, elapsed_ns);
+    if (owner) {
+        stats_add(&owner->stats, op, elapsed_ns);
+    }
+    stats_add(&global_stats, op, elapsed_ns);
+}
+
+// Helper function: record the number of events one read drained from a line
+static void stats_events(ObjStats *stats, LuaChip *owner, int count) {
+    if (count <= 0 || !atomic_load_explicit(&stats_enabled, memory_order_relaxed)) {
+        return;
     }
     
-    // Get offset array
-    int num_lines = lua_rawlen(L, 2);
-    unsigned int *offsets = malloc(num_lines * sizeof(unsigned int));
+    ObjStats *targets[3] = { stats, owner ? &owner->stats : NULL, &global_stats };
+    for (int i = 0; i < 3; i++) {
+        if (targets[i]) {
+            atomic_fetch_add_explicit(&targets[i]->events, count, memory_order_relaxed);
+            stats_max(&targets[i]->queue_high_water, count);
+        }
+    }
+}
+
+// Helper function: push instrumentation counters as a table, optionally
+// clearing them afterwards
+static void push_stats(lua_State *L, ObjStats *stats, int reset) {
+    static const char *const op_names[GPIOD_LUA_NUM_OPS] = { "get", "set", "wait", "read" };
+    
+    lua_createtable(L, 0, GPIOD_LUA_NUM_OPS + 2);
+    for (int op = 0; op < GPIOD_LUA_NUM_OPS; op++) {
+        uint64_t calls = atomic_load_explicit(&stats->ops[op].calls, memory_order_relaxed);
+        uint64_t total_ns = atomic_load_explicit(&stats->ops[op].total_ns, memory_order_relaxed);
+        
+        lua_createtable(L, 0, 4);
+        lua_pushinteger(L, (lua_Integer)calls);
+        lua_setfield(L, -2, "calls");
+        lua_pushinteger(L, (lua_Integer)total_ns);
+        lua_setfield(L, -2, "total_ns");
+        lua_pushinteger(L, (lua_Integer)atomic_load_explicit(&stats->ops[op].max_ns, memory_order_relaxed));
+        lua_setfield(L, -2, "max_ns");
+        lua_pushinteger(L, calls ? (lua_Integer)(total_ns / calls) : 0);
+        lua_setfield(L, -2, "mean_ns");
+        lua_setfield(L, -2, op_names[op]);
+    }
+    lua_pushinteger(L, (lua_Integer)atomic_load_explicit(&stats->events, memory_order_relaxed));
+    lua_setfield(L, -2, "events");
+    lua_pushinteger(L, (lua_Integer)atomic_load_explicit(&stats->queue_high_water, memory_order_relaxed));
+    lua_setfield(L, -2, "queue_high_water");
     
-    for (int i = 0; i < num_lines; i++) {
-        lua_rawgeti(L, 2, i + 1);
-        offsets[i] = luaL_checkinteger(L, -1);
-        lua_pop(L, 1);
+    if (reset) {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
+#else
+#define GPIOD_LUA_STATS_BEGIN(start) ((void)0)
+#define GPIOD_LUA_STATS_END(obj, op, start) ((void)0)
+#define GPIOD_LUA_STATS_EVENTS(obj, count) ((void)0)
+#endif
+
+// chip:stats([reset]) / line:stats([reset]) / bulk:stats([reset])
+// Returns the instrumentation counters, or nil when not compiled in
+static int object_stats(lua_State *L) {
+#ifdef GPIOD_LUA_STATS
+    int reset = lua_toboolean(L, 2);
+    LuaLine *line = (LuaLine *)luaL_testudata(L, 1, GPIOD_LINE_MT);
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_testudata(L, 1, GPIOD_LINE_BULK_MT);
+    
+    if (line) {
+        push_stats(L, &line->stats, reset);
+    } else if (bulk) {
+        push_stats(L, &bulk->stats, reset);
+    } else {
+        LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+        push_stats(L, &chip->stats, reset);
+    }
+#else
+    lua_pushnil(L);
+#endif
+    return 1;
+}
+
+// gpiod.stats([reset])
+// Returns process-wide instrumentation counters, or nil when not compiled in
+static int gpiod_stats(lua_State *L) {
+#ifdef GPIOD_LUA_STATS
+    push_stats(L, &global_stats, lua_toboolean(L, 1));
+    lua_pushboolean(L, atomic_load(&stats_enabled));
+    lua_setfield(L, -2, "enabled");
+#else
+    lua_pushnil(L);
+#endif
+    return 1;
+}
+
+// gpiod.stats_enable([enabled])
+// Turns recording on or off; returns whether it was on (always false when
+// instrumentation is not compiled in)
+static int gpiod_stats_enable(lua_State *L) {
+#ifdef GPIOD_LUA_STATS
+    int enabled = lua_isnoneornil(L, 1) ? 1 : lua_toboolean(L, 1);
+    lua_pushboolean(L, atomic_exchange(&stats_enabled, enabled));
+#else
+    lua_pushboolean(L, 0);
+#endif
+    return 1;
+}
+
+// ============================================================================
+// Debounce filter
+// ============================================================================
+
+// Helper function: reset a debounce filter to a new window
+static void debounce_init(LineDebounce *db, int64_t window_ns) {
+    memset(db, 0, sizeof(*db));
+    db->window_ns = window_ns;
+    db->stable_type = -1;
+}
+
+// Helper function: end the current burst
+// A burst that starts with an edge away from the stable level but ends back
+// on it was a glitch and is dropped; otherwise it is delivered as one edge
+// carrying the final level and the timestamp of its first edge.
+// Returns the number of events written to out (0 or 1)
+static int debounce_settle(LineDebounce *db, struct gpiod_line_event *out) {
+    db->in_burst = 0;
+    
+    if (db->last_type == db->stable_type && db->first.event_type != db->last_type) {
+        db->suppressed++;
+        return 0;
     }
     
-    // Create line bulk object
-    LuaLineBulk *bulk = (LuaLineBulk *)lua_newuserdata(L, sizeof(LuaLineBulk));
-    gpiod_line_bulk_init(&bulk->bulk);
-    bulk->chip = chip->chip;
+    *out = db->first;
+    out->event_type = db->last_type;
+    db->stable_type = db->last_type;
+    db->delivered++;
+    return 1;
+}
+
+// Helper function: run raw events through the filter
+// out may alias events; at most num_events events are written
+static int debounce_feed(LineDebounce *db, const struct gpiod_line_event *events, int num_events,
+                         struct gpiod_line_event *out) {
+    int count = 0;
+    
+    for (int i = 0; i < num_events; i++) {
+        struct gpiod_line_event ev = events[i];
+        int64_t ts_ns = timespec_to_ns(&ev.ts);
+        
+        if (db->in_burst && ts_ns - db->last_ns >= db->window_ns) {
+            count += debounce_settle(db, &out[count]);
+        }
+        
+        if (db->in_burst) {
+            db->suppressed++;
+        } else {
+            db->in_burst = 1;
+            db->first = ev;
+            db->clock = event_timestamp_clock(ts_ns);
+        }
+        db->last_type = ev.event_type;
+        db->last_ns = ts_ns;
+    }
     
-    int ret = gpiod_chip_get_lines(chip->chip, offsets, num_lines, &bulk->bulk);
-    free(offsets);
+    return count;
+}
+
+// Helper function: read events from an event fd through its debounce filter
+// Like gpiod_line_event_read_fd_multiple, the first read blocks when no
+// burst is pending. A pending burst is waited out with poll() so its final
+// edge is delivered without needing a further edge. With may_block zero
+// the wait gives up after GPIOD_LUA_DEBOUNCE_MAX_SETTLE windows, with
+// may_block negative the call never waits; both may return 0 when every
+// edge read was suppressed
+static int debounce_read_fd(int fd, LineDebounce *db, struct gpiod_line_event *out,
+                            unsigned int max_events, int may_block) {
+    struct gpiod_line_event raw[GPIOD_LUA_MAX_EVENTS];
+    int64_t settle_ns = may_block < 0 ? 0 : db->window_ns * GPIOD_LUA_DEBOUNCE_MAX_SETTLE;
+    int64_t give_up_ns = monotonic_ns() + settle_ns;
+    unsigned int count = 0;
+    int readable = !db->in_burst;
+    
+    while (count < max_events) {
+        if (!readable) {
+            if (!db->in_burst) {
+                if (count > 0 || may_block <= 0) {
+                    break;
+                }
+                readable = 1;
+                continue;
+            }
+            
+            // Raw edges still queued in the kernel must be seen before the
+            // burst can be declared stable
+            int64_t remaining_ns = db->last_ns + db->window_ns - clock_now_ns(db->clock);
+            int timeout_ms = remaining_ns > 0 ? (int)((remaining_ns + 999999) / 1000000) : 0;
+            if (timeout_ms > 0 && may_block <= 0 && monotonic_ns() >= give_up_ns) {
+                break;
+            }
+            
+            struct pollfd pfd = { .fd = fd, .events = POLLIN | POLLPRI };
+            int ret = poll(&pfd, 1, timeout_ms);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            
+            if (ret > 0) {
+                readable = 1;
+            } else if (remaining_ns <= 0) {
+                count += debounce_settle(db, &out[count]);
+            }
+            continue;
+        }
+        
+        unsigned int space = max_events - count;
+        int num_raw = gpiod_line_event_read_fd_multiple(fd, raw, space < GPIOD_LUA_MAX_EVENTS ? space : GPIOD_LUA_MAX_EVENTS);
+        if (num_raw < 0) {
+            return -1;
+        }
+        
+        count += debounce_feed(db, raw, num_raw, out + count);
+        readable = 0;
+    }
     
-    if (ret < 0) {
-        return luaL_error(L, "Failed to get GPIO line bulk");
+    return count;
+}
+
+// Helper function: read events from an event fd, filtered when db is an
+// enabled debounce filter
+static inline int read_line_events(int fd, LineDebounce *db, struct gpiod_line_event *events,
+                                   unsigned int max_events, int may_block) {
+    if (!db || !db->window_ns) {
+        return gpiod_line_event_read_fd_multiple(fd, events, max_events);
+    }
+    return debounce_read_fd(fd, db, events, max_events, may_block);
+}
+
+// Helper function: poll() timeout in ms until a pending burst can be
+// delivered, or -1 when the filter has nothing pending
+static int debounce_timeout_ms(const LineDebounce *db) {
+    if (!db->in_burst) {
+        return -1;
     }
     
-    luaL_getmetatable(L, GPIOD_LINE_BULK_MT);
-    lua_setmetatable(L, -2);
+    int64_t remaining_ns = db->last_ns + db->window_ns - clock_now_ns(db->clock);
+    return remaining_ns > 0 ? (int)((remaining_ns + 999999) / 1000000) : 0;
+}
+
+// Helper function: push a poll() timeout in ms as seconds, or nil for none
+static void push_poll_timeout(lua_State *L, int timeout_ms) {
+    if (timeout_ms < 0) {
+        lua_pushnil(L);
+    } else {
+        lua_pushnumber(L, timeout_ms / 1000.0);
+    }
+}
+
+// Helper function: read a debounce window argument (nanoseconds, 0 = off)
+static int64_t check_debounce_window(lua_State *L, int arg) {
+    lua_Integer window_ns = luaL_checkinteger(L, arg);
     
-    return 1;
+    luaL_argcheck(L, window_ns >= 0, arg, "debounce window must not be negative");
+    return window_ns;
 }
 
-// chip:find_line(name)
-static int chip_find_line(lua_State *L) {
-    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
-    const char *name = luaL_checkstring(L, 2);
+#ifdef GPIOD_LUA_BACKEND_V2
+// Helper function: debounce requested input or event lines in the kernel
+// Returns 1 on success, 0 when the software filter has to be used instead
+static int kernel_debounce(struct gpiod_line_bulk *lines, const int64_t *windows) {
+    unsigned long period_us[GPIOD_LINE_BULK_MAX_LINES];
+    
+    for (unsigned int i = 0; i < gpiod_line_bulk_num_lines(lines); i++) {
+        int64_t us = (windows[i] + 999) / 1000;
+        if (us > UINT32_MAX) {
+            return 0;
+        }
+        period_us[i] = (unsigned long)us;
+    }
+    return gpiod_lua_set_debounce_bulk(lines, period_us) == 0;
+}
+#endif
+
+// Helper function: push the counters of a debounce filter as a table
+// Edges merged by kernel debounce are not counted in suppressed
+static void push_debounce_stats(lua_State *L, const LineDebounce *db) {
+    lua_createtable(L, 0, 5);
+    lua_pushinteger(L, db->window_ns + db->kernel_window_ns);
+    lua_setfield(L, -2, "window_ns");
+    lua_pushboolean(L, db->kernel_window_ns != 0);
+    lua_setfield(L, -2, "kernel");
+    lua_pushinteger(L, (lua_Integer)db->delivered);
+    lua_setfield(L, -2, "delivered");
+    lua_pushinteger(L, (lua_Integer)db->suppressed);
+    lua_setfield(L, -2, "suppressed");
+    lua_pushboolean(L, db->in_burst);
+    lua_setfield(L, -2, "settling");
+}
+
+// ============================================================================
+// Latency histograms
+// ============================================================================
+// With latency tracking enabled on a line or bulk, every event read through
+// the binding records the time from its kernel timestamp to its delivery
+// to Lua.
+
+// Helper function: reset a histogram
+static void latency_reset(LatencyHistogram *h) {
+    memset(h, 0, sizeof(*h));
+    h->min_ns = INT64_MAX;
+}
+
+// Helper function: bucket index of a value
+static inline unsigned int latency_bucket(uint64_t value) {
+    if (value < (2u << GPIOD_LUA_LATENCY_SUB_BITS)) {
+        return value;
+    }
     
-    if (!chip->chip) {
-        return luaL_error(L, "Chip is closed");
+    unsigned int shift = 63 - __builtin_clzll(value) - GPIOD_LUA_LATENCY_SUB_BITS;
+    unsigned int index = (shift << GPIOD_LUA_LATENCY_SUB_BITS) + (value >> shift);
+    return index < GPIOD_LUA_LATENCY_BUCKETS ? index : GPIOD_LUA_LATENCY_BUCKETS - 1;
+}
+
+// Helper function: lowest value of a bucket
+static inline uint64_t latency_bucket_low(unsigned int index) {
+    if (index < (2u << GPIOD_LUA_LATENCY_SUB_BITS)) {
+        return index;
     }
     
-    struct gpiod_line *line = gpiod_chip_find_line(chip->chip, name);
-    if (!line) {
-        lua_pushnil(L);
-        return 1;
+    unsigned int shift = (index >> GPIOD_LUA_LATENCY_SUB_BITS) - 1;
+    uint64_t top = (index & ((1u << GPIOD_LUA_LATENCY_SUB_BITS) - 1)) | (1u << GPIOD_LUA_LATENCY_SUB_BITS);
+    return top << shift;
+}
+
+// Helper function: record one latency sample
+static inline void latency_record(LatencyHistogram *h, int64_t latency_ns) {
+    if (latency_ns < 0) {
+        h->negative++;
+        latency_ns = 0;
     }
     
-    LuaLine *lua_line = (LuaLine *)lua_newuserdata(L, sizeof(LuaLine));
-    lua_line->line = line;
-    lua_line->chip = chip->chip;
+    h->counts[latency_bucket(latency_ns)]++;
+    h->total++;
+    h->sum_ns += latency_ns;
+    if (latency_ns < h->min_ns) {
+        h->min_ns = latency_ns;
+    }
+    if (latency_ns > h->max_ns) {
+        h->max_ns = latency_ns;
+    }
+}
+
+// Helper function: record the delivery latency of events just read (before
+// any clock conversion), against the clock of the kernel's timestamps
+static inline void latency_record_events(LatencyHistogram *h, const struct gpiod_line_event *events, int num_events) {
+    if (!h || num_events <= 0) {
+        return;
+    }
+    
+    int64_t now = clock_now_ns(event_timestamp_clock(timespec_to_ns(&events[0].ts)));
+    for (int i = 0; i < num_events; i++) {
+        latency_record(h, now - timespec_to_ns(&events[i].ts));
+    }
+}
+
+// Helper function: value at or below which fraction q of the samples lie
+// (upper bound of the bucket, capped at the maximum)
+static int64_t latency_percentile(const LatencyHistogram *h, double q) {
+    uint64_t rank = (uint64_t)(q * h->total + 0.5);
+    uint64_t seen = 0;
+    
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (unsigned int i = 0; i < GPIOD_LUA_LATENCY_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            int64_t high = i + 1 < GPIOD_LUA_LATENCY_BUCKETS ? (int64_t)latency_bucket_low(i + 1) - 1 : h->max_ns;
+            return high < h->max_ns ? high : h->max_ns;
+        }
+    }
+    
+    return h->max_ns;
+}
+
+// Helper function: push a histogram as a table of summary values and the
+// non-empty buckets ({low_ns, high_ns, count} each)
+static void push_latency_histogram(lua_State *L, const LatencyHistogram *h) {
+    lua_createtable(L, 0, 11);
+    lua_pushinteger(L, (lua_Integer)h->total);
+    lua_setfield(L, -2, "count");
+    lua_pushinteger(L, (lua_Integer)h->negative);
+    lua_setfield(L, -2, "negative");
+    
+    if (h->total) {
+        lua_pushinteger(L, h->min_ns);
+        lua_setfield(L, -2, "min_ns");
+        lua_pushinteger(L, h->max_ns);
+        lua_setfield(L, -2, "max_ns");
+        lua_pushinteger(L, (lua_Integer)(h->sum_ns / h->total));
+        lua_setfield(L, -2, "mean_ns");
+        lua_pushinteger(L, latency_percentile(h, 0.50));
+        lua_setfield(L, -2, "p50_ns");
+        lua_pushinteger(L, latency_percentile(h, 0.90));
+        lua_setfield(L, -2, "p90_ns");
+        lua_pushinteger(L, latency_percentile(h, 0.99));
+        lua_setfield(L, -2, "p99_ns");
+        lua_pushinteger(L, latency_percentile(h, 0.999));
+        lua_setfield(L, -2, "p999_ns");
+    }
+    
+    lua_newtable(L);
+    int count = 0;
+    for (unsigned int i = 0; i < GPIOD_LUA_LATENCY_BUCKETS; i++) {
+        if (!h->counts[i]) {
+            continue;
+        }
+        lua_createtable(L, 3, 0);
+        lua_pushinteger(L, (lua_Integer)latency_bucket_low(i));
+        lua_rawseti(L, -2, 1);
+        lua_pushinteger(L, i + 1 < GPIOD_LUA_LATENCY_BUCKETS ? (lua_Integer)latency_bucket_low(i + 1) - 1 : LUA_MAXINTEGER);
+        lua_rawseti(L, -2, 2);
+        lua_pushinteger(L, (lua_Integer)h->counts[i]);
+        lua_rawseti(L, -2, 3);
+        lua_rawseti(L, -2, ++count);
+    }
+    lua_setfield(L, -2, "buckets");
+}
+
+// ============================================================================
+// Software PWM engine
+// ============================================================================
+
+// Helper function: wait on a thread's stop condition until an absolute
+// CLOCK_MONOTONIC deadline
+// Returns non-zero when the thread has been asked to stop
+static int stoppable_sleep_until(pthread_mutex_t *lock, pthread_cond_t *wakeup, const int *stop,
+                                 int64_t deadline_ns) {
+    struct timespec ts;
+    ts.tv_sec = deadline_ns / 1000000000;
+    ts.tv_nsec = deadline_ns % 1000000000;
+    
+    pthread_mutex_lock(lock);
+    while (!*stop) {
+        if (pthread_cond_timedwait(wakeup, lock, &ts) == ETIMEDOUT) {
+            break;
+        }
+    }
+    int stopped = *stop;
+    pthread_mutex_unlock(lock);
+    
+    return stopped;
+}
+
+// Helper function: initialize a stop condition waited on with
+// CLOCK_MONOTONIC deadlines
+static void stop_cond_init(pthread_mutex_t *lock, pthread_cond_t *wakeup) {
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(wakeup, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    pthread_mutex_init(lock, NULL);
+}
+
+// Helper function: stop and join a thread polling fds, waking it up through
+// its stop eventfd, then close the stop fd and the fds it polled
+static void fd_thread_stop(pthread_t thread, int *started, int *stop_fd, int *fds,
+                           unsigned int num_fds) {
+    if (*started) {
+        uint64_t one = 1;
+        if (write(*stop_fd, &one, sizeof(one)) != sizeof(one)) {
+            pthread_cancel(thread);
+        }
+        pthread_join(thread, NULL);
+        *started = 0;
+    }
+    
+    if (*stop_fd >= 0) {
+        close(*stop_fd);
+        *stop_fd = -1;
+    }
+    
+    for (unsigned int i = 0; i < num_fds; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+}
+
+// Helper function: wait on the PWM condition until an absolute deadline
+// Returns non-zero when the thread has been asked to stop
+static int soft_pwm_sleep_until(SoftPwm *pwm, int64_t deadline_ns) {
+    return stoppable_sleep_until(&pwm->lock, &pwm->wakeup, &pwm->stop, deadline_ns);
+}
+
+// PWM thread: toggle the channels on an absolute-deadline period grid
+static void *soft_pwm_thread(void *arg) {
+    SoftPwm *pwm = (SoftPwm *)arg;
+    unsigned int num_lines = gpiod_line_bulk_num_lines(&pwm->bulk);
+    int values[GPIOD_LINE_BULK_MAX_LINES];
+    int64_t high_ns[GPIOD_LINE_BULK_MAX_LINES];
+    uint64_t current = UINT64_MAX; // Force the first write
+    
+    int64_t period_start = monotonic_ns();
+    for (;;) {
+        // Rising edges: all channels with a non-zero duty go high together
+        uint64_t mask = 0;
+        for (unsigned int i = 0; i < num_lines; i++) {
+            high_ns[i] = atomic_load_explicit(&pwm->high_ns[i], memory_order_relaxed);
+            if (high_ns[i] > 0) {
+                mask |= (uint64_t)1 << i;
+            }
+        }
+        
+        if (mask != current) {
+            mask_to_values(mask, values, num_lines);
+            if (gpiod_line_set_value_bulk(&pwm->bulk, values) < 0) {
+                atomic_store(&pwm->error, errno);
+                return NULL;
+            }
+            current = mask;
+        }
+        
+        // Falling edges in on-time order; full-duty channels stay high
+        for (;;) {
+            int64_t next_off = pwm->period_ns;
+            for (unsigned int i = 0; i < num_lines; i++) {
+                if ((current >> i) & 1 && high_ns[i] < next_off) {
+                    next_off = high_ns[i];
+                }
+            }
+            if (next_off >= pwm->period_ns) {
+                break;
+            }
+            
+            if (soft_pwm_sleep_until(pwm, period_start + next_off)) {
+                return NULL;
+            }
+            
+            for (unsigned int i = 0; i < num_lines; i++) {
+                if (high_ns[i] == next_off) {
+                    current &= ~((uint64_t)1 << i);
+                }
+            }
+            mask_to_values(current, values, num_lines);
+            if (gpiod_line_set_value_bulk(&pwm->bulk, values) < 0) {
+                atomic_store(&pwm->error, errno);
+                return NULL;
+            }
+        }
+        
+        period_start += pwm->period_ns;
+        
+        // Skip whole periods that were missed instead of bursting
+        int64_t now = monotonic_ns();
+        if (now - period_start >= pwm->period_ns) {
+            period_start += (now - period_start) / pwm->period_ns * pwm->period_ns;
+        }
+        
+        if (soft_pwm_sleep_until(pwm, period_start)) {
+            return NULL;
+        }
+    }
+}
+
+// Helper function: start a PWM engine on the given lines
+// Returns NULL and sets errno on failure
+static SoftPwm *soft_pwm_start(const struct gpiod_line_bulk *bulk, int64_t period_ns,
+                               const int64_t *high_ns, int rt_priority) {
+    SoftPwm *pwm = (SoftPwm *)calloc(1, sizeof(SoftPwm));
+    if (!pwm) {
+        return NULL;
+    }
+    
+    pwm->bulk = *bulk;
+    pwm->period_ns = period_ns;
+    for (unsigned int i = 0; i < gpiod_line_bulk_num_lines(&pwm->bulk); i++) {
+        atomic_init(&pwm->high_ns[i], high_ns[i]);
+    }
+    
+    stop_cond_init(&pwm->lock, &pwm->wakeup);
+    
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (rt_priority > 0) {
+        struct sched_param param;
+        param.sched_priority = rt_priority;
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+    }
+    
+    int ret = pthread_create(&pwm->thread, &attr, soft_pwm_thread, pwm);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        pthread_cond_destroy(&pwm->wakeup);
+        pthread_mutex_destroy(&pwm->lock);
+        free(pwm);
+        errno = ret;
+        return NULL;
+    }
+    
+    return pwm;
+}
+
+// Helper function: stop a PWM engine, drive its lines low and free it
+static void soft_pwm_destroy(SoftPwm *pwm) {
+    pthread_mutex_lock(&pwm->lock);
+    pwm->stop = 1;
+    pthread_cond_signal(&pwm->wakeup);
+    pthread_mutex_unlock(&pwm->lock);
+    pthread_join(pwm->thread, NULL);
+    
+    int values[GPIOD_LINE_BULK_MAX_LINES] = { 0 };
+    gpiod_line_set_value_bulk(&pwm->bulk, values);
+    
+    pthread_cond_destroy(&pwm->wakeup);
+    pthread_mutex_destroy(&pwm->lock);
+    free(pwm);
+}
+
+// Helper function: read a frequency argument (PWM or sample rate) as a
+// period in ns
+static int64_t check_frequency(lua_State *L, int arg) {
+    lua_Number freq = luaL_checknumber(L, arg);
+    
+    luaL_argcheck(L, freq > 0 && freq <= 1000000, arg, "frequency out of range");
+    return (int64_t)(1000000000.0 / freq);
+}
+
+// Helper function: read a duty cycle argument (0..1) as an on-time in ns
+static int64_t check_pwm_duty(lua_State *L, int arg, int64_t period_ns) {
+    lua_Number duty = luaL_checknumber(L, arg);
+    
+    luaL_argcheck(L, duty >= 0 && duty <= 1, arg, "duty must be between 0 and 1");
+    return (int64_t)(duty * period_ns);
+}
+
+// Helper function: read a table of one duty cycle (0..1) per line into the
+// high times of a PWM period
+static void check_pwm_duties(lua_State *L, int arg, unsigned int num_lines, int64_t period_ns,
+                             int64_t *high_ns) {
+    for (unsigned int i = 0; i < num_lines; i++) {
+        int isnum;
+        lua_rawgeti(L, arg, i + 1);
+        lua_Number duty = lua_tonumberx(L, -1, &isnum);
+        lua_pop(L, 1);
+        
+        if (!isnum) {
+            luaL_argerror(L, arg, lua_pushfstring(L, "duty %d is not a number", (int)i + 1));
+        }
+        if (!(duty >= 0 && duty <= 1)) {
+            luaL_argerror(L, arg, lua_pushfstring(L, "duty %d must be between 0 and 1", (int)i + 1));
+        }
+        high_ns[i] = (int64_t)(duty * period_ns);
+    }
+}
+
+// ============================================================================
+// Chip related functions
+// ============================================================================
+
+// Helper function: push a chip userdata with empty caches
+static void push_chip(lua_State *L, struct gpiod_chip *gchip) {
+    LuaChip *chip = (LuaChip *)lua_newuserdata(L, sizeof(LuaChip));
+    chip->chip = gchip;
+#ifdef GPIOD_LUA_STATS
+    memset(&chip->stats, 0, sizeof(chip->stats));
+#endif
+    
+    luaL_getmetatable(L, GPIOD_CHIP_MT);
+    lua_setmetatable(L, -2);
+    
+    lua_createtable(L, 0, 3);
+    lua_newtable(L);
+    lua_createtable(L, 0, 1);
+    lua_pushliteral(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+    lua_setfield(L, -2, "lines");
+    lua_newtable(L);
+    lua_createtable(L, 0, 1);
+    lua_pushliteral(L, "k");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+    lua_setfield(L, -2, "threads");
+    lua_setuservalue(L, -2);
+}
+
+// Helper function: record an object owning a background thread in the
+// threads table of its chip, so chip:close() stops the thread before the
+// lines it uses are freed
+static void track_thread(lua_State *L, int chip_idx, int owner_idx, int source_idx) {
+    owner_idx = lua_absindex(L, owner_idx);
+    source_idx = lua_absindex(L, source_idx);
+    
+    lua_getuservalue(L, chip_idx);
+    lua_getfield(L, -1, "threads");
+    lua_pushvalue(L, owner_idx);
+    lua_pushvalue(L, source_idx);
+    lua_rawset(L, -3);
+    lua_pop(L, 2);
+}
+
+static void sampler_stop(LuaSampler *smp);
+static void encoder_stop(LuaEncoder *enc);
+
+// Helper function: stop the background thread of a tracked object
+static void stop_thread(lua_State *L, int idx) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_testudata(L, idx, GPIOD_LINE_BULK_MT);
+    LuaSampler *smp = (LuaSampler *)luaL_testudata(L, idx, GPIOD_SAMPLER_MT);
+    LuaEncoder *enc = (LuaEncoder *)luaL_testudata(L, idx, GPIOD_ENCODER_MT);
+    
+    if (bulk && bulk->pwm) {
+        soft_pwm_destroy(bulk->pwm);
+        bulk->pwm = NULL;
+    }
+    if (smp) {
+        sampler_stop(smp);
+    }
+    if (enc) {
+        encoder_stop(enc);
+    }
+}
+
+// Helper function: check whether a bulk holds a line
+static int bulk_has_line(struct gpiod_line_bulk *bulk, struct gpiod_line *line) {
+    for (unsigned int i = 0; i < gpiod_line_bulk_num_lines(bulk); i++) {
+        if (gpiod_line_bulk_get_line(bulk, i) == line) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Helper function: prepare releasing lines of the line or bulk at
+// source_idx. Raises an error when a running sampler of another object
+// reads one of the lines, then stops the samplers of the object itself
+static void release_sampled_lines(lua_State *L, int chip_idx, int source_idx, struct gpiod_line_bulk *lines) {
+    source_idx = lua_absindex(L, source_idx);
+    
+    lua_getuservalue(L, chip_idx);
+    if (lua_getfield(L, -1, "threads") != LUA_TTABLE) {
+        lua_pop(L, 2);
+        return;
+    }
+    
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        LuaSampler *smp = (LuaSampler *)luaL_testudata(L, -2, GPIOD_SAMPLER_MT);
+        if (smp && smp->started && !lua_rawequal(L, -1, source_idx)) {
+            for (unsigned int i = 0; i < gpiod_line_bulk_num_lines(lines); i++) {
+                struct gpiod_line *line = gpiod_line_bulk_get_line(lines, i);
+                if (bulk_has_line(&smp->bulk, line)) {
+                    luaL_error(L, "Line %d is read by a running sampler", gpiod_line_offset(line));
+                }
+            }
+        }
+        lua_pop(L, 1);
+    }
+    
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        LuaSampler *smp = (LuaSampler *)luaL_testudata(L, -2, GPIOD_SAMPLER_MT);
+        if (smp && lua_rawequal(L, -1, source_idx)) {
+            sampler_stop(smp);
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 2);
+}
+
+// Helper function: stop all tracked background threads of a chip
+static void stop_chip_threads(lua_State *L, int chip_idx) {
+    lua_getuservalue(L, chip_idx);
+    if (lua_getfield(L, -1, "threads") == LUA_TTABLE) {
+        lua_pushnil(L);
+        while (lua_next(L, -2)) {
+            lua_pop(L, 1);
+            stop_thread(L, -1);
+        }
+    }
+    lua_pop(L, 2);
+}
+
+// Helper function: push the cached line userdata for a line of a chip,
+// creating it on first use
+static void push_line(lua_State *L, int chip_idx, struct gpiod_line *gline) {
+    chip_idx = lua_absindex(L, chip_idx);
+    LuaChip *chip = (LuaChip *)lua_touserdata(L, chip_idx);
+    unsigned int offset = gpiod_line_offset(gline);
+    
+    lua_getuservalue(L, chip_idx);
+    lua_getfield(L, -1, "lines");
+    
+    if (lua_rawgeti(L, -1, offset) == LUA_TUSERDATA) {
+        // A released handle becomes usable again when looked up anew
+        LuaLine *line = (LuaLine *)lua_touserdata(L, -1);
+        line->line = gline;
+    } else {
+        lua_pop(L, 1);
+        
+        LuaLine *line = (LuaLine *)lua_newuserdata(L, sizeof(LuaLine));
+        line->line = gline;
+        line->chip = chip->chip;
+        line->event_clock = CLOCK_MONOTONIC;
+        line->pwm = NULL;
+        debounce_init(&line->debounce, 0);
+        line->latency = NULL;
+#ifdef GPIOD_LUA_STATS
+        memset(&line->stats, 0, sizeof(line->stats));
+        line->owner = chip;
+#endif
+        
+        luaL_getmetatable(L, GPIOD_LINE_MT);
+        lua_setmetatable(L, -2);
+        
+        lua_pushvalue(L, chip_idx);
+        lua_setuservalue(L, -2);
+        
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, -3, offset);
+    }
+    
+    lua_replace(L, -3);
+    lua_pop(L, 1);
+}
+
+// Helper function: push the name -> offset table of a chip, building it
+// with a single pass over all lines the first time
+static void push_chip_names(lua_State *L, int chip_idx) {
+    chip_idx = lua_absindex(L, chip_idx);
+    LuaChip *chip = (LuaChip *)lua_touserdata(L, chip_idx);
+    
+    lua_getuservalue(L, chip_idx);
+    if (lua_getfield(L, -1, "names") == LUA_TTABLE) {
+        lua_replace(L, -2);
+        return;
+    }
+    lua_pop(L, 1);
+    
+    unsigned int num_lines = gpiod_chip_num_lines(chip->chip);
+    lua_createtable(L, 0, num_lines);
+    
+    for (unsigned int offset = 0; offset < num_lines; offset++) {
+        struct gpiod_line *line = gpiod_chip_get_line(chip->chip, offset);
+        const char *name = line ? gpiod_line_name(line) : NULL;
+        
+        // Keep the first line when several share a name
+        if (name && lua_getfield(L, -1, name) == LUA_TNIL) {
+            lua_pushinteger(L, offset);
+            lua_setfield(L, -3, name);
+        }
+        if (name) {
+            lua_pop(L, 1);
+        }
+    }
+    
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -3, "names");
+    lua_replace(L, -2);
+}
+
+// Helper function: prepare a new line bulk belonging to a chip
+static LuaLineBulk *new_line_bulk(lua_State *L, int chip_idx) {
+    chip_idx = lua_absindex(L, chip_idx);
+    LuaChip *chip = (LuaChip *)lua_touserdata(L, chip_idx);
+    
+    LuaLineBulk *bulk = (LuaLineBulk *)lua_newuserdatauv(L, sizeof(LuaLineBulk), 2);
+    gpiod_line_bulk_init(&bulk->bulk);
+    bulk->chip = chip->chip;
+    bulk->event_clock = CLOCK_MONOTONIC;
+    bulk->pwm = NULL;
+    bulk->debounce = NULL;
+    bulk->latency = NULL;
+    bulk->epfd = -1;
+#ifdef GPIOD_LUA_STATS
+    memset(&bulk->stats, 0, sizeof(bulk->stats));
+    bulk->owner = chip;
+#endif
+    
+    lua_pushvalue(L, chip_idx);
+    lua_setiuservalue(L, -2, 1);
+    
+    return bulk;
+}
+
+// Helper function: open a chip by name, or by number
+static struct gpiod_chip *open_chip(const char *name) {
+    // Try to open by name
+    struct gpiod_chip *chip = gpiod_chip_open_by_name(name);
+    if (!chip) {
+        // Try to open by number
+        char *endptr;
+        unsigned int num = strtoul(name, &endptr, 10);
+        if (*endptr == '\0') {
+            chip = gpiod_chip_open_by_number(num);
+        }
+    }
+    
+    return chip;
+}
+
+// gpiod.chip_open(name_or_number)
+// Always opens a handle of its own, see reg:open() for shared handles
+static int chip_open(lua_State *L) {
+    const char *name = luaL_checkstring(L, 1);
+    
+    struct gpiod_chip *chip = open_chip(name);
+    if (!chip) {
+        return luaL_error(L, "Failed to open GPIO chip: %s", name);
+    }
+    
+    push_chip(L, chip);
+    return 1;
+}
+
+// chip:get_line(offset)
+// Returns the same line object for repeated lookups of an offset
+static int chip_get_line(lua_State *L) {
+    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+    unsigned int offset = luaL_checkinteger(L, 2);
+    
+    if (!chip->chip) {
+        return luaL_error(L, "Chip is closed");
+    }
+    
+    struct gpiod_line *line = gpiod_chip_get_line(chip->chip, offset);
+    if (!line) {
+        return luaL_error(L, "Failed to get GPIO line: %d", offset);
+    }
+    
+    push_line(L, 1, line);
+    return 1;
+}
+
+// chip:get_lines(offsets_table)
+static int chip_get_lines(lua_State *L) {
+    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    
+    if (!chip->chip) {
+        return luaL_error(L, "Chip is closed");
+    }
+    
+    // Get offset array
+    unsigned int offsets[GPIOD_LINE_BULK_MAX_LINES];
+    int num_lines = lua_rawlen(L, 2);
+    luaL_argcheck(L, num_lines <= GPIOD_LINE_BULK_MAX_LINES, 2, "at most 64 line offsets are supported");
+    
+    for (int i = 0; i < num_lines; i++) {
+        lua_rawgeti(L, 2, i + 1);
+        offsets[i] = luaL_checkinteger(L, -1);
+        lua_pop(L, 1);
+    }
+    
+    // Create line bulk object
+    LuaLineBulk *bulk = new_line_bulk(L, 1);
+    
+    int ret = gpiod_chip_get_lines(chip->chip, offsets, num_lines, &bulk->bulk);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to get GPIO line bulk");
+    }
+    
+    luaL_getmetatable(L, GPIOD_LINE_BULK_MT);
+    lua_setmetatable(L, -2);
+    
+    return 1;
+}
+
+// chip:find_line(name)
+// Looks the name up in the chip's name table instead of scanning all lines
+static int chip_find_line(lua_State *L) {
+    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+    luaL_checkstring(L, 2);
+    
+    if (!chip->chip) {
+        return luaL_error(L, "Chip is closed");
+    }
+    
+    push_chip_names(L, 1);
+    lua_pushvalue(L, 2);
+    if (lua_rawget(L, -2) != LUA_TNUMBER) {
+        lua_pushnil(L);
+        return 1;
+    }
+    
+    struct gpiod_line *line = gpiod_chip_get_line(chip->chip, lua_tointeger(L, -1));
+    if (!line) {
+        lua_pushnil(L);
+        return 1;
+    }
+    
+    push_line(L, 1, line);
+    return 1;
+}
+
+// chip:get_all_lines()
+static int chip_get_all_lines(lua_State *L) {
+    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+    
+    if (!chip->chip) {
+        return luaL_error(L, "Chip is closed");
+    }
+    
+    LuaLineBulk *bulk = new_line_bulk(L, 1);
+    
+    int ret = gpiod_chip_get_all_lines(chip->chip, &bulk->bulk);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to get all GPIO lines");
+    }
+    
+    luaL_getmetatable(L, GPIOD_LINE_BULK_MT);
+    lua_setmetatable(L, -2);
+    
+    return 1;
+}
+
+// Helper function: push a new bulk holding the given offsets of the chip
+// at chip_idx
+static int push_offsets_bulk(lua_State *L, int chip_idx, unsigned int *offsets, unsigned int num_offsets) {
+    LuaChip *chip = (LuaChip *)lua_touserdata(L, chip_idx);
+    LuaLineBulk *bulk = new_line_bulk(L, chip_idx);
+    
+    int ret = gpiod_chip_get_lines(chip->chip, offsets, num_offsets, &bulk->bulk);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to get GPIO line bulk");
+    }
+    
+    luaL_getmetatable(L, GPIOD_LINE_BULK_MT);
+    lua_setmetatable(L, -2);
+    
+    return 1;
+}
+
+// chip:get_line_range(first, count)
+static int chip_get_line_range(lua_State *L) {
+    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+    lua_Integer first = luaL_checkinteger(L, 2);
+    lua_Integer count = luaL_checkinteger(L, 3);
+    unsigned int offsets[GPIOD_LINE_BULK_MAX_LINES];
+    
+    if (!chip->chip) {
+        return luaL_error(L, "Chip is closed");
+    }
+    
+    luaL_argcheck(L, count > 0 && count <= GPIOD_LINE_BULK_MAX_LINES, 3, "count must be between 1 and 64");
+    luaL_argcheck(L, first >= 0 && first <= (lua_Integer)gpiod_chip_num_lines(chip->chip) - count, 2,
+                  "range exceeds the chip's lines");
+    
+    for (lua_Integer i = 0; i < count; i++) {
+        offsets[i] = first + i;
+    }
+    
+    return push_offsets_bulk(L, 1, offsets, count);
+}
+
+// chip:get_lines_mask(mask)
+// Bit i of mask selects offset i; lines are ordered by offset
+static int chip_get_lines_mask(lua_State *L) {
+    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+    uint64_t mask = (uint64_t)luaL_checkinteger(L, 2);
+    unsigned int offsets[GPIOD_LINE_BULK_MAX_LINES];
+    unsigned int num_offsets = 0;
+    
+    if (!chip->chip) {
+        return luaL_error(L, "Chip is closed");
+    }
+    
+    luaL_argcheck(L, mask != 0, 2, "mask selects no lines");
+    
+    while (mask) {
+        offsets[num_offsets++] = __builtin_ctzll(mask);
+        mask &= mask - 1;
+    }
+    
+    return push_offsets_bulk(L, 1, offsets, num_offsets);
+}
+
+// chip:find_lines(names)
+// Resolves all names through the chip's name table in one pass; returns
+// the bulk, or nil and the first name not found
+static int chip_find_lines(lua_State *L) {
+    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    unsigned int offsets[GPIOD_LINE_BULK_MAX_LINES];
+    
+    if (!chip->chip) {
+        return luaL_error(L, "Chip is closed");
+    }
+    
+    lua_Unsigned num_names = lua_rawlen(L, 2);
+    luaL_argcheck(L, num_names > 0 && num_names <= GPIOD_LINE_BULK_MAX_LINES, 2,
+                  "expected 1 to 64 line names");
+    
+    lua_settop(L, 2);
+    push_chip_names(L, 1);
+    for (lua_Unsigned i = 0; i < num_names; i++) {
+        lua_rawgeti(L, 2, i + 1);
+        if (lua_rawget(L, 3) != LUA_TNUMBER) {
+            lua_pushnil(L);
+            lua_rawgeti(L, 2, i + 1);
+            return 2;
+        }
+        offsets[i] = lua_tointeger(L, -1);
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+    
+    return push_offsets_bulk(L, 1, offsets, num_names);
+}
+
+// chip:refresh()
+// Drops the name table so that it is rebuilt from fresh line info
+static int chip_refresh(lua_State *L) {
+    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+    
+    if (!chip->chip) {
+        return luaL_error(L, "Chip is closed");
+    }
+    
+    unsigned int num_lines = gpiod_chip_num_lines(chip->chip);
+    for (unsigned int offset = 0; offset < num_lines; offset++) {
+        struct gpiod_line *line = gpiod_chip_get_line(chip->chip, offset);
+        if (line) {
+            gpiod_line_update(line);
+        }
+    }
+    
+    lua_getuservalue(L, 1);
+    lua_pushnil(L);
+    lua_setfield(L, -2, "names");
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// chip:name()
+static int chip_name(lua_State *L) {
+    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+    
+    if (!chip->chip) {
+        return luaL_error(L, "Chip is closed");
+    }
+    
+    lua_pushstring(L, gpiod_chip_name(chip->chip));
+    return 1;
+}
+
+// chip:label()
+static int chip_label(lua_State *L) {
+    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+    
+    if (!chip->chip) {
+        return luaL_error(L, "Chip is closed");
+    }
+    
+    lua_pushstring(L, gpiod_chip_label(chip->chip));
+    return 1;
+}
+
+// chip:num_lines()
+static int chip_num_lines(lua_State *L) {
+    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+    
+    if (!chip->chip) {
+        return luaL_error(L, "Chip is closed");
+    }
+    
+    lua_pushinteger(L, gpiod_chip_num_lines(chip->chip));
+    return 1;
+}
+
+// chip:close()
+static int chip_close(lua_State *L) {
+    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+    
+    if (chip->chip) {
+        // Threads of bulks (and other owners) must stop before the lines
+        // they use are freed
+        stop_chip_threads(L, 1);
+        
+        // Cached line handles must not outlive the chip
+        lua_getuservalue(L, 1);
+        if (lua_getfield(L, -1, "lines") == LUA_TTABLE) {
+            lua_pushnil(L);
+            while (lua_next(L, -2)) {
+                LuaLine *line = (LuaLine *)lua_touserdata(L, -1);
+                if (line->pwm) {
+                    soft_pwm_destroy(line->pwm);
+                    line->pwm = NULL;
+                }
+                line->line = NULL;
+                lua_pop(L, 1);
+            }
+        }
+        lua_pop(L, 2);
+        
+        gpiod_chip_close(chip->chip);
+        chip->chip = NULL;
+    }
+    
+    return 0;
+}
+
+// ============================================================================
+// Line related functions
+// ============================================================================
+
+// line:request_input(consumer, [flags])
+static int line_request_input(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    const char *consumer = luaL_checkstring(L, 2);
+    int flags = luaL_optinteger(L, 3, 0);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    int ret = gpiod_line_request_input_flags(line->line, consumer, flags);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to request input mode");
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// line:request_output(consumer, default_val, [flags])
+static int line_request_output(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    const char *consumer = luaL_checkstring(L, 2);
+    int default_val = luaL_checkinteger(L, 3);
+    int flags = luaL_optinteger(L, 4, 0);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    int ret = gpiod_line_request_output_flags(line->line, consumer, flags, default_val);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to request output mode");
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// line:set_config(direction, [flags], [value])
+// Reconfigures a requested line in place, without releasing it
+static int line_set_config(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    int direction = check_direction(L, 2);
+    int flags = luaL_optinteger(L, 3, 0);
+    int value = luaL_optinteger(L, 4, 0);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    int ret = gpiod_line_set_config(line->line, direction, flags, value);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to reconfigure line");
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// line:set_direction_input()
+static int line_set_direction_input(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    int ret = gpiod_line_set_direction_input(line->line);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to set line direction");
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// line:set_direction_output([value])
+static int line_set_direction_output(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    int value = luaL_optinteger(L, 2, 0);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    int ret = gpiod_line_set_direction_output(line->line, value);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to set line direction");
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// line:set_flags(flags)
+static int line_set_flags(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    int flags = luaL_checkinteger(L, 2);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    int ret = gpiod_line_set_flags(line->line, flags);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to set line flags");
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// Helper function: raise an error from a value accessor
+// Kept out of line so the accessors stay small enough to inline
+static GPIOD_LUA_COLD int value_error(lua_State *L, const char *msg) {
+    return luaL_error(L, "%s", msg);
+}
+
+// Helper function: read a line value and push it
+// Shared by line:get_value() and the line:getter() closure
+static inline int line_push_value(lua_State *L, LuaLine *line) {
+    if (GPIOD_LUA_UNLIKELY(!line->line)) {
+        return value_error(L, "Line is released");
+    }
+    
+    GPIOD_LUA_STATS_BEGIN(start_ns);
+    int value = gpiod_line_get_value(line->line);
+    GPIOD_LUA_STATS_END(line, GPIOD_LUA_OP_GET, start_ns);
+    if (GPIOD_LUA_UNLIKELY(value < 0)) {
+        return value_error(L, "Failed to read GPIO value");
+    }
+    
+    lua_pushinteger(L, value);
+    return 1;
+}
+
+// Helper function: set a line value
+// Shared by line:set_value() and the line:setter() closure
+static inline int line_write_value(lua_State *L, LuaLine *line, int value) {
+    if (GPIOD_LUA_UNLIKELY(!line->line)) {
+        return value_error(L, "Line is released");
+    }
+    
+    GPIOD_LUA_STATS_BEGIN(start_ns);
+    int ret = gpiod_line_set_value(line->line, value);
+    GPIOD_LUA_STATS_END(line, GPIOD_LUA_OP_SET, start_ns);
+    if (GPIOD_LUA_UNLIKELY(ret < 0)) {
+        return value_error(L, "Failed to set GPIO value");
+    }
+    return 0;
+}
+
+// line:get_value()
+static GPIOD_LUA_HOT int line_get_value(lua_State *L) {
+    return line_push_value(L, (LuaLine *)GPIOD_LUA_CHECK_UDATA(L, 1, GPIOD_LINE_MT));
+}
+
+// line:set_value(value)
+static GPIOD_LUA_HOT int line_set_value(lua_State *L) {
+    LuaLine *line = (LuaLine *)GPIOD_LUA_CHECK_UDATA(L, 1, GPIOD_LINE_MT);
+    
+    line_write_value(L, line, (int)GPIOD_LUA_CHECK_INTEGER(L, 2));
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// Fast-path closures returned by line:getter() / line:setter()
+// The line userdata is bound as upvalue 1, which also keeps it alive, so
+// calls skip argument type checks and method lookup.
+static GPIOD_LUA_HOT int line_fast_get(lua_State *L) {
+    return line_push_value(L, (LuaLine *)lua_touserdata(L, lua_upvalueindex(1)));
+}
+
+static GPIOD_LUA_HOT int line_fast_set(lua_State *L) {
+    line_write_value(L, (LuaLine *)lua_touserdata(L, lua_upvalueindex(1)), (int)lua_tointeger(L, 1));
+    return 0;
+}
+
+// line:getter()
+// Returns a function() -> value bound to this line
+static int line_getter(lua_State *L) {
+    luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    lua_pushvalue(L, 1);
+    lua_pushcclosure(L, line_fast_get, 1);
+    return 1;
+}
+
+// line:setter()
+// Returns a function(value) bound to this line
+static int line_setter(lua_State *L) {
+    luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    lua_pushvalue(L, 1);
+    lua_pushcclosure(L, line_fast_set, 1);
+    return 1;
+}
+
+// line:offset()
+static int line_offset(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    lua_pushinteger(L, gpiod_line_offset(line->line));
+    return 1;
+}
+
+// line:name()
+static int line_name(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    const char *name = gpiod_line_name(line->line);
+    if (name) {
+        lua_pushstring(L, name);
+    } else {
+        lua_pushnil(L);
+    }
+    return 1;
+}
+
+// line:consumer()
+static int line_consumer(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    const char *consumer = gpiod_line_consumer(line->line);
+    if (consumer) {
+        lua_pushstring(L, consumer);
+    } else {
+        lua_pushnil(L);
+    }
+    return 1;
+}
+
+// Helper function: names of the line info values returned to Lua
+static const char *direction_string(int direction) {
+    switch (direction) {
+        case GPIOD_LINE_DIRECTION_INPUT:
+            return "input";
+        case GPIOD_LINE_DIRECTION_OUTPUT:
+            return "output";
+        default:
+            return "unknown";
+    }
+}
+
+static const char *active_state_string(int state) {
+    switch (state) {
+        case GPIOD_LINE_ACTIVE_STATE_HIGH:
+            return "high";
+        case GPIOD_LINE_ACTIVE_STATE_LOW:
+            return "low";
+        default:
+            return "unknown";
+    }
+}
+
+static const char *bias_string(int bias) {
+    switch (bias) {
+        case GPIOD_LINE_BIAS_AS_IS:
+            return "as_is";
+        case GPIOD_LINE_BIAS_DISABLE:
+            return "disable";
+        case GPIOD_LINE_BIAS_PULL_UP:
+            return "pull_up";
+        case GPIOD_LINE_BIAS_PULL_DOWN:
+            return "pull_down";
+        default:
+            return "unknown";
+    }
+}
+
+// line:direction()
+static int line_direction(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    lua_pushstring(L, direction_string(gpiod_line_direction(line->line)));
+    return 1;
+}
+
+// line:is_used()
+static int line_is_used(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    lua_pushboolean(L, gpiod_line_is_used(line->line));
+    return 1;
+}
+
+// line:release()
+static int line_release(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (line->line) {
+        struct gpiod_line_bulk lines;
+        gpiod_line_bulk_init(&lines);
+        gpiod_line_bulk_add(&lines, line->line);
+        
+        lua_getuservalue(L, 1);
+        release_sampled_lines(L, -1, 1, &lines);
+        lua_pop(L, 1);
+    }
+    
+    if (line->pwm) {
+        soft_pwm_destroy(line->pwm);
+        line->pwm = NULL;
+    }
+    
+    if (line->line) {
+        gpiod_line_release(line->line);
+        line->line = NULL;
+    }
+    debounce_init(&line->debounce, 0);
+    
+    free(line->latency);
+    line->latency = NULL;
+    
+    return 0;
+}
+
+// line:request_rising_edge_events(consumer, [clock])
+static int line_request_rising_edge_events(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    const char *consumer = luaL_checkstring(L, 2);
+    int clock = check_event_clock(L, 3);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    request_event_clock(line->line, clock);
+    int ret = gpiod_line_request_rising_edge_events(line->line, consumer);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to request rising edge events");
+    }
+    
+    line->event_clock = clock;
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// line:request_falling_edge_events(consumer, [clock])
+static int line_request_falling_edge_events(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    const char *consumer = luaL_checkstring(L, 2);
+    int clock = check_event_clock(L, 3);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    request_event_clock(line->line, clock);
+    int ret = gpiod_line_request_falling_edge_events(line->line, consumer);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to request falling edge events");
+    }
+    
+    line->event_clock = clock;
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// line:request_both_edges_events(consumer, [clock])
+static int line_request_both_edges_events(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    const char *consumer = luaL_checkstring(L, 2);
+    int clock = check_event_clock(L, 3);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    request_event_clock(line->line, clock);
+    int ret = gpiod_line_request_both_edges_events(line->line, consumer);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to request both edges events");
+    }
+    
+    line->event_clock = clock;
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// line:request_rising_edge_events_flags(consumer, flags, [clock])
+static int line_request_rising_edge_events_flags(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    const char *consumer = luaL_checkstring(L, 2);
+    int flags = luaL_checkinteger(L, 3);
+    int clock = check_event_clock(L, 4);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    request_event_clock(line->line, clock);
+    int ret = gpiod_line_request_rising_edge_events_flags(line->line, consumer, flags);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to request rising edge events");
+    }
+    
+    line->event_clock = clock;
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// line:request_falling_edge_events_flags(consumer, flags, [clock])
+static int line_request_falling_edge_events_flags(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    const char *consumer = luaL_checkstring(L, 2);
+    int flags = luaL_checkinteger(L, 3);
+    int clock = check_event_clock(L, 4);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    request_event_clock(line->line, clock);
+    int ret = gpiod_line_request_falling_edge_events_flags(line->line, consumer, flags);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to request falling edge events");
+    }
+    
+    line->event_clock = clock;
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// line:request_both_edges_events_flags(consumer, flags, [clock])
+static int line_request_both_edges_events_flags(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    const char *consumer = luaL_checkstring(L, 2);
+    int flags = luaL_checkinteger(L, 3);
+    int clock = check_event_clock(L, 4);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    request_event_clock(line->line, clock);
+    int ret = gpiod_line_request_both_edges_events_flags(line->line, consumer, flags);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to request both edges events");
+    }
+    
+    line->event_clock = clock;
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// line:event_wait(timeout_sec)
+static int line_event_wait(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    lua_Number timeout = luaL_optnumber(L, 2, -1);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    struct timespec ts;
+    GPIOD_LUA_STATS_BEGIN(start_ns);
+    int ret = gpiod_line_event_wait(line->line, timeout_to_timespec(timeout, &ts));
+    GPIOD_LUA_STATS_END(line, GPIOD_LUA_OP_WAIT, start_ns);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to wait for event");
+    }
+    
+    lua_pushboolean(L, ret > 0);
+    return 1;
+}
+
+// line:event_read()
+static int line_event_read(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    LuaLineEvent *event = (LuaLineEvent *)lua_newuserdata(L, sizeof(LuaLineEvent));
+    event->offset = gpiod_line_offset(line->line);
+    
+    // A debounced read keeps waiting until an edge passes the filter
+    GPIOD_LUA_STATS_BEGIN(start_ns);
+    int ret = read_line_events(gpiod_line_event_get_fd(line->line), &line->debounce, &event->event, 1, 1);
+    GPIOD_LUA_STATS_END(line, GPIOD_LUA_OP_READ, start_ns);
+    GPIOD_LUA_STATS_EVENTS(line, ret);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to read event");
+    }
+    latency_record_events(line->latency, &event->event, ret);
+    convert_event_clock(&event->event, 1, line->event_clock);
+    
+    luaL_getmetatable(L, GPIOD_LINE_EVENT_MT);
+    lua_setmetatable(L, -2);
+    
+    return 1;
+}
+
+// line:event_read_multiple([max_events])
+static int line_event_read_multiple(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    int max_events = luaL_optinteger(L, 2, GPIOD_LUA_MAX_EVENTS);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    luaL_argcheck(L, max_events > 0 && max_events <= GPIOD_LUA_MAX_EVENTS, 2,
+                  "max_events out of range");
+    
+    struct gpiod_line_event events[GPIOD_LUA_MAX_EVENTS];
+    GPIOD_LUA_STATS_BEGIN(start_ns);
+    int ret = read_line_events(gpiod_line_event_get_fd(line->line), &line->debounce, events, max_events, 0);
+    GPIOD_LUA_STATS_END(line, GPIOD_LUA_OP_READ, start_ns);
+    GPIOD_LUA_STATS_EVENTS(line, ret);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to read events");
+    }
+    latency_record_events(line->latency, events, ret);
+    convert_event_clock(events, ret, line->event_clock);
+    
+    unsigned int offset = gpiod_line_offset(line->line);
+    lua_createtable(L, ret, 0);
+    for (int i = 0; i < ret; i++) {
+        push_line_event(L, &events[i], offset);
+        lua_rawseti(L, -2, i + 1);
+    }
+    
+    return 1;
+}
+
+// line:event_read_into(buffer)
+// Fills the event buffer in place, replacing its previous contents
+static int line_event_read_into(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    LuaEventBuffer *buf = (LuaEventBuffer *)luaL_checkudata(L, 2, GPIOD_EVENT_BUFFER_MT);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    unsigned int max_events = buf->capacity < GPIOD_LUA_MAX_EVENTS ? buf->capacity : GPIOD_LUA_MAX_EVENTS;
+    
+    buf->count = 0;
+    GPIOD_LUA_STATS_BEGIN(start_ns);
+    int ret = read_line_events(gpiod_line_event_get_fd(line->line), &line->debounce, buf->events, max_events, 0);
+    GPIOD_LUA_STATS_END(line, GPIOD_LUA_OP_READ, start_ns);
+    GPIOD_LUA_STATS_EVENTS(line, ret);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to read events");
+    }
+    latency_record_events(line->latency, buf->events, ret);
+    convert_event_clock(buf->events, ret, line->event_clock);
+    
+    unsigned int offset = gpiod_line_offset(line->line);
+    for (int i = 0; i < ret; i++) {
+        buf->offsets[i] = offset;
+    }
+    buf->count = ret;
+    
+    lua_pushinteger(L, ret);
+    return 1;
+}
+
+// Helper function: read one event without blocking
+// Returns 1 with the event pushed, or 0 when a read would block
+static int line_try_read(lua_State *L, LuaLine *line) {
+    int fd = gpiod_line_event_get_fd(line->line);
+    struct gpiod_line_event event;
+    
+    if (fd < 0) {
+        return luaL_error(L, "Failed to read event");
+    }
+    
+    if (debounce_timeout_ms(&line->debounce) != 0) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN | POLLPRI };
+        int ret = poll(&pfd, 1, 0);
+        if (ret < 0) {
+            return luaL_error(L, "Failed to poll event: %s", strerror(errno));
+        }
+        if (ret == 0) {
+            return 0;
+        }
+    }
+    
+    GPIOD_LUA_STATS_BEGIN(start_ns);
+    int ret = read_line_events(fd, &line->debounce, &event, 1, -1);
+    GPIOD_LUA_STATS_END(line, GPIOD_LUA_OP_READ, start_ns);
+    GPIOD_LUA_STATS_EVENTS(line, ret);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to read event");
+    }
+    if (ret == 0) {
+        return 0;
+    }
+    latency_record_events(line->latency, &event, ret);
+    convert_event_clock(&event, 1, line->event_clock);
+    
+    push_line_event(L, &event, gpiod_line_offset(line->line));
+    return 1;
+}
+
+// line:event_try_read()
+// Returns an event, or nil and "would block" when none is ready
+static int line_event_try_read(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    if (line_try_read(L, line)) {
+        return 1;
+    }
+    
+    lua_pushnil(L);
+    lua_pushliteral(L, "would block");
+    return 2;
+}
+
+// Continuation of line:event_read_yield()
+static int line_event_read_yield_k(lua_State *L, int status, lua_KContext ctx) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    (void)status;
+    (void)ctx;
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    lua_settop(L, 1);
+    if (line_try_read(L, line)) {
+        return 1;
+    }
+    
+    // Yield the line itself: it implements pollfd() / events() / timeout()
+    lua_pushvalue(L, 1);
+    return lua_yieldk(L, 1, 0, line_event_read_yield_k);
+}
+
+// line:event_read_yield()
+// Inside a coroutine, yields the line to the scheduler until an event is
+// ready and returns it; outside a coroutine this is line:event_read()
+static int line_event_read_yield(lua_State *L) {
+    if (!lua_isyieldable(L)) {
+        return line_event_read(L);
+    }
+    return line_event_read_yield_k(L, LUA_OK, 0);
+}
+
+// line:pollfd()
+// Pollable object protocol (cqueues style): the fd to wait on
+static int line_pollfd(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    lua_pushinteger(L, gpiod_line_event_get_fd(line->line));
+    return 1;
+}
+
+// line:events() / bulk:events() / loop:events()
+// Pollable object protocol: the fd is waited on for reading
+static int pollable_events(lua_State *L) {
+    lua_pushliteral(L, "r");
+    return 1;
+}
+
+// line:timeout()
+// Pollable object protocol: seconds until a debounced edge is due, or nil
+static int line_timeout(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    push_poll_timeout(L, debounce_timeout_ms(&line->debounce));
+    return 1;
+}
+
+// line:set_debounce(window_ns)
+// Filters edge events read through the binding: edges are only delivered
+// once the line has been stable for window_ns (0 disables the filter).
+// With the v2 backend a line requested as input or for events is
+// debounced by the kernel instead
+static int line_set_debounce(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    int64_t window_ns = check_debounce_window(L, 2);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    debounce_init(&line->debounce, window_ns);
+#ifdef GPIOD_LUA_BACKEND_V2
+    struct gpiod_line_bulk lines;
+    gpiod_line_bulk_init(&lines);
+    gpiod_line_bulk_add(&lines, line->line);
+    if (kernel_debounce(&lines, &window_ns)) {
+        debounce_init(&line->debounce, 0);
+        line->debounce.kernel_window_ns = window_ns;
+    }
+#endif
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// line:debounce_stats()
+static int line_debounce_stats(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    push_debounce_stats(L, &line->debounce);
+    return 1;
+}
+
+// line:track_latency([enabled])
+// Records the kernel-timestamp-to-Lua delivery latency of every event read
+// through the binding; disabling drops the histogram
+static int line_track_latency(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    int enabled = lua_isnoneornil(L, 2) ? 1 : lua_toboolean(L, 2);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    if (!enabled) {
+        free(line->latency);
+        line->latency = NULL;
+    } else if (!line->latency) {
+        line->latency = (LatencyHistogram *)malloc(sizeof(LatencyHistogram));
+        if (!line->latency) {
+            return luaL_error(L, "Failed to allocate latency histogram");
+        }
+        latency_reset(line->latency);
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// line:latency_histogram([reset])
+// Returns the delivery latency histogram, or nil when not tracking
+static int line_latency_histogram(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (!line->latency) {
+        lua_pushnil(L);
+        return 1;
+    }
+    
+    push_latency_histogram(L, line->latency);
+    if (lua_toboolean(L, 2)) {
+        latency_reset(line->latency);
+    }
+    return 1;
+}
+
+// line:event_get_fd()
+static int line_event_get_fd(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    int fd = gpiod_line_event_get_fd(line->line);
+    if (fd < 0) {
+        return luaL_error(L, "Failed to get event file descriptor");
+    }
+    
+    lua_pushinteger(L, fd);
+    return 1;
+}
+
+// line:active_state()
+static int line_active_state(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    lua_pushstring(L, active_state_string(gpiod_line_active_state(line->line)));
+    return 1;
+}
+
+// line:bias()
+static int line_bias(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    lua_pushstring(L, bias_string(gpiod_line_bias(line->line)));
+    return 1;
+}
+
+// line:is_open_drain()
+static int line_is_open_drain(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    lua_pushboolean(L, gpiod_line_is_open_drain(line->line));
+    return 1;
+}
+
+// line:is_open_source()
+static int line_is_open_source(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    lua_pushboolean(L, gpiod_line_is_open_source(line->line));
+    return 1;
+}
+
+// line:pwm_start(freq_hz, duty, [rt_priority])
+// Starts software PWM on a line requested as output
+static int line_pwm_start(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    int64_t period_ns = check_frequency(L, 2);
+    int64_t high_ns = check_pwm_duty(L, 3, period_ns);
+    int rt_priority = luaL_optinteger(L, 4, 0);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    if (line->pwm) {
+        soft_pwm_destroy(line->pwm);
+        line->pwm = NULL;
+    }
+    
+    struct gpiod_line_bulk bulk;
+    gpiod_line_bulk_init(&bulk);
+    gpiod_line_bulk_add(&bulk, line->line);
+    
+    line->pwm = soft_pwm_start(&bulk, period_ns, &high_ns, rt_priority);
+    if (!line->pwm) {
+        return luaL_error(L, "Failed to start PWM thread: %s", strerror(errno));
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// line:pwm_set_duty(duty)
+static int line_pwm_set_duty(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (!line->pwm) {
+        return luaL_error(L, "PWM is not running");
+    }
+    
+    atomic_store(&line->pwm->high_ns[0], check_pwm_duty(L, 2, line->pwm->period_ns));
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// line:pwm_stop()
+// Stops software PWM and drives the line low
+static int line_pwm_stop(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (line->pwm) {
+        int error = atomic_load(&line->pwm->error);
+        soft_pwm_destroy(line->pwm);
+        line->pwm = NULL;
+        
+        if (error) {
+            return luaL_error(L, "PWM thread failed: %s", strerror(error));
+        }
+    }
+    
+    return 0;
+}
+
+// line:update()
+static int line_update(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
+    
+    char old_name[64] = "";
+    const char *name = gpiod_line_name(line->line);
+    if (name) {
+        snprintf(old_name, sizeof(old_name), "%s", name);
+    }
+    
+    int ret = gpiod_line_update(line->line);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to update line status");
+    }
+    
+    // Keep the chip's name table in sync with the refreshed name. Like
+    // push_chip_names it maps a shared name to the first line carrying it
+    name = gpiod_line_name(line->line);
+    lua_getuservalue(L, 1);
+    if (strcmp(old_name, name ? name : "") != 0 && lua_type(L, -1) == LUA_TUSERDATA) {
+        lua_getuservalue(L, -1);
+        if (lua_getfield(L, -1, "names") == LUA_TTABLE) {
+            lua_Integer offset = gpiod_line_offset(line->line);
+            
+            int owned = old_name[0] && lua_getfield(L, -1, old_name) == LUA_TNUMBER &&
+                        lua_tointeger(L, -1) == offset;
+            if (old_name[0]) {
+                lua_pop(L, 1);
+            }
+            
+            if (owned) {
+                // Another line may still carry the old name: rebuild the
+                // table lazily, as chip:refresh() does
+                lua_pushnil(L);
+                lua_setfield(L, -3, "names");
+            } else if (name) {
+                int type = lua_getfield(L, -1, name);
+                if (type == LUA_TNIL || (type == LUA_TNUMBER && lua_tointeger(L, -1) >= offset)) {
+                    lua_pushinteger(L, offset);
+                    lua_setfield(L, -3, name);
+                }
+            }
+        }
+    }
+    lua_settop(L, 1);
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// ============================================================================
+// Line Bulk related functions
+// ============================================================================
+
+// bulk:num_lines()
+static int bulk_num_lines(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    
+    lua_pushinteger(L, gpiod_line_bulk_num_lines(&bulk->bulk));
+    return 1;
+}
+
+// bulk:get_line(index)
+static int bulk_get_line(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    unsigned int index = luaL_checkinteger(L, 2);
+    
+    if (index >= gpiod_line_bulk_num_lines(&bulk->bulk)) {
+        return luaL_error(L, "Index out of range");
+    }
+    
+    lua_getiuservalue(L, 1, 1);
+    push_line(L, -1, gpiod_line_bulk_get_line(&bulk->bulk, index));
+    
+    LuaLine *line = (LuaLine *)lua_touserdata(L, -1);
+    line->event_clock = bulk->event_clock;
+    
+    return 1;
+}
+
+// bulk:request_input(consumer, [flags])
+static int bulk_request_input(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    const char *consumer = luaL_checkstring(L, 2);
+    int flags = luaL_optinteger(L, 3, 0);
+    
+    int ret = gpiod_line_request_bulk_input_flags(&bulk->bulk, consumer, flags);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to request bulk input mode");
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// Helper function: read one value per bulk line from the table at arg
+// into a caller buffer of GPIOD_LINE_BULK_MAX_LINES entries
+static void check_bulk_values(lua_State *L, int arg, int *values, unsigned int num_lines) {
+    for (unsigned int i = 0; i < num_lines; i++) {
+        lua_rawgeti(L, arg, i + 1);
+        values[i] = luaL_checkinteger(L, -1);
+        lua_pop(L, 1);
+    }
+}
+
+// bulk:request_output(consumer, default_vals, [flags])
+static int bulk_request_output(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    const char *consumer = luaL_checkstring(L, 2);
+    luaL_checktype(L, 3, LUA_TTABLE);
+    int flags = luaL_optinteger(L, 4, 0);
+    
+    int values[GPIOD_LINE_BULK_MAX_LINES];
+    
+    check_bulk_values(L, 3, values, gpiod_line_bulk_num_lines(&bulk->bulk));
+    
+    int ret = gpiod_line_request_bulk_output_flags(&bulk->bulk, consumer, flags, values);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to request bulk output mode");
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// bulk:set_config(direction, [flags], [mask])
+// Reconfigures all lines of a requested bulk in place with one ioctl;
+// bit i of mask is the output value of line i
+static int bulk_set_config(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    int direction = check_direction(L, 2);
+    int flags = luaL_optinteger(L, 3, 0);
+    uint64_t mask = (uint64_t)luaL_optinteger(L, 4, 0);
+    int values[GPIOD_LINE_BULK_MAX_LINES];
+    
+    mask_to_values(mask, values, gpiod_line_bulk_num_lines(&bulk->bulk));
+    
+    int ret = gpiod_line_set_config_bulk(&bulk->bulk, direction, flags, values);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to reconfigure bulk");
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// bulk:set_direction_input()
+static int bulk_set_direction_input(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    
+    int ret = gpiod_line_set_direction_input_bulk(&bulk->bulk);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to set bulk direction");
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// bulk:set_direction_output([mask])
+static int bulk_set_direction_output(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    uint64_t mask = (uint64_t)luaL_optinteger(L, 2, 0);
+    int values[GPIOD_LINE_BULK_MAX_LINES];
+    
+    mask_to_values(mask, values, gpiod_line_bulk_num_lines(&bulk->bulk));
+    
+    int ret = gpiod_line_set_direction_output_bulk(&bulk->bulk, values);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to set bulk direction");
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// bulk:set_flags(flags)
+static int bulk_set_flags(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    int flags = luaL_checkinteger(L, 2);
+    
+    int ret = gpiod_line_set_flags_bulk(&bulk->bulk, flags);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to set bulk flags");
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// bulk:get_values([t])
+// Fills and returns t when given (entries 1..num_lines), else a new table
+static GPIOD_LUA_HOT int bulk_get_values(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)GPIOD_LUA_CHECK_UDATA(L, 1, GPIOD_LINE_BULK_MT);
+    int values[GPIOD_LINE_BULK_MAX_LINES];
+    
+    if (!lua_isnoneornil(L, 2)) {
+        GPIOD_LUA_CHECK_TYPE(L, 2, LUA_TTABLE);
+    }
+    
+    unsigned int num_lines = gpiod_line_bulk_num_lines(&bulk->bulk);
+    
+    GPIOD_LUA_STATS_BEGIN(start_ns);
+    int ret = gpiod_line_get_value_bulk(&bulk->bulk, values);
+    GPIOD_LUA_STATS_END(bulk, GPIOD_LUA_OP_GET, start_ns);
+    if (GPIOD_LUA_UNLIKELY(ret < 0)) {
+        return value_error(L, "Failed to read bulk GPIO values");
+    }
+    
+    // Fill the caller's table in place when one is given
+    if (lua_isnoneornil(L, 2)) {
+        lua_createtable(L, num_lines, 0);
+    } else {
+        lua_settop(L, 2);
+    }
+    for (unsigned int i = 0; i < num_lines; i++) {
+        lua_pushinteger(L, values[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    
+    return 1;
+}
+
+// bulk:set_values(values_table)
+static GPIOD_LUA_HOT int bulk_set_values(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)GPIOD_LUA_CHECK_UDATA(L, 1, GPIOD_LINE_BULK_MT);
+    GPIOD_LUA_CHECK_TYPE(L, 2, LUA_TTABLE);
+    
+    int values[GPIOD_LINE_BULK_MAX_LINES];
+    
+    check_bulk_values(L, 2, values, gpiod_line_bulk_num_lines(&bulk->bulk));
+    
+    GPIOD_LUA_STATS_BEGIN(start_ns);
+    int ret = gpiod_line_set_value_bulk(&bulk->bulk, values);
+    GPIOD_LUA_STATS_END(bulk, GPIOD_LUA_OP_SET, start_ns);
+    if (GPIOD_LUA_UNLIKELY(ret < 0)) {
+        return value_error(L, "Failed to set bulk GPIO values");
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// Helper function: request edge events on every line of a bulk
+static int bulk_request_events(lua_State *L, int request_type, int flags, int clock_arg) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    const char *consumer = luaL_checkstring(L, 2);
+    int clock = check_event_clock(L, clock_arg);
+    
+    struct gpiod_line_request_config config = {
+        .consumer = consumer,
+        .request_type = request_type,
+        .flags = flags,
+    };
+    
+    for (unsigned int i = 0; i < gpiod_line_bulk_num_lines(&bulk->bulk); i++) {
+        request_event_clock(gpiod_line_bulk_get_line(&bulk->bulk, i), clock);
+    }
+    
+    int ret = gpiod_line_request_bulk(&bulk->bulk, &config, NULL);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to request bulk edge events");
+    }
+    
+    bulk->event_clock = clock;
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// bulk:request_rising_edge_events(consumer, [clock])
+static int bulk_request_rising_edge_events(lua_State *L) {
+    return bulk_request_events(L, GPIOD_LINE_REQUEST_EVENT_RISING_EDGE, 0, 3);
+}
+
+// bulk:request_falling_edge_events(consumer, [clock])
+static int bulk_request_falling_edge_events(lua_State *L) {
+    return bulk_request_events(L, GPIOD_LINE_REQUEST_EVENT_FALLING_EDGE, 0, 3);
+}
+
+// bulk:request_both_edges_events(consumer, [clock])
+static int bulk_request_both_edges_events(lua_State *L) {
+    return bulk_request_events(L, GPIOD_LINE_REQUEST_EVENT_BOTH_EDGES, 0, 3);
+}
+
+// bulk:request_rising_edge_events_flags(consumer, flags, [clock])
+static int bulk_request_rising_edge_events_flags(lua_State *L) {
+    return bulk_request_events(L, GPIOD_LINE_REQUEST_EVENT_RISING_EDGE, luaL_checkinteger(L, 3), 4);
+}
+
+// bulk:request_falling_edge_events_flags(consumer, flags, [clock])
+static int bulk_request_falling_edge_events_flags(lua_State *L) {
+    return bulk_request_events(L, GPIOD_LINE_REQUEST_EVENT_FALLING_EDGE, luaL_checkinteger(L, 3), 4);
+}
+
+// bulk:request_both_edges_events_flags(consumer, flags, [clock])
+static int bulk_request_both_edges_events_flags(lua_State *L) {
+    return bulk_request_events(L, GPIOD_LINE_REQUEST_EVENT_BOTH_EDGES, luaL_checkinteger(L, 3), 4);
+}
+
+// bulk:event_wait([timeout_sec])
+// Returns a table with the offsets of lines that have pending events,
+// or nil on timeout
+static int bulk_event_wait(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    lua_Number timeout = luaL_optnumber(L, 2, -1);
+    
+    struct timespec ts;
+    struct gpiod_line_bulk event_bulk;
+    gpiod_line_bulk_init(&event_bulk);
+    
+    GPIOD_LUA_STATS_BEGIN(start_ns);
+    int ret = gpiod_line_event_wait_bulk(&bulk->bulk, timeout_to_timespec(timeout, &ts), &event_bulk);
+    GPIOD_LUA_STATS_END(bulk, GPIOD_LUA_OP_WAIT, start_ns);
+    if (ret < 0) {
+        return luaL_error(L, "Failed to wait for bulk events");
+    }
+    
+    if (ret == 0) {
+        lua_pushnil(L);
+        return 1;
+    }
+    
+    unsigned int num_lines = gpiod_line_bulk_num_lines(&event_bulk);
+    lua_createtable(L, num_lines, 0);
+    for (unsigned int i = 0; i < num_lines; i++) {
+        lua_pushinteger(L, gpiod_line_offset(gpiod_line_bulk_get_line(&event_bulk, i)));
+        lua_rawseti(L, -2, i + 1);
+    }
+    
+    return 1;
+}
+
+// Helper function: find the bulk lines that have events to read without
+// blocking (bit i = line i), including debounced lines whose last burst
+// has not been delivered yet
+static uint64_t bulk_ready_mask(lua_State *L, LuaLineBulk *bulk) {
+    struct timespec ts = { 0, 0 };
+    struct gpiod_line_bulk event_bulk;
+    gpiod_line_bulk_init(&event_bulk);
+    
+    int ret = gpiod_line_event_wait_bulk(&bulk->bulk, &ts, &event_bulk);
+    if (ret < 0) {
+        luaL_error(L, "Failed to poll bulk events");
+    }
+    
+    uint64_t mask = 0;
+    unsigned int num_lines = gpiod_line_bulk_num_lines(&bulk->bulk);
+    unsigned int num_ready = ret > 0 ? gpiod_line_bulk_num_lines(&event_bulk) : 0;
+    
+    // Ready lines are reported in bulk order
+    for (unsigned int i = 0, j = 0; i < num_lines && j < num_ready; i++) {
+        if (gpiod_line_bulk_get_line(&bulk->bulk, i) == gpiod_line_bulk_get_line(&event_bulk, j)) {
+            mask |= (uint64_t)1 << i;
+            j++;
+        }
+    }
+    
+    if (bulk->debounce) {
+        for (unsigned int i = 0; i < num_lines; i++) {
+            if (bulk->debounce[i].in_burst) {
+                mask |= (uint64_t)1 << i;
+            }
+        }
+    }
+    
+    return mask;
+}
+
+// bulk:event_read_multiple([max_per_line])
+// Drains pending events from every line of the bulk without blocking
+static int bulk_event_read_multiple(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    int max_events = luaL_optinteger(L, 2, GPIOD_LUA_MAX_EVENTS);
+    
+    luaL_argcheck(L, max_events > 0 && max_events <= GPIOD_LUA_MAX_EVENTS, 2,
+                  "max_per_line out of range");
+    
+    uint64_t ready = bulk_ready_mask(L, bulk);
+    
+    lua_newtable(L);
+    
+    struct gpiod_line_event events[GPIOD_LUA_MAX_EVENTS];
+    int count = 0;
+    unsigned int num_lines = gpiod_line_bulk_num_lines(&bulk->bulk);
+    
+    for (unsigned int i = 0; i < num_lines; i++) {
+        if (!(ready >> i & 1)) {
+            continue;
+        }
+        
+        struct gpiod_line *line = gpiod_line_bulk_get_line(&bulk->bulk, i);
+        
+        GPIOD_LUA_STATS_BEGIN(start_ns);
+        int ret = read_line_events(gpiod_line_event_get_fd(line), bulk->debounce ? &bulk->debounce[i] : NULL,
+                                   events, max_events, 0);
+        GPIOD_LUA_STATS_END(bulk, GPIOD_LUA_OP_READ, start_ns);
+        GPIOD_LUA_STATS_EVENTS(bulk, ret);
+        if (ret < 0) {
+            return luaL_error(L, "Failed to read bulk events");
+        }
+        latency_record_events(bulk->latency ? &bulk->latency[i] : NULL, events, ret);
+        convert_event_clock(events, ret, bulk->event_clock);
+        
+        unsigned int offset = gpiod_line_offset(line);
+        for (int j = 0; j < ret; j++) {
+            push_line_event(L, &events[j], offset);
+            lua_rawseti(L, -2, ++count);
+        }
+    }
+    
+    return 1;
+}
+
+// bulk:event_read_into(buffer)
+// Drains pending events from every line of the bulk without blocking,
+// filling the event buffer in place until it is full
+static int bulk_event_read_into(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    LuaEventBuffer *buf = (LuaEventBuffer *)luaL_checkudata(L, 2, GPIOD_EVENT_BUFFER_MT);
+    
+    buf->count = 0;
+    uint64_t ready = bulk_ready_mask(L, bulk);
+    
+    unsigned int num_lines = gpiod_line_bulk_num_lines(&bulk->bulk);
+    for (unsigned int i = 0; i < num_lines && buf->count < buf->capacity; i++) {
+        if (!(ready >> i & 1)) {
+            continue;
+        }
+        
+        struct gpiod_line *line = gpiod_line_bulk_get_line(&bulk->bulk, i);
+        unsigned int space = buf->capacity - buf->count;
+        
+        GPIOD_LUA_STATS_BEGIN(start_ns);
+        int ret = read_line_events(gpiod_line_event_get_fd(line), bulk->debounce ? &bulk->debounce[i] : NULL,
+                                   buf->events + buf->count,
+                                   space < GPIOD_LUA_MAX_EVENTS ? space : GPIOD_LUA_MAX_EVENTS, 0);
+        GPIOD_LUA_STATS_END(bulk, GPIOD_LUA_OP_READ, start_ns);
+        GPIOD_LUA_STATS_EVENTS(bulk, ret);
+        if (ret < 0) {
+            return luaL_error(L, "Failed to read bulk events");
+        }
+        latency_record_events(bulk->latency ? &bulk->latency[i] : NULL, buf->events + buf->count, ret);
+        convert_event_clock(buf->events + buf->count, ret, bulk->event_clock);
+        
+        unsigned int offset = gpiod_line_offset(line);
+        for (int j = 0; j < ret; j++) {
+            buf->offsets[buf->count++] = offset;
+        }
+    }
+    
+    lua_pushinteger(L, buf->count);
+    return 1;
+}
+
+// Continuation of bulk:event_read_yield()
+static int bulk_event_read_yield_k(lua_State *L, int status, lua_KContext ctx) {
+    (void)status;
+    (void)ctx;
+    
+    lua_settop(L, 1);
+    bulk_event_read_multiple(L);
+    if (lua_rawlen(L, -1) > 0) {
+        return 1;
+    }
+    lua_pop(L, 1);
+    
+    lua_pushvalue(L, 1);
+    return lua_yieldk(L, 1, 0, bulk_event_read_yield_k);
+}
+
+// Helper function: poll() timeout in ms until a debounced edge of the bulk
+// is due, or -1 when none is pending
+static int bulk_timeout_ms(LuaLineBulk *bulk) {
+    int timeout_ms = -1;
+    
+    if (bulk->debounce) {
+        unsigned int num_lines = gpiod_line_bulk_num_lines(&bulk->bulk);
+        for (unsigned int i = 0; i < num_lines; i++) {
+            int ms = debounce_timeout_ms(&bulk->debounce[i]);
+            if (ms >= 0 && (timeout_ms < 0 || ms < timeout_ms)) {
+                timeout_ms = ms;
+            }
+        }
+    }
+    
+    return timeout_ms;
+}
+
+// bulk:event_read_yield()
+// Inside a coroutine, yields the bulk to the scheduler until events are
+// ready and returns them as bulk:event_read_multiple() does; outside a
+// coroutine it blocks until then
+static int bulk_event_read_yield(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    
+    if (lua_isyieldable(L)) {
+        return bulk_event_read_yield_k(L, LUA_OK, 0);
+    }
+    
+    for (;;) {
+        lua_settop(L, 1);
+        bulk_event_read_multiple(L);
+        if (lua_rawlen(L, -1) > 0) {
+            return 1;
+        }
+        
+        struct timespec ts;
+        int timeout_ms = bulk_timeout_ms(bulk);
+        if (gpiod_line_event_wait_bulk(&bulk->bulk, timeout_to_timespec(timeout_ms / 1000.0, &ts), NULL) < 0) {
+            return luaL_error(L, "Failed to wait for bulk events");
+        }
+    }
+}
+
+// bulk:pollfd()
+// Pollable object protocol: an epoll fd that is readable while any line of
+// the bulk has events (created on first use, closed on release)
+static int bulk_pollfd(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    
+    if (bulk->epfd < 0) {
+        int epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd < 0) {
+            return luaL_error(L, "Failed to create poll fd: %s", strerror(errno));
+        }
+        
+        unsigned int num_lines = gpiod_line_bulk_num_lines(&bulk->bulk);
+        for (unsigned int i = 0; i < num_lines; i++) {
+            struct gpiod_line *line = gpiod_line_bulk_get_line(&bulk->bulk, i);
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN;
+            ev.data.u32 = i;
+            
+            int fd = gpiod_line_event_get_fd(line);
+            if (fd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                close(epfd);
+                return luaL_error(L, "Line %d is not requested for events", gpiod_line_offset(line));
+            }
+        }
+        bulk->epfd = epfd;
+    }
+    
+    lua_pushinteger(L, bulk->epfd);
+    return 1;
+}
+
+// bulk:timeout()
+// Pollable object protocol: seconds until a debounced edge is due, or nil
+static int bulk_timeout(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    
+    push_poll_timeout(L, bulk_timeout_ms(bulk));
+    return 1;
+}
+
+// bulk:set_debounce(window_ns | windows)
+// Sets one debounce window for all lines, or one per line from a table
+static int bulk_set_debounce(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    unsigned int num_lines = gpiod_line_bulk_num_lines(&bulk->bulk);
+    int64_t windows[GPIOD_LINE_BULK_MAX_LINES];
+    int enabled = 0;
+    
+    if (lua_istable(L, 2)) {
+        luaL_argcheck(L, lua_rawlen(L, 2) == num_lines, 2, "expected one window per line");
+        for (unsigned int i = 0; i < num_lines; i++) {
+            lua_rawgeti(L, 2, i + 1);
+            windows[i] = check_debounce_window(L, -1);
+            lua_pop(L, 1);
+            enabled |= windows[i] != 0;
+        }
+    } else {
+        int64_t window_ns = check_debounce_window(L, 2);
+        for (unsigned int i = 0; i < num_lines; i++) {
+            windows[i] = window_ns;
+        }
+        enabled = window_ns != 0;
+    }
+    
+#ifdef GPIOD_LUA_BACKEND_V2
+    int kernel = kernel_debounce(&bulk->bulk, windows);
+#else
+    int kernel = 0;
+#endif
+    
+    if (!enabled) {
+        free(bulk->debounce);
+        bulk->debounce = NULL;
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+    
+    if (!bulk->debounce) {
+        bulk->debounce = (LineDebounce *)malloc(num_lines * sizeof(LineDebounce));
+        if (!bulk->debounce) {
+            return luaL_error(L, "Memory allocation failed");
+        }
+    }
+    for (unsigned int i = 0; i < num_lines; i++) {
+        debounce_init(&bulk->debounce[i], kernel ? 0 : windows[i]);
+        bulk->debounce[i].kernel_window_ns = kernel ? windows[i] : 0;
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// bulk:debounce_stats()
+// Returns one counter table per line
+static int bulk_debounce_stats(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    unsigned int num_lines = gpiod_line_bulk_num_lines(&bulk->bulk);
+    LineDebounce off;
+    
+    debounce_init(&off, 0);
+    lua_createtable(L, num_lines, 0);
+    for (unsigned int i = 0; i < num_lines; i++) {
+        push_debounce_stats(L, bulk->debounce ? &bulk->debounce[i] : &off);
+        lua_rawseti(L, -2, i + 1);
+    }
+    
+    return 1;
+}
+
+// bulk:track_latency([enabled])
+// Per-line delivery latency tracking, see line:track_latency()
+static int bulk_track_latency(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    int enabled = lua_isnoneornil(L, 2) ? 1 : lua_toboolean(L, 2);
+    unsigned int num_lines = gpiod_line_bulk_num_lines(&bulk->bulk);
+    
+    if (!enabled) {
+        free(bulk->latency);
+        bulk->latency = NULL;
+    } else if (!bulk->latency && num_lines > 0) {
+        bulk->latency = (LatencyHistogram *)malloc(num_lines * sizeof(LatencyHistogram));
+        if (!bulk->latency) {
+            return luaL_error(L, "Failed to allocate latency histograms");
+        }
+        for (unsigned int i = 0; i < num_lines; i++) {
+            latency_reset(&bulk->latency[i]);
+        }
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// bulk:latency_histogram([reset])
+// Returns one histogram table per line, or nil when not tracking
+static int bulk_latency_histogram(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    unsigned int num_lines = gpiod_line_bulk_num_lines(&bulk->bulk);
+    int reset = lua_toboolean(L, 2);
+    
+    if (!bulk->latency) {
+        lua_pushnil(L);
+        return 1;
+    }
+    
+    lua_createtable(L, num_lines, 0);
+    for (unsigned int i = 0; i < num_lines; i++) {
+        push_latency_histogram(L, &bulk->latency[i]);
+        lua_rawseti(L, -2, i + 1);
+        if (reset) {
+            latency_reset(&bulk->latency[i]);
+        }
+    }
+    
+    return 1;
+}
+
+// Helper function: read all values of a bulk and push them as a mask
+// Shared by bulk:get_mask() and the bulk:getter() closure
+static inline int bulk_push_mask(lua_State *L, LuaLineBulk *bulk) {
+    int values[GPIOD_LINE_BULK_MAX_LINES];
+    
+    GPIOD_LUA_STATS_BEGIN(start_ns);
+    int ret = gpiod_line_get_value_bulk(&bulk->bulk, values);
+    GPIOD_LUA_STATS_END(bulk, GPIOD_LUA_OP_GET, start_ns);
+    if (GPIOD_LUA_UNLIKELY(ret < 0)) {
+        return value_error(L, "Failed to read bulk GPIO values");
+    }
+    
+    lua_pushinteger(L, (lua_Integer)values_to_mask(values, gpiod_line_bulk_num_lines(&bulk->bulk)));
+    return 1;
+}
+
+// Helper function: set all values of a bulk from a mask
+// Shared by bulk:set_mask() and the bulk:setter() closure
+static inline int bulk_write_mask(lua_State *L, LuaLineBulk *bulk, uint64_t mask) {
+    int values[GPIOD_LINE_BULK_MAX_LINES];
+    
+    mask_to_values(mask, values, gpiod_line_bulk_num_lines(&bulk->bulk));
+    
+    GPIOD_LUA_STATS_BEGIN(start_ns);
+    int ret = gpiod_line_set_value_bulk(&bulk->bulk, values);
+    GPIOD_LUA_STATS_END(bulk, GPIOD_LUA_OP_SET, start_ns);
+    if (GPIOD_LUA_UNLIKELY(ret < 0)) {
+        return value_error(L, "Failed to set bulk GPIO values");
+    }
+    return 0;
+}
+
+// bulk:get_mask()
+// Returns all values packed into one integer (bit i = line i)
+static GPIOD_LUA_HOT int bulk_get_mask(lua_State *L) {
+    return bulk_push_mask(L, (LuaLineBulk *)GPIOD_LUA_CHECK_UDATA(L, 1, GPIOD_LINE_BULK_MT));
+}
+
+// bulk:set_mask(mask)
+// Sets all values from one integer (bit i = line i)
+static GPIOD_LUA_HOT int bulk_set_mask(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)GPIOD_LUA_CHECK_UDATA(L, 1, GPIOD_LINE_BULK_MT);
+    
+    bulk_write_mask(L, bulk, (uint64_t)GPIOD_LUA_CHECK_INTEGER(L, 2));
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// Fast-path closures returned by bulk:getter() / bulk:setter()
+// The bulk userdata is bound as upvalue 1 (see line_fast_get)
+static GPIOD_LUA_HOT int bulk_fast_get(lua_State *L) {
+    return bulk_push_mask(L, (LuaLineBulk *)lua_touserdata(L, lua_upvalueindex(1)));
+}
+
+static GPIOD_LUA_HOT int bulk_fast_set(lua_State *L) {
+    bulk_write_mask(L, (LuaLineBulk *)lua_touserdata(L, lua_upvalueindex(1)), (uint64_t)lua_tointeger(L, 1));
+    return 0;
+}
+
+// bulk:getter()
+// Returns a function() -> mask bound to this bulk
+static int bulk_getter(lua_State *L) {
+    luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    
+    lua_pushvalue(L, 1);
+    lua_pushcclosure(L, bulk_fast_get, 1);
+    return 1;
+}
+
+// bulk:setter()
+// Returns a function(mask) bound to this bulk
+static int bulk_setter(lua_State *L) {
+    luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    
+    lua_pushvalue(L, 1);
+    lua_pushcclosure(L, bulk_fast_set, 1);
+    return 1;
+}
+
+// bulk:load_waveform(steps)
+// steps is a sequence of { mask, delay_ns } pairs
+static int bulk_load_waveform(lua_State *L) {
+    luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    
+    unsigned int num_steps = lua_rawlen(L, 2);
+    luaL_argcheck(L, num_steps > 0, 2, "waveform has no steps");
+    
+    LuaWaveform *wave = (LuaWaveform *)lua_newuserdata(L, sizeof(LuaWaveform) + num_steps * sizeof(WaveformStep));
+    wave->num_steps = num_steps;
+    
+    luaL_getmetatable(L, GPIOD_WAVEFORM_MT);
+    lua_setmetatable(L, -2);
+    
+    for (unsigned int i = 0; i < num_steps; i++) {
+        if (lua_rawgeti(L, 2, i + 1) != LUA_TTABLE) {
+            return luaL_error(L, "Waveform step %d is not a { mask, delay_ns } table", i + 1);
+        }
+        
+        int mask_ok, delay_ok;
+        lua_rawgeti(L, -1, 1);
+        lua_rawgeti(L, -2, 2);
+        wave->steps[i].mask = (uint64_t)lua_tointegerx(L, -2, &mask_ok);
+        wave->steps[i].delay_ns = lua_tointegerx(L, -1, &delay_ok);
+        lua_pop(L, 3);
+        
+        if (!mask_ok || !delay_ok || wave->steps[i].delay_ns < 0) {
+            return luaL_error(L, "Waveform step %d needs an integer mask and a non-negative delay_ns", i + 1);
+        }
+    }
+    
+    lua_setiuservalue(L, 1, 2);
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// Helper function: run the calling thread under SCHED_FIFO at rt_priority
+// for a timed loop (no change when rt_priority is 0); saves the previous
+// policy for leave_rt_priority()
+static void enter_rt_priority(lua_State *L, int rt_priority, int *old_policy, struct sched_param *old_param) {
+    if (rt_priority > 0) {
+        struct sched_param param;
+        param.sched_priority = rt_priority;
+        
+        pthread_getschedparam(pthread_self(), old_policy, old_param);
+        int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (ret != 0) {
+            luaL_error(L, "Failed to set SCHED_FIFO priority: %s", strerror(ret));
+        }
+    }
+}
+
+// Helper function: restore the policy saved by enter_rt_priority()
+static void leave_rt_priority(int rt_priority, int old_policy, const struct sched_param *old_param) {
+    if (rt_priority > 0) {
+        pthread_setschedparam(pthread_self(), old_policy, old_param);
+    }
+}
+
+// bulk:play([repeat_count], [rt_priority])
+// Plays the loaded waveform in C using absolute deadlines, optionally with
+// SCHED_FIFO at the given priority. Returns the number of late steps and
+// the maximum lateness in nanoseconds.
+static int bulk_play(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    lua_Integer repeat_count = luaL_optinteger(L, 2, 1);
+    int rt_priority = luaL_optinteger(L, 3, 0);
+    
+    luaL_argcheck(L, repeat_count > 0, 2, "repeat_count must be positive");
+    
+    lua_getiuservalue(L, 1, 2);
+    LuaWaveform *wave = (LuaWaveform *)luaL_testudata(L, -1, GPIOD_WAVEFORM_MT);
+    if (!wave) {
+        return luaL_error(L, "No waveform loaded");
+    }
+    
+    int old_policy = 0;
+    struct sched_param old_param;
+    enter_rt_priority(L, rt_priority, &old_policy, &old_param);
+    
+    unsigned int num_lines = gpiod_line_bulk_num_lines(&bulk->bulk);
+    int values[GPIOD_LINE_BULK_MAX_LINES];
+    lua_Integer late_steps = 0;
+    int64_t max_late_ns = 0;
+    int failed = 0;
+    
+    int64_t deadline = monotonic_ns();
+    for (lua_Integer r = 0; r < repeat_count && !failed; r++) {
+        for (unsigned int i = 0; i < wave->num_steps; i++) {
+            mask_to_values(wave->steps[i].mask, values, num_lines);
+            if (gpiod_line_set_value_bulk(&bulk->bulk, values) < 0) {
+                failed = 1;
+                break;
+            }
+            
+            deadline += wave->steps[i].delay_ns;
+            int64_t late = monotonic_ns() - deadline;
+            if (late > 0) {
+                late_steps++;
+                if (late > max_late_ns) {
+                    max_late_ns = late;
+                }
+            } else {
+                sleep_until_ns(deadline, 0);
+            }
+        }
+    }
+    
+    leave_rt_priority(rt_priority, old_policy, &old_param);
+    
+    if (failed) {
+        return luaL_error(L, "Failed to set bulk GPIO values");
+    }
+    
+    lua_pushinteger(L, late_steps);
+    lua_pushinteger(L, max_late_ns);
+    return 2;
+}
+
+// bulk:sample(rate_hz, count, [rt_priority])
+// Reads the bulk count times on an absolute-deadline grid in C. Returns a
+// string of count packed native integers (string.unpack format "j"), one
+// value bitmask per sample, the number of late samples and the maximum
+// lateness in nanoseconds
+static int bulk_sample(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    int64_t period_ns = check_frequency(L, 2);
+    lua_Integer count = luaL_checkinteger(L, 3);
+    int rt_priority = luaL_optinteger(L, 4, 0);
+    
+    luaL_argcheck(L, count > 0 && count <= GPIOD_LUA_MAX_SAMPLES, 3, "count out of range");
+    
+    luaL_Buffer b;
+    lua_Integer *samples = (lua_Integer *)luaL_buffinitsize(L, &b, count * sizeof(lua_Integer));
+    
+    int old_policy = 0;
+    struct sched_param old_param;
+    enter_rt_priority(L, rt_priority, &old_policy, &old_param);
+    
+    unsigned int num_lines = gpiod_line_bulk_num_lines(&bulk->bulk);
+    int values[GPIOD_LINE_BULK_MAX_LINES];
+    lua_Integer late_samples = 0;
+    int64_t max_late_ns = 0;
+    int failed = 0;
+    
+    int64_t deadline = monotonic_ns();
+    for (lua_Integer i = 0; i < count; i++) {
+        int64_t late = monotonic_ns() - deadline;
+        if (late > 0) {
+            late_samples++;
+            if (late > max_late_ns) {
+                max_late_ns = late;
+            }
+        }
+        
+        GPIOD_LUA_STATS_BEGIN(start_ns);
+        int ret = gpiod_line_get_value_bulk(&bulk->bulk, values);
+        GPIOD_LUA_STATS_END(bulk, GPIOD_LUA_OP_GET, start_ns);
+        if (ret < 0) {
+            failed = 1;
+            break;
+        }
+        samples[i] = (lua_Integer)values_to_mask(values, num_lines);
+        
+        deadline += period_ns;
+        if (i + 1 < count && monotonic_ns() < deadline) {
+            sleep_until_ns(deadline, 0);
+        }
+    }
+    
+    leave_rt_priority(rt_priority, old_policy, &old_param);
+    
+    if (failed) {
+        return luaL_error(L, "Failed to read bulk GPIO values");
+    }
+    
+    luaL_pushresultsize(&b, count * sizeof(lua_Integer));
+    lua_pushinteger(L, late_samples);
+    lua_pushinteger(L, max_late_ns);
+    return 3;
+}
+
+// bulk:pwm_start(freq_hz, duties, [rt_priority])
+// Starts phase-aligned software PWM on all lines (requested as outputs);
+// duties is a table with one duty cycle (0..1) per line
+static int bulk_pwm_start(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    int64_t period_ns = check_frequency(L, 2);
+    luaL_checktype(L, 3, LUA_TTABLE);
+    int rt_priority = luaL_optinteger(L, 4, 0);
+    
+    unsigned int num_lines = gpiod_line_bulk_num_lines(&bulk->bulk);
+    int64_t high_ns[GPIOD_LINE_BULK_MAX_LINES];
+    
+    check_pwm_duties(L, 3, num_lines, period_ns, high_ns);
+    
+    if (bulk->pwm) {
+        soft_pwm_destroy(bulk->pwm);
+        bulk->pwm = NULL;
+    }
+    
+    bulk->pwm = soft_pwm_start(&bulk->bulk, period_ns, high_ns, rt_priority);
+    if (!bulk->pwm) {
+        return luaL_error(L, "Failed to start PWM thread: %s", strerror(errno));
+    }
+    
+    lua_getiuservalue(L, 1, 1);
+    track_thread(L, -1, 1, 1);
+    lua_pop(L, 1);
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// bulk:pwm_set_duty(index, duty) or bulk:pwm_set_duty(duties)
+static int bulk_pwm_set_duty(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    
+    if (!bulk->pwm) {
+        return luaL_error(L, "PWM is not running");
+    }
+    
+    unsigned int num_lines = gpiod_line_bulk_num_lines(&bulk->bulk);
+    
+    if (lua_istable(L, 2)) {
+        // Check every duty before changing any of them
+        int64_t high_ns[GPIOD_LINE_BULK_MAX_LINES];
+        check_pwm_duties(L, 2, num_lines, bulk->pwm->period_ns, high_ns);
+        for (unsigned int i = 0; i < num_lines; i++) {
+            atomic_store(&bulk->pwm->high_ns[i], high_ns[i]);
+        }
+    } else {
+        lua_Integer index = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, index >= 0 && index < num_lines, 2, "Index out of range");
+        atomic_store(&bulk->pwm->high_ns[index], check_pwm_duty(L, 3, bulk->pwm->period_ns));
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// bulk:pwm_stop()
+// Stops software PWM and drives all lines low
+static int bulk_pwm_stop(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    
+    if (bulk->pwm) {
+        int error = atomic_load(&bulk->pwm->error);
+        soft_pwm_destroy(bulk->pwm);
+        bulk->pwm = NULL;
+        
+        if (error) {
+            return luaL_error(L, "PWM thread failed: %s", strerror(error));
+        }
+    }
+    
+    return 0;
+}
+
+// bulk:release()
+static int bulk_release(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    
+    lua_getiuservalue(L, 1, 1);
+    LuaChip *chip = (LuaChip *)lua_touserdata(L, -1);
+    
+    // The lines of a closed chip are already freed (and its threads stopped)
+    if (chip->chip) {
+        release_sampled_lines(L, -1, 1, &bulk->bulk);
+    }
+    lua_pop(L, 1);
+    
+    if (bulk->pwm) {
+        soft_pwm_destroy(bulk->pwm);
+        bulk->pwm = NULL;
+    }
+    
+    if (chip->chip) {
+        gpiod_line_release_bulk(&bulk->bulk);
+    }
+    
+    free(bulk->debounce);
+    bulk->debounce = NULL;
+    free(bulk->latency);
+    bulk->latency = NULL;
+    
+    if (bulk->epfd >= 0) {
+        close(bulk->epfd);
+        bulk->epfd = -1;
+    }
+    return 0;
+}
+
+// ============================================================================
+// Line Group related functions
+// ============================================================================
+
+// Helper function: set all members back-to-back from one mask
+// Returns NULL on success or the failing member's bulk with errno set
+static LuaLineBulk *group_set(LuaLineGroup *grp, uint64_t mask) {
+    int values[GPIOD_LINE_BULK_MAX_LINES];
+    int64_t first_done = 0;
+    int64_t done = 0;
+    
+    // Unpack everything before the first ioctl
+    mask_to_values(mask, values, grp->num_lines);
+    
+    for (unsigned int i = 0; i < grp->num_members; i++) {
+        GroupMember *m = &grp->members[i];
+        
+        int64_t start = monotonic_ns();
+        GPIOD_LUA_STATS_BEGIN(start_ns);
+        int ret = gpiod_line_set_value_bulk(&m->bulk->bulk, &values[m->shift]);
+        GPIOD_LUA_STATS_END(m->bulk, GPIOD_LUA_OP_SET, start_ns);
+        done = monotonic_ns();
+        if (ret < 0) {
+            return m->bulk;
+        }
+        
+        m->avg_ns = m->avg_ns ? m->avg_ns + (done - start - m->avg_ns) / 8 : done - start;
+        if (i == 0) {
+            first_done = done;
+        }
+    }
+    
+    grp->sets++;
+    grp->last_skew_ns = done - first_done;
+    if (grp->last_skew_ns > grp->max_skew_ns) {
+        grp->max_skew_ns = grp->last_skew_ns;
+    }
+    
+    // Keep the slowest member first (insertion sort: few members, and the
+    // order rarely changes)
+    for (unsigned int i = 1; i < grp->num_members; i++) {
+        GroupMember m = grp->members[i];
+        unsigned int j = i;
+        while (j > 0 && grp->members[j - 1].avg_ns < m.avg_ns) {
+            grp->members[j] = grp->members[j - 1];
+            j--;
+        }
+        grp->members[j] = m;
+    }
+    
+    return NULL;
+}
+
+// gpiod.group(bulk, ...)
+// Groups output bulks of one or more chips; bit i of a group mask maps to
+// line i of the concatenation of the bulks in argument order
+static int gpiod_group(lua_State *L) {
+    int num_members = lua_gettop(L);
+    unsigned int num_lines = 0;
+    
+    luaL_argcheck(L, num_members > 0, 1, "expected at least one line bulk");
+    for (int i = 1; i <= num_members; i++) {
+        LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, i, GPIOD_LINE_BULK_MT);
+        num_lines += gpiod_line_bulk_num_lines(&bulk->bulk);
+    }
+    if (num_lines > GPIOD_LINE_BULK_MAX_LINES) {
+        return luaL_error(L, "Group has %d lines, at most %d are supported", num_lines, GPIOD_LINE_BULK_MAX_LINES);
+    }
+    
+    LuaLineGroup *grp = (LuaLineGroup *)lua_newuserdata(L, sizeof(LuaLineGroup) + num_members * sizeof(GroupMember));
+    grp->num_members = num_members;
+    grp->num_lines = num_lines;
+    grp->sets = 0;
+    grp->last_skew_ns = 0;
+    grp->max_skew_ns = 0;
+    
+    // The user value keeps the member bulks alive
+    lua_createtable(L, num_members, 0);
+    unsigned int shift = 0;
+    for (int i = 0; i < num_members; i++) {
+        LuaLineBulk *bulk = (LuaLineBulk *)lua_touserdata(L, i + 1);
+        
+        grp->members[i].bulk = bulk;
+        grp->members[i].shift = shift;
+        grp->members[i].index = i + 1;
+        grp->members[i].avg_ns = 0;
+        shift += gpiod_line_bulk_num_lines(&bulk->bulk);
+        
+        lua_pushvalue(L, i + 1);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setuservalue(L, -2);
+    
+    luaL_getmetatable(L, GPIOD_LINE_GROUP_MT);
+    lua_setmetatable(L, -2);
+    
+    return 1;
+}
+
+// group:set_mask(mask)
+// Issues the per-chip set ioctls back-to-back from C; returns the skew in
+// ns between the first and the last completed set
+static int group_set_mask(lua_State *L) {
+    LuaLineGroup *grp = (LuaLineGroup *)luaL_checkudata(L, 1, GPIOD_LINE_GROUP_MT);
+    uint64_t mask = (uint64_t)luaL_checkinteger(L, 2);
+    
+    LuaLineBulk *failed = group_set(grp, mask);
+    if (failed) {
+        return luaL_error(L, "Failed to set group GPIO values on %s: %s",
+                          gpiod_chip_name(failed->chip), strerror(errno));
+    }
+    
+    lua_pushinteger(L, grp->last_skew_ns);
+    return 1;
+}
+
+// group:get_mask()
+// Reads all members back-to-back into one mask
+static int group_get_mask(lua_State *L) {
+    LuaLineGroup *grp = (LuaLineGroup *)luaL_checkudata(L, 1, GPIOD_LINE_GROUP_MT);
+    int values[GPIOD_LINE_BULK_MAX_LINES];
+    
+    for (unsigned int i = 0; i < grp->num_members; i++) {
+        GroupMember *m = &grp->members[i];
+        
+        GPIOD_LUA_STATS_BEGIN(start_ns);
+        int ret = gpiod_line_get_value_bulk(&m->bulk->bulk, &values[m->shift]);
+        GPIOD_LUA_STATS_END(m->bulk, GPIOD_LUA_OP_GET, start_ns);
+        if (ret < 0) {
+            return luaL_error(L, "Failed to read group GPIO values on %s: %s",
+                              gpiod_chip_name(m->bulk->chip), strerror(errno));
+        }
+    }
+    
+    lua_pushinteger(L, (lua_Integer)values_to_mask(values, grp->num_lines));
+    return 1;
+}
+
+// Fast-path closure returned by group:setter()
+// The group userdata is bound as upvalue 1
+static int group_fast_set(lua_State *L) {
+    LuaLineGroup *grp = (LuaLineGroup *)lua_touserdata(L, lua_upvalueindex(1));
+    
+    LuaLineBulk *failed = group_set(grp, (uint64_t)lua_tointeger(L, 1));
+    if (failed) {
+        return luaL_error(L, "Failed to set group GPIO values on %s: %s",
+                          gpiod_chip_name(failed->chip), strerror(errno));
+    }
+    
+    return 0;
+}
+
+// group:setter()
+// Returns a function(mask) bound to this group
+static int group_setter(lua_State *L) {
+    luaL_checkudata(L, 1, GPIOD_LINE_GROUP_MT);
+    
+    lua_pushvalue(L, 1);
+    lua_pushcclosure(L, group_fast_set, 1);
+    return 1;
+}
+
+// group:num_lines()
+static int group_num_lines(lua_State *L) {
+    LuaLineGroup *grp = (LuaLineGroup *)luaL_checkudata(L, 1, GPIOD_LINE_GROUP_MT);
+    
+    lua_pushinteger(L, grp->num_lines);
+    return 1;
+}
+
+// group:timing([reset])
+// Returns the skew statistics and the current issue order (member
+// positions with their average set time)
+static int group_timing(lua_State *L) {
+    LuaLineGroup *grp = (LuaLineGroup *)luaL_checkudata(L, 1, GPIOD_LINE_GROUP_MT);
+    
+    lua_createtable(L, 0, 5);
+    lua_pushinteger(L, (lua_Integer)grp->sets);
+    lua_setfield(L, -2, "sets");
+    lua_pushinteger(L, grp->last_skew_ns);
+    lua_setfield(L, -2, "last_skew_ns");
+    lua_pushinteger(L, grp->max_skew_ns);
+    lua_setfield(L, -2, "max_skew_ns");
+    
+    lua_createtable(L, grp->num_members, 0);
+    lua_createtable(L, grp->num_members, 0);
+    for (unsigned int i = 0; i < grp->num_members; i++) {
+        lua_pushinteger(L, grp->members[i].index);
+        lua_rawseti(L, -3, i + 1);
+        lua_pushinteger(L, grp->members[i].avg_ns);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -3, "avg_ns");
+    lua_setfield(L, -2, "order");
+    
+    if (lua_toboolean(L, 2)) {
+        grp->sets = 0;
+        grp->last_skew_ns = 0;
+        grp->max_skew_ns = 0;
+    }
+    
+    return 1;
+}
+
+// ============================================================================
+// Line Event related functions
+// ============================================================================
+
+// event:event_type()
+static int event_event_type(lua_State *L) {
+    LuaLineEvent *event = (LuaLineEvent *)luaL_checkudata(L, 1, GPIOD_LINE_EVENT_MT);
+    
+    int type = event->event.event_type;
+    switch (type) {
+        case GPIOD_LINE_EVENT_RISING_EDGE:
+            lua_pushstring(L, "rising_edge");
+            break;
+        case GPIOD_LINE_EVENT_FALLING_EDGE:
+            lua_pushstring(L, "falling_edge");
+            break;
+        default:
+            lua_pushstring(L, "unknown");
+            break;
+    }
+    return 1;
+}
+
+// event:timestamp_ns()
+static int event_timestamp_ns(lua_State *L) {
+    LuaLineEvent *event = (LuaLineEvent *)luaL_checkudata(L, 1, GPIOD_LINE_EVENT_MT);
+    
+    lua_pushinteger(L, timespec_to_ns(&event->event.ts));
+    return 1;
+}
+
+// event:delta_ns(other)
+// Returns the time from the other event to this one in nanoseconds
+static int event_delta_ns(lua_State *L) {
+    LuaLineEvent *event = (LuaLineEvent *)luaL_checkudata(L, 1, GPIOD_LINE_EVENT_MT);
+    LuaLineEvent *other = (LuaLineEvent *)luaL_checkudata(L, 2, GPIOD_LINE_EVENT_MT);
+    
+    lua_pushinteger(L, timespec_to_ns(&event->event.ts) - timespec_to_ns(&other->event.ts));
+    return 1;
+}
+
+// event:offset()
+static int event_offset(lua_State *L) {
+    LuaLineEvent *event = (LuaLineEvent *)luaL_checkudata(L, 1, GPIOD_LINE_EVENT_MT);
+    
+    lua_pushinteger(L, event->offset);
+    return 1;
+}
+
+// event:timestamp()
+static int event_timestamp(lua_State *L) {
+    LuaLineEvent *event = (LuaLineEvent *)luaL_checkudata(L, 1, GPIOD_LINE_EVENT_MT);
+    
+    struct timespec ts = event->event.ts;
+    lua_pushnumber(L, ts.tv_sec + ts.tv_nsec / 1000000000.0);
+    return 1;
+}
+
+// ============================================================================
+// Event Buffer related functions
+// ============================================================================
+
+// Helper function: check 1-based event index
+static unsigned int check_event_index(lua_State *L, LuaEventBuffer *buf, int arg) {
+    lua_Integer index = luaL_checkinteger(L, arg);
+    
+    luaL_argcheck(L, index >= 1 && index <= (lua_Integer)buf->count, arg, "index out of range");
+    return (unsigned int)(index - 1);
+}
+
+// gpiod.event_buffer(capacity)
+static int gpiod_event_buffer(lua_State *L) {
+    lua_Integer capacity = luaL_checkinteger(L, 1);
+    
+    luaL_argcheck(L, capacity > 0 && capacity <= GPIOD_LUA_MAX_BUFFER_EVENTS, 1,
+                  "capacity out of range");
+    
+    size_t size = sizeof(LuaEventBuffer) +
+                  capacity * (sizeof(struct gpiod_line_event) + sizeof(unsigned int));
+    LuaEventBuffer *buf = (LuaEventBuffer *)lua_newuserdata(L, size);
+    buf->capacity = capacity;
+    buf->count = 0;
+    buf->offsets = (unsigned int *)(buf->events + capacity);
+    
+    luaL_getmetatable(L, GPIOD_EVENT_BUFFER_MT);
+    lua_setmetatable(L, -2);
+    
+    return 1;
+}
+
+// buf:capacity()
+static int event_buffer_capacity(lua_State *L) {
+    LuaEventBuffer *buf = (LuaEventBuffer *)luaL_checkudata(L, 1, GPIOD_EVENT_BUFFER_MT);
+    
+    lua_pushinteger(L, buf->capacity);
+    return 1;
+}
+
+// buf:count()
+static int event_buffer_count(lua_State *L) {
+    LuaEventBuffer *buf = (LuaEventBuffer *)luaL_checkudata(L, 1, GPIOD_EVENT_BUFFER_MT);
+    
+    lua_pushinteger(L, buf->count);
+    return 1;
+}
+
+// buf:clear()
+static int event_buffer_clear(lua_State *L) {
+    LuaEventBuffer *buf = (LuaEventBuffer *)luaL_checkudata(L, 1, GPIOD_EVENT_BUFFER_MT);
+    
+    buf->count = 0;
+    return 0;
+}
+
+// buf:event_type(index)
+static int event_buffer_event_type(lua_State *L) {
+    LuaEventBuffer *buf = (LuaEventBuffer *)luaL_checkudata(L, 1, GPIOD_EVENT_BUFFER_MT);
+    unsigned int i = check_event_index(L, buf, 2);
+    
+    lua_pushinteger(L, buf->events[i].event_type);
+    return 1;
+}
+
+// buf:timestamp_ns(index)
+static int event_buffer_timestamp_ns(lua_State *L) {
+    LuaEventBuffer *buf = (LuaEventBuffer *)luaL_checkudata(L, 1, GPIOD_EVENT_BUFFER_MT);
+    unsigned int i = check_event_index(L, buf, 2);
+    
+    lua_pushinteger(L, timespec_to_ns(&buf->events[i].ts));
+    return 1;
+}
+
+// buf:offset(index)
+static int event_buffer_offset(lua_State *L) {
+    LuaEventBuffer *buf = (LuaEventBuffer *)luaL_checkudata(L, 1, GPIOD_EVENT_BUFFER_MT);
+    unsigned int i = check_event_index(L, buf, 2);
+    
+    lua_pushinteger(L, buf->offsets[i]);
+    return 1;
+}
+
+// buf:delta_ns(index, [other_index])
+// Returns the time between two buffered events (default: the previous one)
+static int event_buffer_delta_ns(lua_State *L) {
+    LuaEventBuffer *buf = (LuaEventBuffer *)luaL_checkudata(L, 1, GPIOD_EVENT_BUFFER_MT);
+    unsigned int i = check_event_index(L, buf, 2);
+    unsigned int j;
+    
+    if (lua_isnoneornil(L, 3)) {
+        luaL_argcheck(L, i > 0, 2, "first event has no previous event");
+        j = i - 1;
+    } else {
+        j = check_event_index(L, buf, 3);
+    }
+    
+    lua_pushinteger(L, timespec_to_ns(&buf->events[i].ts) - timespec_to_ns(&buf->events[j].ts));
+    return 1;
+}
+
+// buf:get(index)
+// Returns event type, timestamp in nanoseconds and line offset
+static int event_buffer_get(lua_State *L) {
+    LuaEventBuffer *buf = (LuaEventBuffer *)luaL_checkudata(L, 1, GPIOD_EVENT_BUFFER_MT);
+    unsigned int i = check_event_index(L, buf, 2);
+    
+    lua_pushinteger(L, buf->events[i].event_type);
+    lua_pushinteger(L, timespec_to_ns(&buf->events[i].ts));
+    lua_pushinteger(L, buf->offsets[i]);
+    return 3;
+}
+
+// ============================================================================
+// Chip Iterator related functions
+// ============================================================================
+
+// gpiod.chip_iter()
+static int gpiod_chip_iter(lua_State *L) {
+    LuaChipIter *iter = (LuaChipIter *)lua_newuserdata(L, sizeof(LuaChipIter));
+    iter->iter = gpiod_chip_iter_new();
+    
+    if (!iter->iter) {
+        lua_pushnil(L);
+        return 1;
+    }
+    
+    luaL_getmetatable(L, GPIOD_CHIP_ITER_MT);
+    lua_setmetatable(L, -2);
+    
+    return 1;
+}
+
+// iter:next()
+static int chip_iter_next(lua_State *L) {
+    LuaChipIter *iter = (LuaChipIter *)luaL_checkudata(L, 1, GPIOD_CHIP_ITER_MT);
+    
+    if (!iter->iter) {
+        lua_pushnil(L);
+        return 1;
+    }
+    
+    struct gpiod_chip *chip = gpiod_chip_iter_next_noclose(iter->iter);
+    if (!chip) {
+        lua_pushnil(L);
+        return 1;
+    }
+    
+    push_chip(L, chip);
+    return 1;
+}
+
+// iter:next_noclose()
+static int chip_iter_next_noclose(lua_State *L) {
+    LuaChipIter *iter = (LuaChipIter *)luaL_checkudata(L, 1, GPIOD_CHIP_ITER_MT);
+    
+    if (!iter->iter) {
+        lua_pushnil(L);
+        return 1;
+    }
+    
+    struct gpiod_chip *chip = gpiod_chip_iter_next_noclose(iter->iter);
+    if (!chip) {
+        lua_pushnil(L);
+        return 1;
+    }
+    
+    push_chip(L, chip);
+    return 1;
+}
+
+// iter:close()
+static int chip_iter_close(lua_State *L) {
+    LuaChipIter *iter = (LuaChipIter *)luaL_checkudata(L, 1, GPIOD_CHIP_ITER_MT);
+    
+    if (iter->iter) {
+        gpiod_chip_iter_free_noclose(iter->iter);
+        iter->iter = NULL;
+    }
+    
+    return 0;
+}
+
+// ============================================================================
+// Chip Registry related functions
+// ============================================================================
+
+// Registry key of the Lua state's chip registry
+static const char chip_registry_key = 0;
+
+// Helper function: push the open chip registry of the Lua state, or return
+// NULL (pushing nothing) when there is none
+static LuaChipRegistry *push_chip_registry(lua_State *L) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &chip_registry_key);
+    LuaChipRegistry *reg = (LuaChipRegistry *)lua_touserdata(L, -1);
+    
+    if (!reg || reg->fd < 0) {
+        lua_pop(L, 1);
+        return NULL;
+    }
+    
+    return reg;
+}
+
+// Helper function: is name a gpiochip device node name
+static int is_chip_name(const char *name) {
+    return strncmp(name, "gpiochip", 8) == 0 && name[8] != '\0';
+}
+
+// Helper function: the device name of a chip given by name, or by a
+// number N meaning gpiochipN
+static const char *chip_device_name(const char *name, char *buf, size_t size) {
+    char *endptr;
+    unsigned long num = strtoul(name, &endptr, 10);
+    
+    if (name[0] && *endptr == '\0') {
+        snprintf(buf, size, "gpiochip%lu", num);
+        return buf;
+    }
+    
+    return name;
+}
+
+// Helper function: push the registered chip called name, or a number N
+// meaning gpiochipN; returns 0 (pushing nothing) if it is not registered
+static int push_registered_chip(lua_State *L, const char *name) {
+    if (!push_chip_registry(L)) {
+        return 0;
+    }
+    
+    char chip_name[32];
+    name = chip_device_name(name, chip_name, sizeof(chip_name));
+    
+    lua_getuservalue(L, -1);
+    lua_getfield(L, -1, "chips");
+    if (lua_getfield(L, -1, name) == LUA_TUSERDATA &&
+        ((LuaChip *)lua_touserdata(L, -1))->chip) {
+        lua_replace(L, -4);
+        lua_pop(L, 2);
+        return 1;
+    }
+    
+    lua_pop(L, 4);
+    return 0;
+}
+
+// Helper function: add the chip at chip_idx to the registry tables at
+// tables_idx; returns 0 if a chip of that name was already present
+static int registry_insert(lua_State *L, int tables_idx, int chip_idx) {
+    tables_idx = lua_absindex(L, tables_idx);
+    chip_idx = lua_absindex(L, chip_idx);
+    LuaChip *chip = (LuaChip *)lua_touserdata(L, chip_idx);
+    const char *name = gpiod_chip_name(chip->chip);
+    const char *label = gpiod_chip_label(chip->chip);
+    
+    lua_getfield(L, tables_idx, "chips");
+    if (lua_getfield(L, -1, name) == LUA_TUSERDATA &&
+        ((LuaChip *)lua_touserdata(L, -1))->chip) {
+        lua_pop(L, 2);
+        return 0;
+    }
+    lua_pop(L, 1);
+    lua_pushvalue(L, chip_idx);
+    lua_setfield(L, -2, name);
+    lua_pop(L, 1);
+    
+    lua_getfield(L, tables_idx, "labels");
+    if (lua_getfield(L, -1, label) != LUA_TUSERDATA || !((LuaChip *)lua_touserdata(L, -1))->chip) {
+        lua_pushvalue(L, chip_idx);
+        lua_setfield(L, -3, label);
+    }
+    lua_pop(L, 2);
+    
+    return 1;
+}
+
+// Helper function: append an add/remove change to the table at changes_idx
+static void push_registry_change(lua_State *L, int changes_idx, const char *event,
+                                 const char *name, const char *label) {
+    lua_createtable(L, 0, 3);
+    lua_pushstring(L, event);
+    lua_setfield(L, -2, "event");
+    lua_pushstring(L, name);
+    lua_setfield(L, -2, "name");
+    lua_pushstring(L, label);
+    lua_setfield(L, -2, "label");
+    lua_rawseti(L, changes_idx, lua_rawlen(L, changes_idx) + 1);
+}
+
+// Helper function: open and register a chip that appeared in /dev
+// Opening fails until udev has set the node's permissions; IN_ATTRIB
+// retries it
+static void registry_add(lua_State *L, int tables_idx, int changes_idx, const char *name) {
+    tables_idx = lua_absindex(L, tables_idx);
+    changes_idx = lua_absindex(L, changes_idx);
+    
+    lua_getfield(L, tables_idx, "chips");
+    int known = lua_getfield(L, -1, name) == LUA_TUSERDATA &&
+                ((LuaChip *)lua_touserdata(L, -1))->chip;
+    lua_pop(L, 2);
+    if (known) {
+        return;
+    }
+    
+    struct gpiod_chip *gchip = gpiod_chip_open_by_name(name);
+    if (!gchip) {
+        return;
+    }
+    
+    push_chip(L, gchip);
+    if (registry_insert(L, tables_idx, -1)) {
+        push_registry_change(L, changes_idx, "added", name, gpiod_chip_label(gchip));
+    }
+    lua_pop(L, 1);
+}
+
+// Helper function: unregister a chip whose node was removed from /dev
+// The handle stays open for objects still referencing it and is closed
+// when it is collected
+static void registry_remove(lua_State *L, int tables_idx, int changes_idx, const char *name) {
+    tables_idx = lua_absindex(L, tables_idx);
+    changes_idx = lua_absindex(L, changes_idx);
+    
+    lua_getfield(L, tables_idx, "chips");
+    if (lua_getfield(L, -1, name) != LUA_TUSERDATA) {
+        lua_pop(L, 2);
+        return;
+    }
+    
+    LuaChip *chip = (LuaChip *)lua_touserdata(L, -1);
+    const char *label = chip->chip ? gpiod_chip_label(chip->chip) : "";
+    
+    lua_pushnil(L);
+    lua_setfield(L, -3, name);
+    
+    lua_getfield(L, tables_idx, "labels");
+    if (lua_getfield(L, -1, label) != LUA_TNIL && lua_rawequal(L, -1, -3)) {
+        lua_pushnil(L);
+        lua_setfield(L, -3, label);
+    }
+    lua_pop(L, 2);
+    
+    push_registry_change(L, changes_idx, "removed", name, label);
+    lua_pop(L, 2);
+}
+
+// Helper function: bring the registry in line with the gpiochip nodes in
+// /dev (initial enumeration, and recovery after an inotify queue overflow)
+static void registry_scan(lua_State *L, int tables_idx, int changes_idx) {
+    tables_idx = lua_absindex(L, tables_idx);
+    changes_idx = lua_absindex(L, changes_idx);
+    
+    // Drop chips whose node disappeared
+    lua_getfield(L, tables_idx, "chips");
+    lua_newtable(L);
+    lua_pushnil(L);
+    while (lua_next(L, -3)) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "/dev/%s", lua_tostring(L, -2));
+        lua_pop(L, 1);
+        if (access(path, F_OK) != 0) {
+            lua_pushvalue(L, -1);
+            lua_rawseti(L, -3, lua_rawlen(L, -3) + 1);
+        }
+    }
+    for (lua_Unsigned i = 1; i <= lua_rawlen(L, -1); i++) {
+        lua_rawgeti(L, -1, i);
+        registry_remove(L, tables_idx, changes_idx, lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 2);
+    
+    DIR *dir = opendir("/dev");
+    if (!dir) {
+        return;
+    }
+    
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (is_chip_name(entry->d_name)) {
+            registry_add(L, tables_idx, changes_idx, entry->d_name);
+        }
+    }
+    closedir(dir);
+}
+
+// Helper function: get the chip registry argument and check that it is open
+static LuaChipRegistry *check_chip_registry(lua_State *L, int idx) {
+    LuaChipRegistry *reg = (LuaChipRegistry *)luaL_checkudata(L, idx, GPIOD_CHIP_REGISTRY_MT);
+    
+    if (reg->fd < 0) {
+        luaL_error(L, "Chip registry is closed");
+    }
+    
+    return reg;
+}
+
+// gpiod.chip_registry()
+// Returns the Lua state's chip registry, enumerating the chips on first use
+static int gpiod_chip_registry(lua_State *L) {
+    if (push_chip_registry(L)) {
+        return 1;
+    }
+    
+    LuaChipRegistry *reg = (LuaChipRegistry *)lua_newuserdata(L, sizeof(LuaChipRegistry));
+    reg->fd = -1;
+    luaL_getmetatable(L, GPIOD_CHIP_REGISTRY_MT);
+    lua_setmetatable(L, -2);
+    
+    lua_createtable(L, 0, 2);
+    lua_newtable(L);
+    lua_setfield(L, -2, "chips");
+    lua_newtable(L);
+    lua_setfield(L, -2, "labels");
+    lua_setuservalue(L, -2);
+    
+    // Watch before enumerating so that no hotplug event is lost
+    reg->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (reg->fd < 0) {
+        return luaL_error(L, "Failed to create inotify instance: %s", strerror(errno));
+    }
+    if (inotify_add_watch(reg->fd, "/dev", IN_CREATE | IN_DELETE | IN_ATTRIB) < 0) {
+        int err = errno;
+        close(reg->fd);
+        reg->fd = -1;
+        return luaL_error(L, "Failed to watch /dev: %s", strerror(err));
+    }
+    
+    lua_getuservalue(L, -1);
+    lua_newtable(L);
+    registry_scan(L, -2, -1);
+    lua_pop(L, 2);
+    
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &chip_registry_key);
+    
+    return 1;
+}
+
+// reg:update()
+// Applies pending hotplug notifications without blocking; returns a table
+// of {event = "added" | "removed", name, label} changes
+static int chip_registry_update(lua_State *L) {
+    LuaChipRegistry *reg = check_chip_registry(L, 1);
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    
+    lua_settop(L, 1);
+    lua_getuservalue(L, 1);
+    lua_newtable(L);
+    
+    for (;;) {
+        ssize_t len = read(reg->fd, buf, sizeof(buf));
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                break;
+            }
+            return luaL_error(L, "Failed to read hotplug events: %s", strerror(errno));
+        }
+        
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+            
+            if (ev->mask & IN_Q_OVERFLOW) {
+                registry_scan(L, 2, 3);
+            } else if (ev->len && is_chip_name(ev->name)) {
+                if (ev->mask & IN_DELETE) {
+                    registry_remove(L, 2, 3, ev->name);
+                } else {
+                    registry_add(L, 2, 3, ev->name);
+                }
+            }
+        }
+    }
+    
+    return 1;
+}
+
+// reg:get(name_or_number)
+// Returns the open chip, or nil if no such chip is present
+static int chip_registry_get(lua_State *L) {
+    check_chip_registry(L, 1);
+    const char *name = luaL_checkstring(L, 2);
+    
+    if (!push_registered_chip(L, name)) {
+        lua_pushnil(L);
+    }
+    return 1;
+}
+
+// reg:open(name_or_number)
+// Returns the registered handle of a chip, opening and registering it if
+// needed. Every caller gets the same handle, so chip:close() closes it for
+// all of them
+static int chip_registry_open(lua_State *L) {
+    check_chip_registry(L, 1);
+    const char *name = luaL_checkstring(L, 2);
+    
+    if (push_registered_chip(L, name)) {
+        return 1;
+    }
+    
+    struct gpiod_chip *chip = open_chip(name);
+    if (!chip) {
+        return luaL_error(L, "Failed to open GPIO chip: %s", name);
+    }
+    
+    push_chip(L, chip);
+    lua_getuservalue(L, 1);
+    registry_insert(L, -1, -2);
+    lua_pop(L, 1);
+    return 1;
+}
+
+// reg:find(label)
+static int chip_registry_find(lua_State *L) {
+    check_chip_registry(L, 1);
+    luaL_checkstring(L, 2);
+    
+    lua_getuservalue(L, 1);
+    lua_getfield(L, -1, "labels");
+    lua_pushvalue(L, 2);
+    if (lua_rawget(L, -2) != LUA_TUSERDATA || !((LuaChip *)lua_touserdata(L, -1))->chip) {
+        lua_pushnil(L);
+    }
+    return 1;
+}
+
+// reg:chips()
+// Returns a table mapping chip name -> chip
+static int chip_registry_chips(lua_State *L) {
+    check_chip_registry(L, 1);
+    
+    lua_getuservalue(L, 1);
+    lua_getfield(L, -1, "chips");
+    lua_newtable(L);
+    lua_pushnil(L);
+    while (lua_next(L, -3)) {
+        if (((LuaChip *)lua_touserdata(L, -1))->chip) {
+            lua_pushvalue(L, -2);
+            lua_insert(L, -2);
+            lua_rawset(L, -4);
+        } else {
+            lua_pop(L, 1);
+        }
+    }
+    return 1;
+}
+
+// reg:pollfd()
+// Pollable object protocol: the inotify fd becomes readable on hotplug;
+// call reg:update() when it is
+static int chip_registry_pollfd(lua_State *L) {
+    LuaChipRegistry *reg = check_chip_registry(L, 1);
+    
+    lua_pushinteger(L, reg->fd);
+    return 1;
+}
+
+// reg:timeout()
+static int chip_registry_timeout(lua_State *L) {
+    lua_pushnil(L);
+    return 1;
+}
+
+// reg:close()
+// Stops watching /dev; the registered chips stay open for their users
+static int chip_registry_close(lua_State *L) {
+    LuaChipRegistry *reg = (LuaChipRegistry *)luaL_checkudata(L, 1, GPIOD_CHIP_REGISTRY_MT);
+    
+    if (reg->fd >= 0) {
+        close(reg->fd);
+        reg->fd = -1;
+        
+        lua_pushnil(L);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &chip_registry_key);
+    }
+    
+    return 0;
+}
+
+// ============================================================================
+// Shared Input related functions
+// ============================================================================
+// Shared requests are process-wide: one kernel request per set of lines,
+// reference-counted across all Lua states and threads of the process.
+// shared_lock only guards the lists and reference counts (request setup and
+// release); value reads run without it.
+
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static SharedChip *shared_chips;
+static SharedRequest *shared_requests;
+
+// Helper function: get or open a shared chip (shared_lock held)
+static SharedChip *shared_chip_acquire(const char *name) {
+    for (SharedChip *chip = shared_chips; chip; chip = chip->next) {
+        if (strcmp(chip->name, name) == 0) {
+            chip->refs++;
+            return chip;
+        }
+    }
+    
+    SharedChip *chip = calloc(1, sizeof(SharedChip));
+    if (!chip) {
+        return NULL;
+    }
+    
+    chip->chip = gpiod_chip_open_by_name(name);
+    if (!chip->chip) {
+        free(chip);
+        return NULL;
+    }
+    
+    snprintf(chip->name, sizeof(chip->name), "%s", name);
+    chip->refs = 1;
+    chip->next = shared_chips;
+    shared_chips = chip;
+    return chip;
+}
+
+// Helper function: drop a reference to a shared chip (shared_lock held)
+static void shared_chip_release(SharedChip *chip) {
+    if (--chip->refs > 0) {
+        return;
+    }
+    
+    for (SharedChip **p = &shared_chips; *p; p = &(*p)->next) {
+        if (*p == chip) {
+            *p = chip->next;
+            break;
+        }
+    }
+    gpiod_chip_close(chip->chip);
+    free(chip);
+}
+
+// Helper function: get or make the shared request for a set of input lines
+// Returns NULL with errno set on failure
+static SharedRequest *shared_request_acquire(const char *chip_name, const unsigned int *offsets,
+                                             unsigned int num_lines, const char *consumer, int flags) {
+    pthread_mutex_lock(&shared_lock);
+    
+    for (SharedRequest *req = shared_requests; req; req = req->next) {
+        if (req->num_lines == num_lines && req->flags == flags &&
+            strcmp(req->chip->name, chip_name) == 0 &&
+            memcmp(req->offsets, offsets, num_lines * sizeof(unsigned int)) == 0) {
+            req->refs++;
+            pthread_mutex_unlock(&shared_lock);
+            return req;
+        }
+    }
+    
+    int err = ENOMEM;
+    SharedRequest *req = calloc(1, sizeof(SharedRequest));
+    if (!req) {
+        goto fail;
+    }
+    
+    req->chip = shared_chip_acquire(chip_name);
+    if (!req->chip) {
+        err = errno;
+        free(req);
+        goto fail;
+    }
+    
+    if (gpiod_chip_get_lines(req->chip->chip, (unsigned int *)offsets, num_lines, &req->bulk) < 0 ||
+        gpiod_line_request_bulk_input_flags(&req->bulk, consumer, flags) < 0) {
+        err = errno;
+        shared_chip_release(req->chip);
+        free(req);
+        goto fail;
+    }
+    
+    memcpy(req->offsets, offsets, num_lines * sizeof(unsigned int));
+    req->num_lines = num_lines;
+    req->flags = flags;
+    req->refs = 1;
+    pthread_mutex_init(&req->refresh_lock, NULL);
+    atomic_init(&req->seq, 0);
+    atomic_init(&req->mask, 0);
+    atomic_init(&req->timestamp_ns, 0);
+    atomic_init(&req->reads, 0);
+    atomic_init(&req->snapshot_hits, 0);
+    
+    req->next = shared_requests;
+    shared_requests = req;
+    pthread_mutex_unlock(&shared_lock);
+    return req;
+    
+fail:
+    pthread_mutex_unlock(&shared_lock);
+    errno = err;
+    return NULL;
+}
+
+// Helper function: drop a reference to a shared request; the last one
+// releases the lines
+static void shared_request_release(SharedRequest *req) {
+    pthread_mutex_lock(&shared_lock);
+    
+    if (--req->refs == 0) {
+        for (SharedRequest **p = &shared_requests; *p; p = &(*p)->next) {
+            if (*p == req) {
+                *p = req->next;
+                break;
+            }
+        }
+        
+        gpiod_line_release_bulk(&req->bulk);
+        shared_chip_release(req->chip);
+        pthread_mutex_destroy(&req->refresh_lock);
+        free(req);
+    }
+    
+    pthread_mutex_unlock(&shared_lock);
+}
+
+// Helper function: read the lines from the kernel and publish the values
+// Returns 0, or -1 with errno set
+static int shared_request_refresh(SharedRequest *req, uint64_t *mask, int64_t *timestamp_ns) {
+    int values[GPIOD_LINE_BULK_MAX_LINES];
+    
+    pthread_mutex_lock(&req->refresh_lock);
+    int ret = gpiod_line_get_value_bulk(&req->bulk, values);
+    if (ret < 0) {
+        int err = errno;
+        pthread_mutex_unlock(&req->refresh_lock);
+        errno = err;
+        return -1;
+    }
+    
+    *mask = values_to_mask(values, req->num_lines);
+    *timestamp_ns = monotonic_ns();
+    
+    atomic_fetch_add_explicit(&req->seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&req->mask, *mask, memory_order_relaxed);
+    atomic_store_explicit(&req->timestamp_ns, *timestamp_ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&req->seq, 1, memory_order_release);
+    atomic_fetch_add_explicit(&req->reads, 1, memory_order_relaxed);
+    
+    pthread_mutex_unlock(&req->refresh_lock);
+    return 0;
+}
+
+// Helper function: read the last published values without locking
+static void shared_request_load(SharedRequest *req, uint64_t *mask, int64_t *timestamp_ns) {
+    uint64_t seq;
+    
+    do {
+        while ((seq = atomic_load_explicit(&req->seq, memory_order_acquire)) & 1) {
+            sched_yield();
+        }
+        *mask = atomic_load_explicit(&req->mask, memory_order_relaxed);
+        *timestamp_ns = atomic_load_explicit(&req->timestamp_ns, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+    } while (atomic_load_explicit(&req->seq, memory_order_relaxed) != seq);
+}
+
+// Helper function: get the shared input argument and check that it is held
+static SharedRequest *check_shared_input(lua_State *L, int idx) {
+    LuaSharedInput *input = (LuaSharedInput *)luaL_checkudata(L, idx, GPIOD_SHARED_INPUT_MT);
+    
+    if (!input->req) {
+        luaL_error(L, "Shared input is released");
+    }
+    
+    return input->req;
+}
+
+// gpiod.shared_input(chip_name_or_number, offsets, consumer, [flags])
+// Requests input lines once per process: further calls for the same chip,
+// offsets and flags, from any Lua state or thread, share that request
+// (the first caller's consumer label is kept)
+static int gpiod_shared_input(lua_State *L) {
+    char chip_name[32];
+    const char *name = chip_device_name(luaL_checkstring(L, 1), chip_name, sizeof(chip_name));
+    luaL_checktype(L, 2, LUA_TTABLE);
+    const char *consumer = luaL_checkstring(L, 3);
+    int flags = luaL_optinteger(L, 4, 0);
+    unsigned int offsets[GPIOD_LINE_BULK_MAX_LINES];
+    
+    lua_Unsigned num_lines = lua_rawlen(L, 2);
+    luaL_argcheck(L, num_lines > 0 && num_lines <= GPIOD_LINE_BULK_MAX_LINES, 2,
+                  "expected 1 to 64 line offsets");
+    for (lua_Unsigned i = 0; i < num_lines; i++) {
+        lua_rawgeti(L, 2, i + 1);
+        offsets[i] = luaL_checkinteger(L, -1);
+        lua_pop(L, 1);
+    }
+    
+    LuaSharedInput *input = (LuaSharedInput *)lua_newuserdata(L, sizeof(LuaSharedInput));
+    input->req = NULL;
+    luaL_getmetatable(L, GPIOD_SHARED_INPUT_MT);
+    lua_setmetatable(L, -2);
+    
+    input->req = shared_request_acquire(name, offsets, num_lines, consumer, flags);
+    if (!input->req) {
+        return luaL_error(L, "Failed to request shared input on %s: %s", name, strerror(errno));
+    }
+    
+    return 1;
+}
+
+// shared:get_mask()
+// Reads the lines from the kernel (publishing the values for snapshot())
+static int shared_input_get_mask(lua_State *L) {
+    SharedRequest *req = check_shared_input(L, 1);
+    uint64_t mask;
+    int64_t timestamp_ns;
+    
+    if (shared_request_refresh(req, &mask, &timestamp_ns) < 0) {
+        return luaL_error(L, "Failed to read shared GPIO values: %s", strerror(errno));
+    }
+    
+    lua_pushinteger(L, (lua_Integer)mask);
+    return 1;
+}
+
+// shared:get_values()
+static int shared_input_get_values(lua_State *L) {
+    SharedRequest *req = check_shared_input(L, 1);
+    uint64_t mask;
+    int64_t timestamp_ns;
+    
+    if (shared_request_refresh(req, &mask, &timestamp_ns) < 0) {
+        return luaL_error(L, "Failed to read shared GPIO values: %s", strerror(errno));
+    }
+    
+    lua_createtable(L, req->num_lines, 0);
+    for (unsigned int i = 0; i < req->num_lines; i++) {
+        lua_pushinteger(L, (mask >> i) & 1);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
+// shared:snapshot([max_age_ns])
+// Returns the last values read by any state through this request and the
+// CLOCK_MONOTONIC time of that read, without taking a lock. With max_age_ns,
+// values older than that (or never read) are read from the kernel first.
+static int shared_input_snapshot(lua_State *L) {
+    SharedRequest *req = check_shared_input(L, 1);
+    lua_Integer max_age_ns = luaL_optinteger(L, 2, -1);
+    uint64_t mask;
+    int64_t timestamp_ns;
+    
+    shared_request_load(req, &mask, &timestamp_ns);
+    if (max_age_ns >= 0 && (timestamp_ns == 0 || monotonic_ns() - timestamp_ns > max_age_ns)) {
+        if (shared_request_refresh(req, &mask, &timestamp_ns) < 0) {
+            return luaL_error(L, "Failed to read shared GPIO values: %s", strerror(errno));
+        }
+    } else {
+        atomic_fetch_add_explicit(&req->snapshot_hits, 1, memory_order_relaxed);
+    }
+    
+    lua_pushinteger(L, (lua_Integer)mask);
+    lua_pushinteger(L, timestamp_ns);
+    return 2;
+}
+
+// shared:offsets()
+static int shared_input_offsets(lua_State *L) {
+    SharedRequest *req = check_shared_input(L, 1);
+    
+    lua_createtable(L, req->num_lines, 0);
+    for (unsigned int i = 0; i < req->num_lines; i++) {
+        lua_pushinteger(L, req->offsets[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
+// shared:stats()
+static int shared_input_stats(lua_State *L) {
+    SharedRequest *req = check_shared_input(L, 1);
+    
+    pthread_mutex_lock(&shared_lock);
+    unsigned int refs = req->refs;
+    pthread_mutex_unlock(&shared_lock);
+    
+    lua_createtable(L, 0, 4);
+    lua_pushstring(L, req->chip->name);
+    lua_setfield(L, -2, "chip");
+    lua_pushinteger(L, refs);
+    lua_setfield(L, -2, "refs");
+    lua_pushinteger(L, (lua_Integer)atomic_load(&req->reads));
+    lua_setfield(L, -2, "reads");
+    lua_pushinteger(L, (lua_Integer)atomic_load(&req->snapshot_hits));
+    lua_setfield(L, -2, "snapshot_hits");
+    return 1;
+}
+
+// shared:release()
+// Drops this state's reference; the lines are released with the last one
+static int shared_input_release(lua_State *L) {
+    LuaSharedInput *input = (LuaSharedInput *)luaL_checkudata(L, 1, GPIOD_SHARED_INPUT_MT);
+    
+    if (input->req) {
+        shared_request_release(input->req);
+        input->req = NULL;
+    }
+    
+    return 0;
+}
+
+// ============================================================================
+// Line Info Snapshot related functions
+// ============================================================================
+
+// Fields of a line info record, in the order of the table keys
+enum {
+    INFO_NAME,
+    INFO_CONSUMER,
+    INFO_DIRECTION,
+    INFO_ACTIVE_STATE,
+    INFO_BIAS,
+    INFO_USED,
+    INFO_OPEN_DRAIN,
+    INFO_OPEN_SOURCE,
+    INFO_NUM_FIELDS
+};
+
+static const char *const info_fields[] = {
+    "name", "consumer", "direction", "active_state", "bias",
+    "used", "open_drain", "open_source", NULL
+};
+
+// Helper function: push one field of a record; unnamed lines and lines
+// without a consumer give missing
+static void push_info_field(lua_State *L, const LineInfoRecord *info, int field, int missing) {
+    switch (field) {
+        case INFO_NAME:
+        case INFO_CONSUMER: {
+            const char *s = field == INFO_NAME ? info->name : info->consumer;
+            if (s[0]) {
+                lua_pushstring(L, s);
+            } else if (missing) {
+                lua_pushboolean(L, 0);
+            } else {
+                lua_pushnil(L);
+            }
+            break;
+        }
+        case INFO_DIRECTION:
+            lua_pushstring(L, direction_string(info->direction));
+            break;
+        case INFO_ACTIVE_STATE:
+            lua_pushstring(L, active_state_string(info->active_state));
+            break;
+        case INFO_BIAS:
+            lua_pushstring(L, bias_string(info->bias));
+            break;
+        case INFO_USED:
+            lua_pushboolean(L, info->flags & GPIOD_LUA_INFO_USED);
+            break;
+        case INFO_OPEN_DRAIN:
+            lua_pushboolean(L, info->flags & GPIOD_LUA_INFO_OPEN_DRAIN);
+            break;
+        case INFO_OPEN_SOURCE:
+            lua_pushboolean(L, info->flags & GPIOD_LUA_INFO_OPEN_SOURCE);
+            break;
+    }
+}
+
+// Helper function: push all fields of a record as a table
+static void push_info_table(lua_State *L, const LineInfoRecord *info, unsigned int offset) {
+    lua_createtable(L, 0, INFO_NUM_FIELDS + 1);
+    lua_pushinteger(L, offset);
+    lua_setfield(L, -2, "offset");
+    for (int field = 0; field < INFO_NUM_FIELDS; field++) {
+        push_info_field(L, info, field, 0);
+        lua_setfield(L, -2, info_fields[field]);
+    }
+}
+
+// Helper function: check the offset argument of a snapshot accessor
+static const LineInfoRecord *check_info_offset(lua_State *L, LuaLineInfo *snap, int arg) {
+    lua_Integer offset = luaL_checkinteger(L, arg);
+    
+    luaL_argcheck(L, offset >= 0 && offset < snap->num_lines, arg, "offset out of range");
+    return &snap->lines[offset];
+}
+
+// Helper function: convert line info reported by the kernel into a record
+static void info_record_from_uapi(LineInfoRecord *info, const struct gpio_v2_line_info *uinfo) {
+    memset(info, 0, sizeof(*info));
+    snprintf(info->name, sizeof(info->name), "%.*s", (int)sizeof(uinfo->name), uinfo->name);
+    snprintf(info->consumer, sizeof(info->consumer), "%.*s", (int)sizeof(uinfo->consumer), uinfo->consumer);
+    
+    uint64_t flags = uinfo->flags;
+    info->direction = (flags & GPIO_V2_LINE_FLAG_OUTPUT) ? GPIOD_LINE_DIRECTION_OUTPUT : GPIOD_LINE_DIRECTION_INPUT;
+    info->active_state = (flags & GPIO_V2_LINE_FLAG_ACTIVE_LOW) ? GPIOD_LINE_ACTIVE_STATE_LOW : GPIOD_LINE_ACTIVE_STATE_HIGH;
+    if (flags & GPIO_V2_LINE_FLAG_BIAS_PULL_UP) {
+        info->bias = GPIOD_LINE_BIAS_PULL_UP;
+    } else if (flags & GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN) {
+        info->bias = GPIOD_LINE_BIAS_PULL_DOWN;
+    } else if (flags & GPIO_V2_LINE_FLAG_BIAS_DISABLED) {
+        info->bias = GPIOD_LINE_BIAS_DISABLE;
+    } else {
+        info->bias = GPIOD_LINE_BIAS_AS_IS;
+    }
+    info->flags = ((flags & GPIO_V2_LINE_FLAG_USED) ? GPIOD_LUA_INFO_USED : 0) |
+                  ((flags & GPIO_V2_LINE_FLAG_OPEN_DRAIN) ? GPIOD_LUA_INFO_OPEN_DRAIN : 0) |
+                  ((flags & GPIO_V2_LINE_FLAG_OPEN_SOURCE) ? GPIOD_LUA_INFO_OPEN_SOURCE : 0);
+}
+
+// Helper function: check whether the chip's cached name table still
+// matches the names of a snapshot (the table keeps the first line of
+// names shared by several lines)
+static int chip_names_match(lua_State *L, int names_idx, const LuaLineInfo *snap) {
+    names_idx = lua_absindex(L, names_idx);
+    
+    lua_pushnil(L);
+    while (lua_next(L, names_idx)) {
+        lua_Integer offset = lua_tointeger(L, -1);
+        if (offset < 0 || offset >= snap->num_lines ||
+            strcmp(snap->lines[offset].name, lua_tostring(L, -2)) != 0) {
+            lua_pop(L, 2);
+            return 0;
+        }
+        lua_pop(L, 1);
+    }
+    
+    for (unsigned int offset = 0; offset < snap->num_lines; offset++) {
+        const char *name = snap->lines[offset].name;
+        if (name[0]) {
+            int known = lua_getfield(L, names_idx, name) != LUA_TNIL;
+            lua_pop(L, 1);
+            if (!known) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// chip:line_info_snapshot()
+// Reads the info of all lines from the kernel in one pass, one
+// GPIO_V2_GET_LINEINFO ioctl per line, into a compact record array
+static int chip_line_info_snapshot(lua_State *L) {
+    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+    
+    if (!chip->chip) {
+        return luaL_error(L, "Chip is closed");
+    }
+    
+    unsigned int num_lines = gpiod_chip_num_lines(chip->chip);
+    LuaLineInfo *snap = (LuaLineInfo *)lua_newuserdata(L, sizeof(LuaLineInfo) + num_lines * sizeof(LineInfoRecord));
+    memset(snap, 0, sizeof(LuaLineInfo) + num_lines * sizeof(LineInfoRecord));
+    snap->num_lines = num_lines;
+    snprintf(snap->chip_name, sizeof(snap->chip_name), "%s", gpiod_chip_name(chip->chip));
+    
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/dev/%s", snap->chip_name);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return luaL_error(L, "Failed to open %s: %s", path, strerror(errno));
+    }
+    
+    for (unsigned int offset = 0; offset < num_lines; offset++) {
+        struct gpio_v2_line_info uinfo;
+        memset(&uinfo, 0, sizeof(uinfo));
+        uinfo.offset = offset;
+        
+        if (ioctl(fd, GPIO_V2_GET_LINEINFO_IOCTL, &uinfo) < 0) {
+            int error = errno;
+            close(fd);
+            return luaL_error(L, "Failed to read line info: %d: %s", offset, strerror(error));
+        }
+        info_record_from_uapi(&snap->lines[offset], &uinfo);
+    }
+    close(fd);
+    snap->timestamp_ns = monotonic_ns();
+    
+    // A renamed line invalidates the chip's name table
+    lua_getuservalue(L, 1);
+    if (lua_getfield(L, -1, "names") == LUA_TTABLE && !chip_names_match(L, -1, snap)) {
+        lua_pushnil(L);
+        lua_setfield(L, -3, "names");
+    }
+    lua_pop(L, 2);
+    
+    luaL_getmetatable(L, GPIOD_LINE_INFO_MT);
+    lua_setmetatable(L, -2);
+    
+    return 1;
+}
+
+// snap:num_lines()
+static int line_info_num_lines(lua_State *L) {
+    LuaLineInfo *snap = (LuaLineInfo *)luaL_checkudata(L, 1, GPIOD_LINE_INFO_MT);
+    
+    lua_pushinteger(L, snap->num_lines);
+    return 1;
+}
+
+// snap:chip_name()
+static int line_info_chip_name(lua_State *L) {
+    LuaLineInfo *snap = (LuaLineInfo *)luaL_checkudata(L, 1, GPIOD_LINE_INFO_MT);
+    
+    lua_pushstring(L, snap->chip_name);
+    return 1;
+}
+
+// snap:timestamp_ns()
+// CLOCK_MONOTONIC time at which the snapshot was completed
+static int line_info_timestamp_ns(lua_State *L) {
+    LuaLineInfo *snap = (LuaLineInfo *)luaL_checkudata(L, 1, GPIOD_LINE_INFO_MT);
+    
+    lua_pushinteger(L, snap->timestamp_ns);
+    return 1;
+}
+
+// Helper function: snap:<field>(offset)
+static int line_info_field(lua_State *L, int field) {
+    LuaLineInfo *snap = (LuaLineInfo *)luaL_checkudata(L, 1, GPIOD_LINE_INFO_MT);
+    
+    push_info_field(L, check_info_offset(L, snap, 2), field, 0);
+    return 1;
+}
+
+// snap:name(offset)
+static int line_info_name(lua_State *L) {
+    return line_info_field(L, INFO_NAME);
+}
+
+// snap:consumer(offset)
+static int line_info_consumer(lua_State *L) {
+    return line_info_field(L, INFO_CONSUMER);
+}
+
+// snap:direction(offset)
+static int line_info_direction(lua_State *L) {
+    return line_info_field(L, INFO_DIRECTION);
+}
+
+// snap:active_state(offset)
+static int line_info_active_state(lua_State *L) {
+    return line_info_field(L, INFO_ACTIVE_STATE);
+}
+
+// snap:bias(offset)
+static int line_info_bias(lua_State *L) {
+    return line_info_field(L, INFO_BIAS);
+}
+
+// snap:is_used(offset)
+static int line_info_is_used(lua_State *L) {
+    return line_info_field(L, INFO_USED);
+}
+
+// snap:is_open_drain(offset)
+static int line_info_is_open_drain(lua_State *L) {
+    return line_info_field(L, INFO_OPEN_DRAIN);
+}
+
+// snap:is_open_source(offset)
+static int line_info_is_open_source(lua_State *L) {
+    return line_info_field(L, INFO_OPEN_SOURCE);
+}
+
+// snap:get(offset)
+// Returns all fields of one line as a table
+static int line_info_get(lua_State *L) {
+    LuaLineInfo *snap = (LuaLineInfo *)luaL_checkudata(L, 1, GPIOD_LINE_INFO_MT);
+    const LineInfoRecord *info = check_info_offset(L, snap, 2);
+    
+    push_info_table(L, info, info - snap->lines);
+    return 1;
+}
+
+// snap:column(field)
+// Returns one field of all lines as an array (index = offset + 1); unnamed
+// lines and lines without a consumer are false
+static int line_info_column(lua_State *L) {
+    LuaLineInfo *snap = (LuaLineInfo *)luaL_checkudata(L, 1, GPIOD_LINE_INFO_MT);
+    int field = luaL_checkoption(L, 2, NULL, info_fields);
+    
+    lua_createtable(L, snap->num_lines, 0);
+    for (unsigned int offset = 0; offset < snap->num_lines; offset++) {
+        push_info_field(L, &snap->lines[offset], field, 1);
+        lua_rawseti(L, -2, offset + 1);
+    }
+    
+    return 1;
+}
+
+// snap:diff(prev)
+// Compares the records in C and returns a table with one info table (with
+// an offset field) per line whose info differs from prev
+static int line_info_diff(lua_State *L) {
+    LuaLineInfo *snap = (LuaLineInfo *)luaL_checkudata(L, 1, GPIOD_LINE_INFO_MT);
+    LuaLineInfo *prev = (LuaLineInfo *)luaL_checkudata(L, 2, GPIOD_LINE_INFO_MT);
+    
+    if (snap->num_lines != prev->num_lines || strcmp(snap->chip_name, prev->chip_name) != 0) {
+        return luaL_error(L, "Snapshots belong to different chips");
+    }
+    
+    lua_newtable(L);
+    int count = 0;
+    for (unsigned int offset = 0; offset < snap->num_lines; offset++) {
+        if (memcmp(&snap->lines[offset], &prev->lines[offset], sizeof(LineInfoRecord)) != 0) {
+            push_info_table(L, &snap->lines[offset], offset);
+            lua_rawseti(L, -2, ++count);
+        }
+    }
+    
+    return 1;
+}
+
+// ============================================================================
+// Line Info Watch related functions
+// ============================================================================
+
+static int timeout_to_ms(lua_Number timeout);
+
+// Helper function: push a line info change as a line info table with
+// event ("requested", "released" or "config_changed") and timestamp_ns
+// (CLOCK_MONOTONIC) fields
+static void push_info_change(lua_State *L, const struct gpio_v2_line_info_changed *change) {
+    LineInfoRecord info;
+    info_record_from_uapi(&info, &change->info);
+    push_info_table(L, &info, change->info.offset);
+    
+    switch (change->event_type) {
+        case GPIO_V2_LINE_CHANGED_REQUESTED:
+            lua_pushliteral(L, "requested");
+            break;
+        case GPIO_V2_LINE_CHANGED_RELEASED:
+            lua_pushliteral(L, "released");
+            break;
+        default:
+            lua_pushliteral(L, "config_changed");
+            break;
+    }
+    lua_setfield(L, -2, "event");
+    lua_pushinteger(L, (lua_Integer)change->timestamp_ns);
+    lua_setfield(L, -2, "timestamp_ns");
+}
+
+// Helper function: read up to max_changes pending changes without blocking
+// Returns the number read, or -1 with errno set
+static int read_info_changes(int fd, struct gpio_v2_line_info_changed *changes, unsigned int max_changes) {
+    ssize_t len;
+    do {
+        len = read(fd, changes, max_changes * sizeof(*changes));
+    } while (len < 0 && errno == EINTR);
+    
+    if (len < 0) {
+        return errno == EAGAIN ? 0 : -1;
+    }
+    
+    return len / sizeof(*changes);
+}
+
+// Helper function: get the watch argument and check that it is open
+static LuaInfoWatch *check_info_watch(lua_State *L, int idx) {
+    LuaInfoWatch *watch = (LuaInfoWatch *)luaL_checkudata(L, idx, GPIOD_INFO_WATCH_MT);
+    
+    if (watch->fd < 0) {
+        luaL_error(L, "Line info watch is closed");
+    }
+    
+    return watch;
+}
+
+// Helper function: start watching a line; pushes its current info table
+static void info_watch_add_line(lua_State *L, LuaInfoWatch *watch, lua_Integer offset) {
+    if (offset < 0 || offset >= watch->num_lines) {
+        luaL_error(L, "Line offset out of range: %d", (int)offset);
+    }
+    
+    struct gpio_v2_line_info uinfo;
+    memset(&uinfo, 0, sizeof(uinfo));
+    uinfo.offset = offset;
+    
+    if (ioctl(watch->fd, GPIO_V2_GET_LINEINFO_WATCH_IOCTL, &uinfo) < 0) {
+        if (errno != EBUSY) {
+            luaL_error(L, "Failed to watch line %d: %s", (int)offset, strerror(errno));
+        }
+        
+        // Already watched: read the current info instead
+        if (ioctl(watch->fd, GPIO_V2_GET_LINEINFO_IOCTL, &uinfo) < 0) {
+            luaL_error(L, "Failed to read line %d info: %s", (int)offset, strerror(errno));
+        }
+    }
+    
+    LineInfoRecord info;
+    info_record_from_uapi(&info, &uinfo);
+    push_info_table(L, &info, offset);
+}
+
+// chip:watch_line_info([offsets])
+// Watches the given lines (all lines of the chip by default) for requests,
+// releases and configuration changes by any process
+static int chip_watch_line_info(lua_State *L) {
+    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+    
+    if (!chip->chip) {
+        return luaL_error(L, "Chip is closed");
+    }
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+    }
+    
+    LuaInfoWatch *watch = (LuaInfoWatch *)lua_newuserdata(L, sizeof(LuaInfoWatch));
+    watch->num_lines = gpiod_chip_num_lines(chip->chip);
+    luaL_getmetatable(L, GPIOD_INFO_WATCH_MT);
+    lua_setmetatable(L, -2);
+    
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/dev/%s", gpiod_chip_name(chip->chip));
+    watch->fd = open(path, O_RDWR | O_CLOEXEC | O_NONBLOCK);
+    if (watch->fd < 0) {
+        return luaL_error(L, "Failed to open %s: %s", path, strerror(errno));
+    }
+    
+    if (lua_isnoneornil(L, 2)) {
+        for (unsigned int offset = 0; offset < watch->num_lines; offset++) {
+            info_watch_add_line(L, watch, offset);
+            lua_pop(L, 1);
+        }
+    } else {
+        lua_Unsigned num_offsets = lua_rawlen(L, 2);
+        for (lua_Unsigned i = 0; i < num_offsets; i++) {
+            lua_rawgeti(L, 2, i + 1);
+            lua_Integer offset = luaL_checkinteger(L, -1);
+            lua_pop(L, 1);
+            info_watch_add_line(L, watch, offset);
+            lua_pop(L, 1);
+        }
+    }
+    
+    return 1;
+}
+
+// watch:add(offset)
+// Returns the current info of the line as a table
+static int info_watch_add(lua_State *L) {
+    LuaInfoWatch *watch = check_info_watch(L, 1);
+    
+    info_watch_add_line(L, watch, luaL_checkinteger(L, 2));
+    return 1;
+}
+
+// watch:remove(offset)
+static int info_watch_remove(lua_State *L) {
+    LuaInfoWatch *watch = check_info_watch(L, 1);
+    __u32 offset = luaL_checkinteger(L, 2);
+    
+    if (ioctl(watch->fd, GPIO_GET_LINEINFO_UNWATCH_IOCTL, &offset) < 0) {
+        return luaL_error(L, "Failed to unwatch line %d: %s", (int)offset, strerror(errno));
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// watch:wait([timeout])
+// Returns true when changes are pending, false on timeout
+static int info_watch_wait(lua_State *L) {
+    LuaInfoWatch *watch = check_info_watch(L, 1);
+    lua_Number timeout = luaL_optnumber(L, 2, -1);
+    
+    struct pollfd pfd = { .fd = watch->fd, .events = POLLIN };
+    int ret;
+    do {
+        ret = poll(&pfd, 1, timeout_to_ms(timeout));
+    } while (ret < 0 && errno == EINTR);
+    
+    if (ret < 0) {
+        return luaL_error(L, "Failed to wait for line info changes: %s", strerror(errno));
+    }
+    
+    lua_pushboolean(L, ret > 0);
+    return 1;
+}
+
+// watch:read([max_changes])
+// Drains pending changes without blocking into a table of change tables
+static int info_watch_read(lua_State *L) {
+    LuaInfoWatch *watch = check_info_watch(L, 1);
+    lua_Integer max_changes = luaL_optinteger(L, 2, GPIOD_LUA_MAX_EVENTS);
+    struct gpio_v2_line_info_changed changes[GPIOD_LUA_MAX_EVENTS];
+    
+    luaL_argcheck(L, max_changes > 0, 2, "max_changes must be positive");
+    
+    lua_newtable(L);
+    int count = 0;
+    while (count < max_changes) {
+        unsigned int chunk = max_changes - count < GPIOD_LUA_MAX_EVENTS ? max_changes - count : GPIOD_LUA_MAX_EVENTS;
+        int num_changes = read_info_changes(watch->fd, changes, chunk);
+        if (num_changes < 0) {
+            return luaL_error(L, "Failed to read line info changes: %s", strerror(errno));
+        }
+        
+        for (int i = 0; i < num_changes; i++) {
+            push_info_change(L, &changes[i]);
+            lua_rawseti(L, -2, ++count);
+        }
+        
+        if ((unsigned int)num_changes < chunk) {
+            break;
+        }
+    }
+    
+    return 1;
+}
+
+// watch:pollfd()
+// Pollable object protocol: the chip fd becomes readable on changes
+static int info_watch_pollfd(lua_State *L) {
+    LuaInfoWatch *watch = check_info_watch(L, 1);
+    
+    lua_pushinteger(L, watch->fd);
+    return 1;
+}
+
+// watch:timeout()
+static int info_watch_timeout(lua_State *L) {
+    lua_pushnil(L);
+    return 1;
+}
+
+// watch:close()
+static int info_watch_close(lua_State *L) {
+    LuaInfoWatch *watch = (LuaInfoWatch *)luaL_checkudata(L, 1, GPIOD_INFO_WATCH_MT);
+    
+    if (watch->fd >= 0) {
+        close(watch->fd);
+        watch->fd = -1;
+    }
+    
+    return 0;
+}
+
+// ============================================================================
+// Event Loop related functions
+// ============================================================================
+
+// Helper function: milliseconds for epoll_wait (negative = forever)
+static int timeout_to_ms(lua_Number timeout) {
+    if (timeout < 0) {
+        return -1;
+    }
+    
+    // Round up so that short timeouts do not turn into busy polling
+    return (int)(timeout * 1000 + 0.999);
+}
+
+// Helper function: get event loop and check that it is open
+static LuaEventLoop *check_event_loop(lua_State *L, int idx) {
+    LuaEventLoop *loop = (LuaEventLoop *)luaL_checkudata(L, idx, GPIOD_EVENT_LOOP_MT);
+    
+    if (loop->epfd < 0) {
+        luaL_error(L, "Event loop is closed");
+    }
+    
+    return loop;
+}
+
+// Helper function: collect the lines of a line or line bulk argument
+// Returns the event clock of the line or bulk
+static int check_event_source(lua_State *L, int idx, struct gpiod_line_bulk *lines) {
+    gpiod_line_bulk_init(lines);
+    
+    LuaLine *line = (LuaLine *)luaL_testudata(L, idx, GPIOD_LINE_MT);
+    if (line) {
+        if (!line->line) {
+            luaL_error(L, "Line is released");
+        }
+        gpiod_line_bulk_add(lines, line->line);
+        return line->event_clock;
+    }
+    
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_testudata(L, idx, GPIOD_LINE_BULK_MT);
+    if (bulk) {
+        *lines = bulk->bulk;
+        return bulk->event_clock;
+    }
+    
+    return luaL_typeerror(L, idx, "gpiod.line or gpiod.line_bulk");
+}
+
+// Helper function: latency histogram of line index of a line or line bulk,
+// or NULL when latency is not tracked
+static LatencyHistogram *source_latency(lua_State *L, int idx, unsigned int index) {
+    LuaLine *line = (LuaLine *)luaL_testudata(L, idx, GPIOD_LINE_MT);
+    if (line) {
+        return line->latency;
+    }
+    
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_testudata(L, idx, GPIOD_LINE_BULK_MT);
+    return bulk && bulk->latency ? &bulk->latency[index] : NULL;
+}
+
+// Helper function: debounce filter of line index of a line or line bulk,
+// or NULL when the line is not debounced
+static LineDebounce *source_debounce(lua_State *L, int idx, unsigned int index) {
+    LuaLine *line = (LuaLine *)luaL_testudata(L, idx, GPIOD_LINE_MT);
+    if (line) {
+        return line->debounce.window_ns ? &line->debounce : NULL;
+    }
+    
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_testudata(L, idx, GPIOD_LINE_BULK_MT);
+    if (bulk && bulk->debounce && bulk->debounce[index].window_ns) {
+        return &bulk->debounce[index];
+    }
+    
+    return NULL;
+}
+
+// gpiod.event_loop()
+static int gpiod_event_loop(lua_State *L) {
+    LuaEventLoop *loop = (LuaEventLoop *)lua_newuserdata(L, sizeof(LuaEventLoop));
+    loop->epfd = -1;
+    loop->running = 0;
+    
+    luaL_getmetatable(L, GPIOD_EVENT_LOOP_MT);
+    lua_setmetatable(L, -2);
+    
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0) {
+        return luaL_error(L, "Failed to create event loop: %s", strerror(errno));
+    }
+    
+    lua_newtable(L);
+    lua_setuservalue(L, -2);
+    
+    return 1;
+}
+
+// Helper function: register a line info watch with an event loop
+// Registrations of watches hold the callback and the watch only
+static int event_loop_add_watch(lua_State *L, LuaEventLoop *loop, LuaInfoWatch *watch) {
+    if (!lua_isnoneornil(L, 4)) {
+        return luaL_argerror(L, 4, "event buffers do not apply to line info watches");
+    }
+    
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = watch->fd;
+    
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, watch->fd, &ev) < 0 && errno != EEXIST) {
+        return luaL_error(L, "Failed to add line info watch to event loop: %s", strerror(errno));
+    }
+    
+    lua_getuservalue(L, 1);
+    lua_createtable(L, 2, 1);
+    lua_pushvalue(L, 3);
+    lua_rawseti(L, -2, 1);
+    lua_pushvalue(L, 2);
+    lua_rawseti(L, -2, 2);
+    lua_pushinteger(L, EVENT_LOOP_WATCH);
+    lua_setfield(L, -2, "kind");
+    lua_rawseti(L, -2, watch->fd);
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// loop:add(line_or_bulk_or_watch, callback, [buffer])
+// callback(event, line_or_bulk) is called for every event read; when an
+// event buffer is given, callback(buffer, line_or_bulk) is called once per
+// batch with the buffer filled in place instead. For a line info watch,
+// callback(change, watch) is called for every change
+static int event_loop_add(lua_State *L) {
+    LuaEventLoop *loop = check_event_loop(L, 1);
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+    
+    LuaInfoWatch *watch = (LuaInfoWatch *)luaL_testudata(L, 2, GPIOD_INFO_WATCH_MT);
+    if (watch) {
+        return event_loop_add_watch(L, loop, check_info_watch(L, 2));
+    }
+    
+    struct gpiod_line_bulk lines;
+    int clock = check_event_source(L, 2, &lines);
+    if (!lua_isnoneornil(L, 4)) {
+        luaL_checkudata(L, 4, GPIOD_EVENT_BUFFER_MT);
+    }
+    
+    lua_getuservalue(L, 1);
+    
+    unsigned int num_lines = gpiod_line_bulk_num_lines(&lines);
+    for (unsigned int i = 0; i < num_lines; i++) {
+        struct gpiod_line *line = gpiod_line_bulk_get_line(&lines, i);
+        
+        int fd = gpiod_line_event_get_fd(line);
+        if (fd < 0) {
+            return luaL_error(L, "Line %d is not requested for events", gpiod_line_offset(line));
+        }
+        
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            // Re-adding a line replaces its callback
+            if (errno != EEXIST) {
+                return luaL_error(L, "Failed to add line %d to event loop: %s",
+                                  gpiod_line_offset(line), strerror(errno));
+            }
+        }
+        
+        lua_createtable(L, 6, 1);
+        lua_pushvalue(L, 3);
+        lua_rawseti(L, -2, 1);
+        lua_pushvalue(L, 2);
+        lua_rawseti(L, -2, 2);
+        lua_pushinteger(L, gpiod_line_offset(line));
+        lua_rawseti(L, -2, 3);
+        if (lua_isnoneornil(L, 4)) {
+            lua_pushboolean(L, 0);
+        } else {
+            lua_pushvalue(L, 4);
+        }
+        lua_rawseti(L, -2, 4);
+        lua_pushinteger(L, clock);
+        lua_rawseti(L, -2, 5);
+        lua_pushinteger(L, i);
+        lua_rawseti(L, -2, 6);
+        lua_pushinteger(L, EVENT_LOOP_LINE);
+        lua_setfield(L, -2, "kind");
+        lua_rawseti(L, -2, fd);
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// loop:remove(line_or_bulk_or_watch)
+static int event_loop_remove(lua_State *L) {
+    LuaEventLoop *loop = check_event_loop(L, 1);
+    
+    LuaInfoWatch *watch = (LuaInfoWatch *)luaL_testudata(L, 2, GPIOD_INFO_WATCH_MT);
+    if (watch) {
+        if (watch->fd >= 0) {
+            epoll_ctl(loop->epfd, EPOLL_CTL_DEL, watch->fd, NULL);
+            lua_getuservalue(L, 1);
+            lua_pushnil(L);
+            lua_rawseti(L, -2, watch->fd);
+        }
+        
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+    
+    struct gpiod_line_bulk lines;
+    check_event_source(L, 2, &lines);
+    
+    lua_getuservalue(L, 1);
+    
+    unsigned int num_lines = gpiod_line_bulk_num_lines(&lines);
+    for (unsigned int i = 0; i < num_lines; i++) {
+        int fd = gpiod_line_event_get_fd(gpiod_line_bulk_get_line(&lines, i));
+        if (fd < 0) {
+            continue;
+        }
+        
+        epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+        lua_pushnil(L);
+        lua_rawseti(L, -2, fd);
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// Helper function: wait once and dispatch all ready events
+// Returns the number of events dispatched
+static int event_loop_dispatch(lua_State *L, LuaEventLoop *loop, int timeout_ms) {
+    struct epoll_event ready[GPIOD_LUA_MAX_READY_FDS];
+    
+    int num_ready = epoll_wait(loop->epfd, ready, GPIOD_LUA_MAX_READY_FDS, timeout_ms);
+    if (num_ready < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        return luaL_error(L, "Failed to wait for events: %s", strerror(errno));
+    }
+    
+    lua_getuservalue(L, 1);
+    int registry = lua_gettop(L);
+    
+    struct gpiod_line_event events[GPIOD_LUA_MAX_EVENTS];
+    int dispatched = 0;
+    
+    for (int i = 0; i < num_ready; i++) {
+        int fd = ready[i].data.fd;
+        
+        // An earlier callback may have removed this registration
+        if (lua_rawgeti(L, registry, fd) != LUA_TTABLE) {
+            lua_pop(L, 1);
+            continue;
+        }
+        
+        // Line info watch: one callback per change
+        lua_getfield(L, -1, "kind");
+        int kind = (int)lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        if (kind == EVENT_LOOP_WATCH) {
+            struct gpio_v2_line_info_changed changes[GPIOD_LUA_MAX_EVENTS];
+            int num_changes = read_info_changes(fd, changes, GPIOD_LUA_MAX_EVENTS);
+            if (num_changes < 0) {
+                return luaL_error(L, "Failed to read line info changes: %s", strerror(errno));
+            }
+            
+            for (int j = 0; j < num_changes; j++) {
+                lua_rawgeti(L, -1, 1);
+                push_info_change(L, &changes[j]);
+                lua_rawgeti(L, -3, 2);
+                lua_call(L, 2, 0);
+                dispatched++;
+            }
+            
+            lua_pop(L, 1);
+            continue;
+        }
+        
+        lua_rawgeti(L, -1, 3);
+        unsigned int offset = lua_tointeger(L, -1);
+        lua_rawgeti(L, -2, 5);
+        int clock = lua_tointeger(L, -1);
+        lua_rawgeti(L, -3, 6);
+        lua_rawgeti(L, -4, 2);
+        LineDebounce *db = source_debounce(L, -1, lua_tointeger(L, -2));
+        LatencyHistogram *latency = source_latency(L, -1, lua_tointeger(L, -2));
+        lua_pop(L, 4);
+        
+        lua_rawgeti(L, -1, 4);
+        LuaEventBuffer *buf = (LuaEventBuffer *)lua_touserdata(L, -1);
+        if (buf) {
+            // Batch mode: fill the registered buffer, one callback per fd
+            unsigned int max_events = buf->capacity < GPIOD_LUA_MAX_EVENTS ? buf->capacity : GPIOD_LUA_MAX_EVENTS;
+            int num_events = read_line_events(fd, db, buf->events, max_events, 0);
+            if (num_events < 0) {
+                return luaL_error(L, "Failed to read events: %s", strerror(errno));
+            }
+            latency_record_events(latency, buf->events, num_events);
+            convert_event_clock(buf->events, num_events, clock);
+            
+            for (int j = 0; j < num_events; j++) {
+                buf->offsets[j] = offset;
+            }
+            buf->count = num_events;
+            
+            lua_rawgeti(L, -2, 1);
+            lua_insert(L, -2);
+            lua_rawgeti(L, -3, 2);
+            lua_call(L, 2, 0);
+            dispatched += num_events;
+            
+            lua_pop(L, 1);
+            continue;
+        }
+        lua_pop(L, 1);
+        
+        int num_events = read_line_events(fd, db, events, GPIOD_LUA_MAX_EVENTS, 0);
+        if (num_events < 0) {
+            return luaL_error(L, "Failed to read events: %s", strerror(errno));
+        }
+        latency_record_events(latency, events, num_events);
+        convert_event_clock(events, num_events, clock);
+        
+        for (int j = 0; j < num_events; j++) {
+            lua_rawgeti(L, -1, 1);
+            push_line_event(L, &events[j], offset);
+            lua_rawgeti(L, -3, 2);
+            lua_call(L, 2, 0);
+            dispatched++;
+        }
+        
+        lua_pop(L, 1);
+    }
+    
+    lua_settop(L, registry - 1);
+    return dispatched;
+}
+
+// loop:step([timeout_sec])
+static int event_loop_step(lua_State *L) {
+    LuaEventLoop *loop = check_event_loop(L, 1);
+    lua_Number timeout = luaL_optnumber(L, 2, -1);
+    
+    lua_pushinteger(L, event_loop_dispatch(L, loop, timeout_to_ms(timeout)));
+    return 1;
+}
+
+// loop:run([timeout_sec])
+// Dispatches events until loop:stop() is called or the timeout expires
+static int event_loop_run(lua_State *L) {
+    LuaEventLoop *loop = check_event_loop(L, 1);
+    lua_Number timeout = luaL_optnumber(L, 2, -1);
+    
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double deadline = now.tv_sec + now.tv_nsec / 1000000000.0 + timeout;
+    lua_Integer total = 0;
+    
+    loop->running = 1;
+    while (loop->running && loop->epfd >= 0) {
+        lua_Number remaining = -1;
+        if (timeout >= 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            remaining = deadline - (now.tv_sec + now.tv_nsec / 1000000000.0);
+            if (remaining <= 0) {
+                break;
+            }
+        }
+        
+        total += event_loop_dispatch(L, loop, timeout_to_ms(remaining));
+    }
+    loop->running = 0;
+    
+    lua_pushinteger(L, total);
+    return 1;
+}
+
+// loop:stop()
+static int event_loop_stop(lua_State *L) {
+    LuaEventLoop *loop = (LuaEventLoop *)luaL_checkudata(L, 1, GPIOD_EVENT_LOOP_MT);
+    
+    loop->running = 0;
+    return 0;
+}
+
+// loop:fd()
+static int event_loop_fd(lua_State *L) {
+    LuaEventLoop *loop = check_event_loop(L, 1);
+    
+    lua_pushinteger(L, loop->epfd);
+    return 1;
+}
+
+// loop:timeout()
+// Pollable object protocol: the loop itself never needs a timeout
+static int event_loop_timeout(lua_State *L) {
+    check_event_loop(L, 1);
+    
+    lua_pushnil(L);
+    return 1;
+}
+
+// loop:close()
+static int event_loop_close(lua_State *L) {
+    LuaEventLoop *loop = (LuaEventLoop *)luaL_checkudata(L, 1, GPIOD_EVENT_LOOP_MT);
+    
+    if (loop->epfd >= 0) {
+        close(loop->epfd);
+        loop->epfd = -1;
+    }
+    loop->running = 0;
     
-    luaL_getmetatable(L, GPIOD_LINE_MT);
-    lua_setmetatable(L, -2);
+    // Drop references to registered lines and callbacks
+    lua_newtable(L);
+    lua_setuservalue(L, 1);
     
-    return 1;
+    return 0;
 }
 
-// chip:get_all_lines()
-static int chip_get_all_lines(lua_State *L) {
-    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+// ============================================================================
+// Ticker related functions
+// ============================================================================
+
+// gpiod.ticker(period_sec, [spin_sec])
+static int gpiod_ticker(lua_State *L) {
+    lua_Number period = luaL_checknumber(L, 1);
+    lua_Number spin = luaL_optnumber(L, 2, 0);
     
-    if (!chip->chip) {
-        return luaL_error(L, "Chip is closed");
-    }
+    // Deadlines are now + period in int64 ns, so keep half the range free
+    luaL_argcheck(L, period > 0 && period * 1e9 < (lua_Number)(INT64_MAX / 2), 1, "period out of range");
+    luaL_argcheck(L, spin >= 0 && spin < period, 2, "spin must be shorter than the period");
     
-    LuaLineBulk *bulk = (LuaLineBulk *)lua_newuserdata(L, sizeof(LuaLineBulk));
-    gpiod_line_bulk_init(&bulk->bulk);
-    bulk->chip = chip->chip;
+    int64_t period_ns = (int64_t)(period * 1000000000);
+    luaL_argcheck(L, period_ns > 0, 1, "period must be at least 1 ns");
     
-    int ret = gpiod_chip_get_all_lines(chip->chip, &bulk->bulk);
-    if (ret < 0) {
-        return luaL_error(L, "Failed to get all GPIO lines");
-    }
+    LuaTicker *ticker = (LuaTicker *)lua_newuserdata(L, sizeof(LuaTicker));
+    memset(ticker, 0, sizeof(LuaTicker));
+    ticker->period_ns = period_ns;
+    ticker->spin_ns = (int64_t)(spin * 1000000000);
+    ticker->deadline_ns = monotonic_ns() + ticker->period_ns;
     
-    luaL_getmetatable(L, GPIOD_LINE_BULK_MT);
+    luaL_getmetatable(L, GPIOD_TICKER_MT);
     lua_setmetatable(L, -2);
     
     return 1;
 }
 
-// chip:name()
-static int chip_name(lua_State *L) {
-    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
-    
-    if (!chip->chip) {
-        return luaL_error(L, "Chip is closed");
+// ticker:wait()
+// Sleeps until the next deadline. Returns the number of periods skipped
+// because the previous deadline had already passed (0 when on time).
+static int ticker_wait(lua_State *L) {
+    LuaTicker *ticker = (LuaTicker *)luaL_checkudata(L, 1, GPIOD_TICKER_MT);
+    
+    int64_t now = monotonic_ns();
+    lua_Integer skipped = 0;
+    
+    // Missed one or more whole periods: resynchronize to the period grid
+    if (now - ticker->deadline_ns >= ticker->period_ns) {
+        skipped = (now - ticker->deadline_ns) / ticker->period_ns;
+        ticker->deadline_ns += skipped * ticker->period_ns;
+        ticker->overruns += skipped;
     }
     
-    lua_pushstring(L, gpiod_chip_name(chip->chip));
-    return 1;
-}
-
-// chip:label()
-static int chip_label(lua_State *L) {
-    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+    if (now < ticker->deadline_ns) {
+        sleep_until_ns(ticker->deadline_ns, ticker->spin_ns);
+        now = monotonic_ns();
+    }
     
-    if (!chip->chip) {
-        return luaL_error(L, "Chip is closed");
+    int64_t late = now - ticker->deadline_ns;
+    ticker->late_total_ns += late;
+    if (late > ticker->late_max_ns) {
+        ticker->late_max_ns = late;
     }
     
-    lua_pushstring(L, gpiod_chip_label(chip->chip));
+    ticker->ticks++;
+    ticker->deadline_ns += ticker->period_ns;
+    
+    lua_pushinteger(L, skipped);
     return 1;
 }
 
-// chip:num_lines()
-static int chip_num_lines(lua_State *L) {
-    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
-    
-    if (!chip->chip) {
-        return luaL_error(L, "Chip is closed");
-    }
+// ticker:stats()
+static int ticker_stats(lua_State *L) {
+    LuaTicker *ticker = (LuaTicker *)luaL_checkudata(L, 1, GPIOD_TICKER_MT);
+    
+    lua_createtable(L, 0, 5);
+    lua_pushinteger(L, ticker->period_ns);
+    lua_setfield(L, -2, "period_ns");
+    lua_pushinteger(L, (lua_Integer)ticker->ticks);
+    lua_setfield(L, -2, "ticks");
+    lua_pushinteger(L, (lua_Integer)ticker->overruns);
+    lua_setfield(L, -2, "overruns");
+    lua_pushinteger(L, ticker->late_max_ns);
+    lua_setfield(L, -2, "max_late_ns");
+    lua_pushinteger(L, ticker->ticks ? ticker->late_total_ns / (int64_t)ticker->ticks : 0);
+    lua_setfield(L, -2, "mean_late_ns");
     
-    lua_pushinteger(L, gpiod_chip_num_lines(chip->chip));
     return 1;
 }
 
-// chip:close()
-static int chip_close(lua_State *L) {
-    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+// ticker:reset()
+// Restarts the period grid from now and clears the statistics
+static int ticker_reset(lua_State *L) {
+    LuaTicker *ticker = (LuaTicker *)luaL_checkudata(L, 1, GPIOD_TICKER_MT);
     
-    if (chip->chip) {
-        gpiod_chip_close(chip->chip);
-        chip->chip = NULL;
-    }
+    ticker->deadline_ns = monotonic_ns() + ticker->period_ns;
+    ticker->ticks = 0;
+    ticker->overruns = 0;
+    ticker->late_total_ns = 0;
+    ticker->late_max_ns = 0;
     
     return 0;
 }
 
 // ============================================================================
-// Line related functions
+// Background Capture related functions
 // ============================================================================
 
-// line:request_input(consumer, [flags])
-static int line_request_input(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
-    const char *consumer = luaL_checkstring(L, 2);
-    int flags = luaL_optinteger(L, 3, 0);
+// Helper function: order capture records by timestamp
+static int capture_record_compare(const void *a, const void *b) {
+    const CaptureRecord *ra = (const CaptureRecord *)a;
+    const CaptureRecord *rb = (const CaptureRecord *)b;
     
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
+    return (ra->timestamp_ns > rb->timestamp_ns) - (ra->timestamp_ns < rb->timestamp_ns);
+}
+
+// Helper function: push records into the ring (capture thread only)
+static void capture_push(LuaCapture *cap, const CaptureRecord *records, unsigned int count) {
+    unsigned int head = atomic_load_explicit(&cap->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&cap->tail, memory_order_acquire);
+    unsigned int capacity = cap->mask + 1;
+    unsigned int dropped = 0;
+    
+    for (unsigned int i = 0; i < count; i++) {
+        if (head - tail == capacity) {
+            dropped++;
+            continue;
+        }
+        cap->ring[head & cap->mask] = records[i];
+        head++;
     }
     
-    int ret = gpiod_line_request_input_flags(line->line, consumer, flags);
-    if (ret < 0) {
-        return luaL_error(L, "Failed to request input mode");
+    atomic_store_explicit(&cap->head, head, memory_order_release);
+    atomic_fetch_add_explicit(&cap->received, count, memory_order_relaxed);
+    if (dropped) {
+        atomic_fetch_add_explicit(&cap->overflows, dropped, memory_order_relaxed);
     }
     
-    lua_pushboolean(L, 1);
-    return 1;
+    unsigned int depth = head - tail;
+    if (depth > atomic_load_explicit(&cap->high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&cap->high_water, depth, memory_order_relaxed);
+    }
 }
 
-// line:request_output(consumer, default_val, [flags])
-static int line_request_output(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
-    const char *consumer = luaL_checkstring(L, 2);
-    int default_val = luaL_checkinteger(L, 3);
-    int flags = luaL_optinteger(L, 4, 0);
-    
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
+// Helper function: append records to the capture file (capture thread only)
+static void capture_file_push(LuaCapture *cap, const CaptureRecord *records, unsigned int count) {
+    RecordingHeader *hdr = cap->file;
+    RecordingRecord *out = (RecordingRecord *)((char *)hdr + hdr->header_size);
+    uint64_t written = atomic_load_explicit(&hdr->written, memory_order_relaxed);
+    int ring = hdr->flags & GPIOD_LUA_RECORDING_RING;
+    unsigned int dropped = 0;
+    
+    for (unsigned int i = 0; i < count; i++) {
+        if (!ring && written == hdr->capacity) {
+            dropped++;
+            continue;
+        }
+        
+        RecordingRecord *rec = &out[written % hdr->capacity];
+        rec->timestamp_ns = records[i].timestamp_ns;
+        rec->offset = records[i].offset;
+        rec->index = records[i].index;
+        rec->event_type = records[i].event_type;
+        rec->reserved = 0;
+        written++;
     }
     
-    int ret = gpiod_line_request_output_flags(line->line, consumer, flags, default_val);
-    if (ret < 0) {
-        return luaL_error(L, "Failed to request output mode");
+    atomic_store_explicit(&hdr->written, written, memory_order_release);
+    atomic_fetch_add_explicit(&cap->received, count, memory_order_relaxed);
+    if (dropped) {
+        atomic_fetch_add_explicit(&hdr->dropped, dropped, memory_order_relaxed);
+        atomic_fetch_add_explicit(&cap->overflows, dropped, memory_order_relaxed);
     }
-    
-    lua_pushboolean(L, 1);
-    return 1;
 }
 
-// line:get_value()
-static int line_get_value(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+// Capture thread: block on all event fds and decode ready events
+static void *capture_thread(void *arg) {
+    LuaCapture *cap = (LuaCapture *)arg;
+    struct pollfd pfds[GPIOD_LINE_BULK_MAX_LINES + 1];
+    struct gpiod_line_event events[GPIOD_LUA_MAX_EVENTS];
+    CaptureRecord records[GPIOD_LINE_BULK_MAX_LINES * GPIOD_LUA_MAX_EVENTS];
+    
+    for (unsigned int i = 0; i < cap->num_lines; i++) {
+        pfds[i].fd = cap->fds[i];
+        pfds[i].events = POLLIN | POLLPRI;
+    }
+    pfds[cap->num_lines].fd = cap->stop_fd;
+    pfds[cap->num_lines].events = POLLIN;
+    
+    for (;;) {
+        // Wake up in time to deliver the last edge of a bouncing line
+        int timeout_ms = -1;
+        for (unsigned int i = 0; i < cap->num_lines; i++) {
+            int ms = debounce_timeout_ms(&cap->debounce[i]);
+            if (ms >= 0 && (timeout_ms < 0 || ms < timeout_ms)) {
+                timeout_ms = ms;
+            }
+        }
+        
+        int ret = poll(pfds, cap->num_lines + 1, timeout_ms);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            atomic_store(&cap->error, errno);
+            break;
+        }
+        
+        if (pfds[cap->num_lines].revents) {
+            break;
+        }
+        
+        unsigned int count = 0;
+        unsigned int sources = 0;
+        for (unsigned int i = 0; i < cap->num_lines; i++) {
+            if (!pfds[i].revents && !cap->debounce[i].in_burst) {
+                continue;
+            }
+            
+            // The chip was removed underneath the capture
+            if (pfds[i].revents & (POLLERR | POLLNVAL)) {
+                atomic_store(&cap->error, EBADF);
+                return NULL;
+            }
+            
+            int num_events = read_line_events(cap->fds[i], &cap->debounce[i], events, GPIOD_LUA_MAX_EVENTS, 0);
+            if (num_events < 0) {
+                atomic_store(&cap->error, errno);
+                return NULL;
+            }
+            convert_event_clock(events, num_events, cap->event_clock);
+            
+            for (int j = 0; j < num_events; j++) {
+                records[count].timestamp_ns = timespec_to_ns(&events[j].ts);
+                records[count].offset = cap->offsets[i];
+                records[count].index = i;
+                records[count].event_type = events[j].event_type;
+                count++;
+            }
+            sources++;
+        }
+        
+        // Keep events from different lines in timestamp order
+        if (sources > 1) {
+            qsort(records, count, sizeof(CaptureRecord), capture_record_compare);
+        }
+        
+        if (cap->file) {
+            capture_file_push(cap, records, count);
+        } else {
+            capture_push(cap, records, count);
+        }
+    }
     
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
+    return NULL;
+}
+
+// Helper function: unmap and close the capture file once the thread is
+// stopped. Linear files are truncated to the records written
+static void capture_file_close(LuaCapture *cap) {
+    RecordingHeader *hdr = cap->file;
+    size_t used = cap->file_size;
+    
+    if (!(hdr->flags & GPIOD_LUA_RECORDING_RING)) {
+        used = hdr->header_size + atomic_load(&hdr->written) * sizeof(RecordingRecord);
     }
     
-    int value = gpiod_line_get_value(line->line);
-    if (value < 0) {
-        return luaL_error(L, "Failed to read GPIO value");
+    msync(hdr, cap->file_size, MS_SYNC);
+    munmap(hdr, cap->file_size);
+    if (used < cap->file_size && ftruncate(cap->file_fd, used) < 0) {
+        atomic_store(&cap->error, errno);
     }
+    close(cap->file_fd);
     
-    lua_pushinteger(L, value);
-    return 1;
+    cap->file = NULL;
+    cap->file_fd = -1;
 }
 
-// line:set_value(value)
-static int line_set_value(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
-    int value = luaL_checkinteger(L, 2);
+// Helper function: stop and join the capture thread
+static void capture_stop(LuaCapture *cap) {
+    fd_thread_stop(cap->thread, &cap->started, &cap->stop_fd, cap->fds, cap->num_lines);
     
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
+    if (cap->file) {
+        capture_file_close(cap);
     }
+}
+
+// Helper function: number of records waiting in the ring (Lua side)
+static unsigned int capture_pending(LuaCapture *cap) {
+    unsigned int head = atomic_load_explicit(&cap->head, memory_order_acquire);
+    unsigned int tail = atomic_load_explicit(&cap->tail, memory_order_relaxed);
     
-    int ret = gpiod_line_set_value(line->line, value);
-    if (ret < 0) {
-        return luaL_error(L, "Failed to set GPIO value");
+    return head - tail;
+}
+
+// Helper function: push a capture of the event source at index 1 with a
+// ring of capacity records (a power of two); the thread is not started yet
+static LuaCapture *new_capture(lua_State *L, int clock, struct gpiod_line_bulk *lines, unsigned int capacity) {
+    LuaCapture *cap = (LuaCapture *)lua_newuserdata(L, sizeof(LuaCapture) + capacity * sizeof(CaptureRecord));
+    cap->started = 0;
+    cap->stop_fd = -1;
+    cap->event_clock = clock;
+    cap->num_lines = gpiod_line_bulk_num_lines(lines);
+    cap->mask = capacity - 1;
+    atomic_init(&cap->head, 0);
+    atomic_init(&cap->tail, 0);
+    atomic_init(&cap->high_water, 0);
+    atomic_init(&cap->received, 0);
+    atomic_init(&cap->overflows, 0);
+    atomic_init(&cap->error, 0);
+    cap->file = NULL;
+    cap->file_size = 0;
+    cap->file_fd = -1;
+    cap->file_capacity = 0;
+    for (unsigned int i = 0; i < cap->num_lines; i++) {
+        cap->fds[i] = -1;
     }
     
-    lua_pushboolean(L, 1);
-    return 1;
+    luaL_getmetatable(L, GPIOD_CAPTURE_MT);
+    lua_setmetatable(L, -2);
+    
+    for (unsigned int i = 0; i < cap->num_lines; i++) {
+        struct gpiod_line *line = gpiod_line_bulk_get_line(lines, i);
+        int fd = gpiod_line_event_get_fd(line);
+        
+        cap->offsets[i] = gpiod_line_offset(line);
+        if (fd < 0) {
+            luaL_error(L, "Line %d is not requested for events", cap->offsets[i]);
+        }
+        
+        // The thread polls its own duplicate: releasing the line closes the
+        // line's fd, whose number may then be reused by an unrelated file
+        cap->fds[i] = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (cap->fds[i] < 0) {
+            luaL_error(L, "Failed to create capture: %s", strerror(errno));
+        }
+        
+        // The thread filters with its own copy of the source's settings
+        LineDebounce *db = source_debounce(L, 1, i);
+        debounce_init(&cap->debounce[i], db ? db->window_ns : 0);
+    }
+    
+    // Keep the source alive while the capture runs
+    lua_pushvalue(L, 1);
+    lua_setuservalue(L, -2);
+    
+    return cap;
 }
 
-// line:offset()
-static int line_offset(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+// Helper function: start the thread of a capture on top of the stack
+static int capture_start(lua_State *L, LuaCapture *cap) {
+    cap->stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (cap->stop_fd < 0) {
+        return luaL_error(L, "Failed to create capture: %s", strerror(errno));
+    }
     
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
+    int ret = pthread_create(&cap->thread, NULL, capture_thread, cap);
+    if (ret != 0) {
+        return luaL_error(L, "Failed to start capture thread: %s", strerror(ret));
     }
+    cap->started = 1;
     
-    lua_pushinteger(L, gpiod_line_offset(line->line));
     return 1;
 }
 
-// line:name()
-static int line_name(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
-    
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
+// gpiod.capture(line_or_bulk, [capacity])
+// Starts a background thread capturing events of event-requested lines
+static int gpiod_capture(lua_State *L) {
+    struct gpiod_line_bulk lines;
+    int clock = check_event_source(L, 1, &lines);
+    lua_Integer requested = luaL_optinteger(L, 2, GPIOD_LUA_CAPTURE_DEFAULT_EVENTS);
+    
+    luaL_argcheck(L, requested > 0 && requested <= GPIOD_LUA_CAPTURE_MAX_EVENTS, 2,
+                  "capacity out of range");
+    
+    unsigned int capacity = 1;
+    while (capacity < requested) {
+        capacity <<= 1;
     }
     
-    const char *name = gpiod_line_name(line->line);
-    if (name) {
-        lua_pushstring(L, name);
-    } else {
-        lua_pushnil(L);
-    }
-    return 1;
+    LuaCapture *cap = new_capture(L, clock, &lines, capacity);
+    return capture_start(L, cap);
 }
 
-// line:consumer()
-static int line_consumer(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+// Helper function: create and map a preallocated capture file
+static int capture_file_open(LuaCapture *cap, const char *path, uint64_t capacity, int ring) {
+    size_t size = sizeof(RecordingHeader) + capacity * sizeof(RecordingRecord);
     
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
     }
     
-    const char *consumer = gpiod_line_consumer(line->line);
-    if (consumer) {
-        lua_pushstring(L, consumer);
-    } else {
-        lua_pushnil(L);
+    int ret = posix_fallocate(fd, 0, size);
+    if (ret != 0) {
+        close(fd);
+        errno = ret;
+        return -1;
     }
-    return 1;
+    
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+    
+    RecordingHeader *hdr = (RecordingHeader *)map;
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, GPIOD_LUA_RECORDING_MAGIC, sizeof(hdr->magic));
+    hdr->version = GPIOD_LUA_RECORDING_VERSION;
+    hdr->header_size = sizeof(RecordingHeader);
+    hdr->record_size = sizeof(RecordingRecord);
+    hdr->flags = ring ? GPIOD_LUA_RECORDING_RING : 0;
+    hdr->capacity = capacity;
+    atomic_init(&hdr->written, 0);
+    atomic_init(&hdr->dropped, 0);
+    
+    cap->file = hdr;
+    cap->file_size = size;
+    cap->file_fd = fd;
+    cap->file_capacity = capacity;
+    return 0;
 }
 
-// line:direction()
-static int line_direction(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
-    
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
+// gpiod.record(line_or_bulk, path, [max_records], [ring])
+// Starts a background capture that streams events into a preallocated,
+// memory-mapped capture file. A linear file stops recording when full; a
+// ring file keeps the latest max_records events
+static int gpiod_record(lua_State *L) {
+    struct gpiod_line_bulk lines;
+    int clock = check_event_source(L, 1, &lines);
+    const char *path = luaL_checkstring(L, 2);
+    lua_Integer capacity = luaL_optinteger(L, 3, GPIOD_LUA_RECORDING_DEFAULT_RECORDS);
+    int ring = lua_toboolean(L, 4);
+    
+    luaL_argcheck(L, capacity > 0 && capacity <= GPIOD_LUA_RECORDING_MAX_RECORDS, 3,
+                  "max_records out of range");
+    
+    LuaCapture *cap = new_capture(L, clock, &lines, 1);
+    
+    if (capture_file_open(cap, path, capacity, ring) < 0) {
+        return luaL_error(L, "Failed to create capture file %s: %s", path, strerror(errno));
     }
     
-    int direction = gpiod_line_direction(line->line);
-    switch (direction) {
-        case GPIOD_LINE_DIRECTION_INPUT:
-            lua_pushstring(L, "input");
-            break;
-        case GPIOD_LINE_DIRECTION_OUTPUT:
-            lua_pushstring(L, "output");
-            break;
-        default:
-            lua_pushstring(L, "unknown");
-            break;
+    RecordingHeader *hdr = cap->file;
+    struct timespec start;
+    clock_gettime(clock, &start);
+    hdr->event_clock = clock;
+    hdr->num_lines = cap->num_lines;
+    hdr->start_ns = timespec_to_ns(&start);
+    
+    for (unsigned int i = 0; i < cap->num_lines; i++) {
+        struct gpiod_line *line = gpiod_line_bulk_get_line(&lines, i);
+        const char *name = gpiod_line_name(line);
+        
+        hdr->offsets[i] = cap->offsets[i];
+        snprintf(hdr->names[i], sizeof(hdr->names[i]), "%s", name ? name : "");
+        if (gpiod_line_get_value(line) > 0) {
+            hdr->initial_mask |= (uint64_t)1 << i;
+        }
     }
-    return 1;
+    
+    return capture_start(L, cap);
 }
 
-// line:is_used()
-static int line_is_used(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+// cap:read_into(buffer)
+// Moves captured events into the event buffer without blocking
+static int capture_read_into(lua_State *L) {
+    LuaCapture *cap = (LuaCapture *)luaL_checkudata(L, 1, GPIOD_CAPTURE_MT);
+    LuaEventBuffer *buf = (LuaEventBuffer *)luaL_checkudata(L, 2, GPIOD_EVENT_BUFFER_MT);
+    
+    unsigned int tail = atomic_load_explicit(&cap->tail, memory_order_relaxed);
+    unsigned int count = capture_pending(cap);
+    if (count > buf->capacity) {
+        count = buf->capacity;
+    }
     
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
+    for (unsigned int i = 0; i < count; i++) {
+        const CaptureRecord *rec = &cap->ring[(tail + i) & cap->mask];
+        
+        buf->events[i].ts.tv_sec = rec->timestamp_ns / 1000000000;
+        buf->events[i].ts.tv_nsec = rec->timestamp_ns % 1000000000;
+        buf->events[i].event_type = rec->event_type;
+        buf->offsets[i] = rec->offset;
     }
+    buf->count = count;
     
-    lua_pushboolean(L, gpiod_line_is_used(line->line));
+    atomic_store_explicit(&cap->tail, tail + count, memory_order_release);
+    
+    lua_pushinteger(L, count);
     return 1;
 }
 
-// line:release()
-static int line_release(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+// cap:read([max_events])
+// Moves captured events into a table of event objects without blocking
+static int capture_read(lua_State *L) {
+    LuaCapture *cap = (LuaCapture *)luaL_checkudata(L, 1, GPIOD_CAPTURE_MT);
+    lua_Integer max_events = luaL_optinteger(L, 2, cap->mask + 1);
+    
+    luaL_argcheck(L, max_events > 0, 2, "max_events out of range");
+    
+    unsigned int tail = atomic_load_explicit(&cap->tail, memory_order_relaxed);
+    unsigned int count = capture_pending(cap);
+    if (count > max_events) {
+        count = max_events;
+    }
     
-    if (line->line) {
-        gpiod_line_release(line->line);
-        line->line = NULL;
+    lua_createtable(L, count, 0);
+    for (unsigned int i = 0; i < count; i++) {
+        const CaptureRecord *rec = &cap->ring[(tail + i) & cap->mask];
+        struct gpiod_line_event ev;
+        
+        ev.ts.tv_sec = rec->timestamp_ns / 1000000000;
+        ev.ts.tv_nsec = rec->timestamp_ns % 1000000000;
+        ev.event_type = rec->event_type;
+        push_line_event(L, &ev, rec->offset);
+        lua_rawseti(L, -2, i + 1);
     }
     
-    return 0;
+    atomic_store_explicit(&cap->tail, tail + count, memory_order_release);
+    
+    return 1;
 }
 
-// line:request_rising_edge_events(consumer)
-static int line_request_rising_edge_events(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
-    const char *consumer = luaL_checkstring(L, 2);
+// cap:pending()
+static int capture_pending_count(lua_State *L) {
+    LuaCapture *cap = (LuaCapture *)luaL_checkudata(L, 1, GPIOD_CAPTURE_MT);
     
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
-    }
+    lua_pushinteger(L, capture_pending(cap));
+    return 1;
+}
+
+// cap:overflows()
+static int capture_overflows(lua_State *L) {
+    LuaCapture *cap = (LuaCapture *)luaL_checkudata(L, 1, GPIOD_CAPTURE_MT);
     
-    int ret = gpiod_line_request_rising_edge_events(line->line, consumer);
-    if (ret < 0) {
-        return luaL_error(L, "Failed to request rising edge events");
+    lua_pushinteger(L, (lua_Integer)atomic_load(&cap->overflows));
+    return 1;
+}
+
+// cap:stats()
+static int capture_stats(lua_State *L) {
+    LuaCapture *cap = (LuaCapture *)luaL_checkudata(L, 1, GPIOD_CAPTURE_MT);
+    
+    lua_createtable(L, 0, 7);
+    lua_pushinteger(L, cap->file_capacity ? (lua_Integer)cap->file_capacity : cap->mask + 1);
+    lua_setfield(L, -2, "capacity");
+    lua_pushinteger(L, capture_pending(cap));
+    lua_setfield(L, -2, "pending");
+    lua_pushinteger(L, atomic_load(&cap->high_water));
+    lua_setfield(L, -2, "high_water");
+    lua_pushinteger(L, (lua_Integer)atomic_load(&cap->received));
+    lua_setfield(L, -2, "received");
+    lua_pushinteger(L, (lua_Integer)atomic_load(&cap->overflows));
+    lua_setfield(L, -2, "overflows");
+    int error = atomic_load(&cap->error);
+    lua_pushboolean(L, cap->started && !error);
+    lua_setfield(L, -2, "running");
+    
+    if (error) {
+        lua_pushstring(L, strerror(error));
+        lua_setfield(L, -2, "error");
     }
     
-    lua_pushboolean(L, 1);
     return 1;
 }
 
-// line:request_falling_edge_events(consumer)
-static int line_request_falling_edge_events(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
-    const char *consumer = luaL_checkstring(L, 2);
+// cap:reset_stats()
+static int capture_reset_stats(lua_State *L) {
+    LuaCapture *cap = (LuaCapture *)luaL_checkudata(L, 1, GPIOD_CAPTURE_MT);
     
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
-    }
+    atomic_store(&cap->received, 0);
+    atomic_store(&cap->overflows, 0);
+    atomic_store(&cap->high_water, capture_pending(cap));
+    return 0;
+}
+
+// cap:stop()
+// Stops the capture thread; already captured events can still be read
+static int capture_close(lua_State *L) {
+    LuaCapture *cap = (LuaCapture *)luaL_checkudata(L, 1, GPIOD_CAPTURE_MT);
     
-    int ret = gpiod_line_request_falling_edge_events(line->line, consumer);
-    if (ret < 0) {
-        return luaL_error(L, "Failed to request falling edge events");
+    capture_stop(cap);
+    return 0;
+}
+
+// ============================================================================
+// Capture File Reader related functions
+// ============================================================================
+
+// Helper function: check an open capture file reader argument
+static LuaRecording *check_recording(lua_State *L, int idx) {
+    LuaRecording *rec = (LuaRecording *)luaL_checkudata(L, idx, GPIOD_RECORDING_MT);
+    
+    if (!rec->header) {
+        luaL_error(L, "Capture file is closed");
+    }
+    return rec;
+}
+
+// Helper function: records written so far (the file may still be recorded)
+static uint64_t recording_written(const RecordingHeader *hdr) {
+    return atomic_load_explicit(&hdr->written, memory_order_acquire);
+}
+
+// Helper function: oldest record still held by the file
+static uint64_t recording_first(const RecordingHeader *hdr, uint64_t written) {
+    if ((hdr->flags & GPIOD_LUA_RECORDING_RING) && written > hdr->capacity) {
+        return written - hdr->capacity;
     }
+    return 0;
+}
+
+// Helper function: record number n (counted like written)
+static const RecordingRecord *recording_record(const LuaRecording *rec, uint64_t n) {
+    const RecordingRecord *records =
+        (const RecordingRecord *)((const char *)rec->header + rec->header->header_size);
     
-    lua_pushboolean(L, 1);
-    return 1;
+    return &records[n % rec->header->capacity];
 }
 
-// line:request_both_edges_events(consumer)
-static int line_request_both_edges_events(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
-    const char *consumer = luaL_checkstring(L, 2);
+// Helper function: number of records readable from the current position
+static uint64_t recording_available(LuaRecording *rec) {
+    uint64_t written = recording_written(rec->header);
+    uint64_t first = recording_first(rec->header, written);
+    
+    // Skip records a live ring has overwritten
+    if (rec->position < first) {
+        rec->position = first;
+    }
+    return written - rec->position;
+}
+
+// gpiod.recording(path)
+// Opens a capture file written by gpiod.record() for reading
+static int gpiod_recording(lua_State *L) {
+    const char *path = luaL_checkstring(L, 1);
+    
+    LuaRecording *rec = (LuaRecording *)lua_newuserdata(L, sizeof(LuaRecording));
+    rec->fd = -1;
+    rec->header = NULL;
+    rec->size = 0;
+    rec->position = 0;
+    
+    luaL_getmetatable(L, GPIOD_RECORDING_MT);
+    lua_setmetatable(L, -2);
     
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
+    rec->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (rec->fd < 0) {
+        return luaL_error(L, "Failed to open capture file %s: %s", path, strerror(errno));
     }
     
-    int ret = gpiod_line_request_both_edges_events(line->line, consumer);
-    if (ret < 0) {
-        return luaL_error(L, "Failed to request both edges events");
+    struct stat st;
+    if (fstat(rec->fd, &st) < 0 || (size_t)st.st_size < sizeof(RecordingHeader)) {
+        return luaL_error(L, "Not a capture file: %s", path);
+    }
+    
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, rec->fd, 0);
+    if (map == MAP_FAILED) {
+        return luaL_error(L, "Failed to map capture file %s: %s", path, strerror(errno));
+    }
+    rec->header = (const RecordingHeader *)map;
+    rec->size = st.st_size;
+    
+    const RecordingHeader *hdr = rec->header;
+    uint64_t written = recording_written(hdr);
+    uint64_t held = written < hdr->capacity ? written : hdr->capacity;
+    if (memcmp(hdr->magic, GPIOD_LUA_RECORDING_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != GPIOD_LUA_RECORDING_VERSION ||
+        hdr->header_size != sizeof(RecordingHeader) ||
+        hdr->record_size != sizeof(RecordingRecord) ||
+        hdr->capacity == 0 || hdr->num_lines > GPIOD_LINE_BULK_MAX_LINES ||
+        rec->size < hdr->header_size + held * hdr->record_size) {
+        return luaL_error(L, "Not a capture file: %s", path);
     }
     
-    lua_pushboolean(L, 1);
+    rec->position = recording_first(hdr, written);
     return 1;
 }
 
-// line:request_rising_edge_events_flags(consumer, flags)
-static int line_request_rising_edge_events_flags(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
-    const char *consumer = luaL_checkstring(L, 2);
-    int flags = luaL_checkinteger(L, 3);
-    
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
-    }
-    
-    int ret = gpiod_line_request_rising_edge_events_flags(line->line, consumer, flags);
-    if (ret < 0) {
-        return luaL_error(L, "Failed to request rising edge events");
+// rec:info()
+static int recording_info(lua_State *L) {
+    LuaRecording *rec = check_recording(L, 1);
+    const RecordingHeader *hdr = rec->header;
+    
+    lua_createtable(L, 0, 8);
+    lua_pushinteger(L, (lua_Integer)hdr->capacity);
+    lua_setfield(L, -2, "capacity");
+    lua_pushinteger(L, (lua_Integer)recording_written(hdr));
+    lua_setfield(L, -2, "written");
+    lua_pushinteger(L, (lua_Integer)atomic_load(&hdr->dropped));
+    lua_setfield(L, -2, "dropped");
+    lua_pushboolean(L, hdr->flags & GPIOD_LUA_RECORDING_RING);
+    lua_setfield(L, -2, "ring");
+    lua_pushinteger(L, hdr->event_clock);
+    lua_setfield(L, -2, "event_clock");
+    lua_pushinteger(L, hdr->start_ns);
+    lua_setfield(L, -2, "start_ns");
+    lua_pushinteger(L, (lua_Integer)hdr->initial_mask);
+    lua_setfield(L, -2, "initial_mask");
+    
+    lua_createtable(L, hdr->num_lines, 0);
+    for (unsigned int i = 0; i < hdr->num_lines; i++) {
+        lua_createtable(L, 0, 2);
+        lua_pushinteger(L, hdr->offsets[i]);
+        lua_setfield(L, -2, "offset");
+        if (hdr->names[i][0]) {
+            lua_pushlstring(L, hdr->names[i], strnlen(hdr->names[i], sizeof(hdr->names[i])));
+            lua_setfield(L, -2, "name");
+        }
+        lua_rawseti(L, -2, i + 1);
     }
+    lua_setfield(L, -2, "lines");
     
-    lua_pushboolean(L, 1);
     return 1;
 }
 
-// line:request_falling_edge_events_flags(consumer, flags)
-static int line_request_falling_edge_events_flags(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
-    const char *consumer = luaL_checkstring(L, 2);
-    int flags = luaL_checkinteger(L, 3);
-    
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
+// rec:read_into(buffer)
+// Reads the next chunk of records into an event buffer; returns the
+// number of events, 0 at the end of the file
+static int recording_read_into(lua_State *L) {
+    LuaRecording *rec = check_recording(L, 1);
+    LuaEventBuffer *buf = (LuaEventBuffer *)luaL_checkudata(L, 2, GPIOD_EVENT_BUFFER_MT);
+    
+    uint64_t count = recording_available(rec);
+    if (count > buf->capacity) {
+        count = buf->capacity;
     }
     
-    int ret = gpiod_line_request_falling_edge_events_flags(line->line, consumer, flags);
-    if (ret < 0) {
-        return luaL_error(L, "Failed to request falling edge events");
+    for (unsigned int i = 0; i < count; i++) {
+        const RecordingRecord *r = recording_record(rec, rec->position + i);
+        
+        buf->events[i].ts.tv_sec = r->timestamp_ns / 1000000000;
+        buf->events[i].ts.tv_nsec = r->timestamp_ns % 1000000000;
+        buf->events[i].event_type = r->event_type;
+        buf->offsets[i] = r->offset;
     }
+    buf->count = count;
+    rec->position += count;
     
-    lua_pushboolean(L, 1);
+    lua_pushinteger(L, (lua_Integer)count);
     return 1;
 }
 
-// line:request_both_edges_events_flags(consumer, flags)
-static int line_request_both_edges_events_flags(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
-    const char *consumer = luaL_checkstring(L, 2);
-    int flags = luaL_checkinteger(L, 3);
-    
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
+// rec:read([max_events])
+// Reads the next chunk of records into a table of event objects (empty at
+// the end of the file)
+static int recording_read(lua_State *L) {
+    LuaRecording *rec = check_recording(L, 1);
+    lua_Integer max_events = luaL_optinteger(L, 2, GPIOD_LUA_CAPTURE_DEFAULT_EVENTS);
+    
+    luaL_argcheck(L, max_events > 0, 2, "max_events out of range");
+    
+    uint64_t count = recording_available(rec);
+    if (count > (uint64_t)max_events) {
+        count = max_events;
     }
     
-    int ret = gpiod_line_request_both_edges_events_flags(line->line, consumer, flags);
-    if (ret < 0) {
-        return luaL_error(L, "Failed to request both edges events");
+    lua_createtable(L, count, 0);
+    for (unsigned int i = 0; i < count; i++) {
+        const RecordingRecord *r = recording_record(rec, rec->position + i);
+        struct gpiod_line_event ev;
+        
+        ev.ts.tv_sec = r->timestamp_ns / 1000000000;
+        ev.ts.tv_nsec = r->timestamp_ns % 1000000000;
+        ev.event_type = r->event_type;
+        push_line_event(L, &ev, r->offset);
+        lua_rawseti(L, -2, i + 1);
     }
+    rec->position += count;
     
-    lua_pushboolean(L, 1);
     return 1;
 }
 
-// line:event_wait(timeout_sec)
-static int line_event_wait(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
-    lua_Number timeout = luaL_optnumber(L, 2, -1);
+// rec:rewind()
+static int recording_rewind(lua_State *L) {
+    LuaRecording *rec = check_recording(L, 1);
     
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
+    rec->position = recording_first(rec->header, recording_written(rec->header));
+    return 0;
+}
+
+// rec:export_vcd(path)
+// Writes all held records as a Value Change Dump (viewable in GTKWave),
+// with times in ns since the start of the capture; returns the number of
+// value changes written
+static int recording_export_vcd(lua_State *L) {
+    LuaRecording *rec = check_recording(L, 1);
+    const char *path = luaL_checkstring(L, 2);
+    const RecordingHeader *hdr = rec->header;
+    
+    uint64_t written = recording_written(hdr);
+    uint64_t first = recording_first(hdr, written);
+    
+    // Levels before the first held record: the start levels, or for a ring
+    // that wrapped the level before each line's first held edge ('x' when a
+    // line has none)
+    char initial[GPIOD_LINE_BULK_MAX_LINES];
+    for (unsigned int i = 0; i < hdr->num_lines; i++) {
+        initial[i] = first ? 'x' : ((hdr->initial_mask >> i) & 1 ? '1' : '0');
+    }
+    if (first) {
+        unsigned int unresolved = hdr->num_lines;
+        for (uint64_t n = first; n < written && unresolved; n++) {
+            const RecordingRecord *r = recording_record(rec, n);
+            if (r->index < hdr->num_lines && initial[r->index] == 'x') {
+                initial[r->index] = r->event_type == GPIOD_LINE_EVENT_RISING_EDGE ? '0' : '1';
+                unresolved--;
+            }
+        }
     }
     
-    struct timespec ts;
-    struct timespec *timeout_ptr = NULL;
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        return luaL_error(L, "Failed to create VCD file %s: %s", path, strerror(errno));
+    }
     
-    if (timeout >= 0) {
-        ts.tv_sec = (time_t)timeout;
-        ts.tv_nsec = (long)((timeout - ts.tv_sec) * 1000000000);
-        timeout_ptr = &ts;
+    fprintf(out, "$version gpiod-lua $end\n$timescale 1ns $end\n$scope module gpio $end\n");
+    for (unsigned int i = 0; i < hdr->num_lines; i++) {
+        char name[sizeof(hdr->names[i]) + 1];
+        
+        if (hdr->names[i][0]) {
+            snprintf(name, sizeof(name), "%.*s", (int)sizeof(hdr->names[i]), hdr->names[i]);
+            for (char *c = name; *c; c++) {
+                if (*c <= ' ' || *c > '~') {
+                    *c = '_';
+                }
+            }
+        } else {
+            snprintf(name, sizeof(name), "line%u", hdr->offsets[i]);
+        }
+        fprintf(out, "$var wire 1 %c %s $end\n", '!' + i, name);
+    }
+    fprintf(out, "$upscope $end\n$enddefinitions $end\n#0\n$dumpvars\n");
+    for (unsigned int i = 0; i < hdr->num_lines; i++) {
+        fprintf(out, "%c%c\n", initial[i], '!' + i);
+    }
+    fprintf(out, "$end\n");
+    
+    // Events queued before the start of the capture are clamped to time 0
+    int64_t time_ns = 0;
+    lua_Integer changes = 0;
+    for (uint64_t n = first; n < written; n++) {
+        const RecordingRecord *r = recording_record(rec, n);
+        if (r->index >= hdr->num_lines) {
+            continue;
+        }
+        
+        int64_t t = r->timestamp_ns - hdr->start_ns;
+        if (t > time_ns) {
+            time_ns = t;
+            fprintf(out, "#%lld\n", (long long)time_ns);
+        }
+        fprintf(out, "%c%c\n", r->event_type == GPIOD_LINE_EVENT_RISING_EDGE ? '1' : '0', '!' + r->index);
+        changes++;
     }
     
-    int ret = gpiod_line_event_wait(line->line, timeout_ptr);
-    if (ret < 0) {
-        return luaL_error(L, "Failed to wait for event");
+    int failed = ferror(out);
+    if (fclose(out) != 0 || failed) {
+        return luaL_error(L, "Failed to write VCD file %s", path);
     }
     
-    lua_pushboolean(L, ret > 0);
+    lua_pushinteger(L, changes);
     return 1;
 }
 
-// line:event_read()
-static int line_event_read(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+// rec:close()
+static int recording_close(lua_State *L) {
+    LuaRecording *rec = (LuaRecording *)luaL_checkudata(L, 1, GPIOD_RECORDING_MT);
     
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
+    if (rec->header) {
+        munmap((void *)rec->header, rec->size);
+        rec->header = NULL;
     }
-    
-    LuaLineEvent *event = (LuaLineEvent *)lua_newuserdata(L, sizeof(LuaLineEvent));
-    
-    int ret = gpiod_line_event_read(line->line, &event->event);
-    if (ret < 0) {
-        return luaL_error(L, "Failed to read event");
+    if (rec->fd >= 0) {
+        close(rec->fd);
+        rec->fd = -1;
+    }
+    return 0;
+}
+
+// ============================================================================
+// Background Sampler related functions
+// ============================================================================
+
+// Helper function: push a sample into the ring (sampler thread only)
+static void sampler_push(LuaSampler *smp, int64_t timestamp_ns, uint64_t mask) {
+    unsigned int head = atomic_load_explicit(&smp->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&smp->tail, memory_order_acquire);
+    
+    atomic_fetch_add_explicit(&smp->samples, 1, memory_order_relaxed);
+    if (head - tail == smp->mask + 1) {
+        atomic_fetch_add_explicit(&smp->overflows, 1, memory_order_relaxed);
+        return;
     }
     
-    luaL_getmetatable(L, GPIOD_LINE_EVENT_MT);
-    lua_setmetatable(L, -2);
+    smp->ring[head & smp->mask].timestamp_ns = timestamp_ns;
+    smp->ring[head & smp->mask].mask = mask;
+    atomic_store_explicit(&smp->head, head + 1, memory_order_release);
+}
+
+// Sampler thread: read the bulk on an absolute-deadline period grid
+static void *sampler_thread(void *arg) {
+    LuaSampler *smp = (LuaSampler *)arg;
+    unsigned int num_lines = gpiod_line_bulk_num_lines(&smp->bulk);
+    int values[GPIOD_LINE_BULK_MAX_LINES];
+    
+    int64_t deadline = monotonic_ns();
+    for (;;) {
+        int64_t now = monotonic_ns();
+        if (gpiod_line_get_value_bulk(&smp->bulk, values) < 0) {
+            atomic_store(&smp->error, errno);
+            return NULL;
+        }
+        sampler_push(smp, now, values_to_mask(values, num_lines));
+        
+        if (now - deadline > atomic_load_explicit(&smp->max_late_ns, memory_order_relaxed)) {
+            atomic_store_explicit(&smp->max_late_ns, now - deadline, memory_order_relaxed);
+        }
+        deadline += smp->period_ns;
+        
+        // Skip whole periods that were missed instead of bursting
+        now = monotonic_ns();
+        if (now - deadline >= smp->period_ns) {
+            int64_t skipped = (now - deadline) / smp->period_ns;
+            deadline += skipped * smp->period_ns;
+            atomic_fetch_add_explicit(&smp->missed, skipped, memory_order_relaxed);
+        }
+        
+        if (stoppable_sleep_until(&smp->lock, &smp->wakeup, &smp->stop, deadline)) {
+            return NULL;
+        }
+    }
+}
+
+// Helper function: stop and join the sampler thread
+static void sampler_stop(LuaSampler *smp) {
+    if (smp->started) {
+        pthread_mutex_lock(&smp->lock);
+        smp->stop = 1;
+        pthread_cond_signal(&smp->wakeup);
+        pthread_mutex_unlock(&smp->lock);
+        pthread_join(smp->thread, NULL);
+        smp->started = 0;
+    }
+}
+
+// Helper function: number of samples waiting in the ring (Lua side)
+static unsigned int sampler_pending(LuaSampler *smp) {
+    unsigned int head = atomic_load_explicit(&smp->head, memory_order_acquire);
+    unsigned int tail = atomic_load_explicit(&smp->tail, memory_order_relaxed);
     
-    return 1;
+    return head - tail;
 }
 
-// line:event_get_fd()
-static int line_event_get_fd(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+// bulk:sampler(rate_hz, [capacity], [rt_priority])
+// Starts a background thread sampling the bulk at a fixed rate
+static int bulk_sampler(lua_State *L) {
+    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    int64_t period_ns = check_frequency(L, 2);
+    lua_Integer requested = luaL_optinteger(L, 3, GPIOD_LUA_SAMPLER_DEFAULT_SAMPLES);
+    int rt_priority = luaL_optinteger(L, 4, 0);
     
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
+    luaL_argcheck(L, requested > 0 && requested <= GPIOD_LUA_SAMPLER_MAX_SAMPLES, 3,
+                  "capacity out of range");
+    
+    lua_getiuservalue(L, 1, 1);
+    if (!((LuaChip *)lua_touserdata(L, -1))->chip) {
+        return luaL_error(L, "Chip is closed");
     }
+    lua_pop(L, 1);
     
-    int fd = gpiod_line_event_get_fd(line->line);
-    if (fd < 0) {
-        return luaL_error(L, "Failed to get event file descriptor");
+    unsigned int capacity = 1;
+    while (capacity < requested) {
+        capacity <<= 1;
     }
     
-    lua_pushinteger(L, fd);
-    return 1;
-}
-
-// line:active_state()
-static int line_active_state(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+    LuaSampler *smp = (LuaSampler *)lua_newuserdata(L, sizeof(LuaSampler) + capacity * sizeof(SampleRecord));
+    smp->started = 0;
+    smp->stop = 0;
+    smp->bulk = bulk->bulk;
+    smp->period_ns = period_ns;
+    smp->mask = capacity - 1;
+    atomic_init(&smp->head, 0);
+    atomic_init(&smp->tail, 0);
+    atomic_init(&smp->samples, 0);
+    atomic_init(&smp->overflows, 0);
+    atomic_init(&smp->missed, 0);
+    atomic_init(&smp->max_late_ns, 0);
+    atomic_init(&smp->error, 0);
+    stop_cond_init(&smp->lock, &smp->wakeup);
+    
+    luaL_getmetatable(L, GPIOD_SAMPLER_MT);
+    lua_setmetatable(L, -2);
     
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
+    // Keep the bulk alive while the thread reads its lines, and let
+    // bulk:release() and chip:close() stop the thread
+    lua_pushvalue(L, 1);
+    lua_setuservalue(L, -2);
+    lua_getiuservalue(L, 1, 1);
+    track_thread(L, -1, -2, 1);
+    lua_pop(L, 1);
+    
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (rt_priority > 0) {
+        struct sched_param param;
+        param.sched_priority = rt_priority;
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
     }
     
-    int state = gpiod_line_active_state(line->line);
-    switch (state) {
-        case GPIOD_LINE_ACTIVE_STATE_HIGH:
-            lua_pushstring(L, "high");
-            break;
-        case GPIOD_LINE_ACTIVE_STATE_LOW:
-            lua_pushstring(L, "low");
-            break;
-        default:
-            lua_pushstring(L, "unknown");
-            break;
+    int ret = pthread_create(&smp->thread, &attr, sampler_thread, smp);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        return luaL_error(L, "Failed to start sampler thread: %s", strerror(ret));
     }
+    smp->started = 1;
+    
     return 1;
 }
 
-// line:bias()
-static int line_bias(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
+// smp:read([max_samples])
+// Moves samples out of the ring without blocking. Returns two strings of
+// packed native integers (string.unpack format "j"): the value bitmasks
+// and the CLOCK_MONOTONIC timestamps (ns) of the samples
+static int sampler_read(lua_State *L) {
+    LuaSampler *smp = (LuaSampler *)luaL_checkudata(L, 1, GPIOD_SAMPLER_MT);
+    lua_Integer max_samples = luaL_optinteger(L, 2, smp->mask + 1);
+    
+    luaL_argcheck(L, max_samples > 0, 2, "max_samples out of range");
+    
+    unsigned int tail = atomic_load_explicit(&smp->tail, memory_order_relaxed);
+    unsigned int count = sampler_pending(smp);
+    if (count > max_samples) {
+        count = max_samples;
+    }
     
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
+    luaL_Buffer masks;
+    lua_Integer *out = (lua_Integer *)luaL_buffinitsize(L, &masks, count * sizeof(lua_Integer));
+    for (unsigned int i = 0; i < count; i++) {
+        out[i] = (lua_Integer)smp->ring[(tail + i) & smp->mask].mask;
     }
+    luaL_pushresultsize(&masks, count * sizeof(lua_Integer));
     
-    int bias = gpiod_line_bias(line->line);
-    switch (bias) {
-        case GPIOD_LINE_BIAS_AS_IS:
-            lua_pushstring(L, "as_is");
-            break;
-        case GPIOD_LINE_BIAS_DISABLE:
-            lua_pushstring(L, "disable");
-            break;
-        case GPIOD_LINE_BIAS_PULL_UP:
-            lua_pushstring(L, "pull_up");
-            break;
-        case GPIOD_LINE_BIAS_PULL_DOWN:
-            lua_pushstring(L, "pull_down");
-            break;
-        default:
-            lua_pushstring(L, "unknown");
-            break;
+    luaL_Buffer times;
+    out = (lua_Integer *)luaL_buffinitsize(L, &times, count * sizeof(lua_Integer));
+    for (unsigned int i = 0; i < count; i++) {
+        out[i] = smp->ring[(tail + i) & smp->mask].timestamp_ns;
     }
-    return 1;
+    luaL_pushresultsize(&times, count * sizeof(lua_Integer));
+    
+    atomic_store_explicit(&smp->tail, tail + count, memory_order_release);
+    
+    return 2;
 }
 
-// line:is_open_drain()
-static int line_is_open_drain(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
-    
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
-    }
+// smp:pending()
+static int sampler_pending_count(lua_State *L) {
+    LuaSampler *smp = (LuaSampler *)luaL_checkudata(L, 1, GPIOD_SAMPLER_MT);
     
-    lua_pushboolean(L, gpiod_line_is_open_drain(line->line));
+    lua_pushinteger(L, sampler_pending(smp));
     return 1;
 }
 
-// line:is_open_source()
-static int line_is_open_source(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
-    
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
+// smp:stats()
+static int sampler_stats(lua_State *L) {
+    LuaSampler *smp = (LuaSampler *)luaL_checkudata(L, 1, GPIOD_SAMPLER_MT);
+    
+    lua_createtable(L, 0, 8);
+    lua_pushinteger(L, smp->period_ns);
+    lua_setfield(L, -2, "period_ns");
+    lua_pushinteger(L, smp->mask + 1);
+    lua_setfield(L, -2, "capacity");
+    lua_pushinteger(L, sampler_pending(smp));
+    lua_setfield(L, -2, "pending");
+    lua_pushinteger(L, (lua_Integer)atomic_load(&smp->samples));
+    lua_setfield(L, -2, "samples");
+    lua_pushinteger(L, (lua_Integer)atomic_load(&smp->overflows));
+    lua_setfield(L, -2, "overflows");
+    lua_pushinteger(L, (lua_Integer)atomic_load(&smp->missed));
+    lua_setfield(L, -2, "missed");
+    lua_pushinteger(L, atomic_load(&smp->max_late_ns));
+    lua_setfield(L, -2, "max_late_ns");
+    int error = atomic_load(&smp->error);
+    lua_pushboolean(L, smp->started && !error);
+    lua_setfield(L, -2, "running");
+    
+    if (error) {
+        lua_pushstring(L, strerror(error));
+        lua_setfield(L, -2, "error");
     }
     
-    lua_pushboolean(L, gpiod_line_is_open_source(line->line));
     return 1;
 }
 
-// line:update()
-static int line_update(lua_State *L) {
-    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
-    
-    if (!line->line) {
-        return luaL_error(L, "Line is released");
-    }
+// smp:stop()
+// Stops the sampler thread; buffered samples can still be read
+static int sampler_close(lua_State *L) {
+    LuaSampler *smp = (LuaSampler *)luaL_checkudata(L, 1, GPIOD_SAMPLER_MT);
     
-    int ret = gpiod_line_update(line->line);
-    if (ret < 0) {
-        return luaL_error(L, "Failed to update line status");
-    }
+    sampler_stop(smp);
+    return 0;
+}
+
+// Sampler __gc: stop the thread and free its synchronization objects
+static int sampler_gc(lua_State *L) {
+    LuaSampler *smp = (LuaSampler *)luaL_checkudata(L, 1, GPIOD_SAMPLER_MT);
     
-    lua_pushboolean(L, 1);
-    return 1;
+    sampler_stop(smp);
+    pthread_cond_destroy(&smp->wakeup);
+    pthread_mutex_destroy(&smp->lock);
+    return 0;
 }
 
 // ============================================================================
-// Line Bulk related functions
+// Edge Counter related functions
 // ============================================================================
 
-// bulk:num_lines()
-static int bulk_num_lines(lua_State *L) {
-    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
-    
-    lua_pushinteger(L, gpiod_line_bulk_num_lines(&bulk->bulk));
-    return 1;
+// Helper function: clear all counts and statistics (lock held)
+static void counter_clear(LuaCounter *cnt) {
+    cnt->rising = 0;
+    cnt->falling = 0;
+    cnt->last_ns[0] = -1;
+    cnt->last_ns[1] = -1;
+    cnt->intervals = 0;
+    cnt->interval_total_ns = 0;
+    cnt->interval_min_ns = 0;
+    cnt->interval_max_ns = 0;
+    cnt->window_intervals = 0;
+    cnt->window_total_ns = 0;
 }
 
-// bulk:get_line(index)
-static int bulk_get_line(lua_State *L) {
-    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
-    unsigned int index = luaL_checkinteger(L, 2);
-    
-    if (index >= gpiod_line_bulk_num_lines(&bulk->bulk)) {
-        return luaL_error(L, "Index out of range");
+// Helper function: account one edge (lock held)
+// Intervals are measured between edges of the same type, so they are full
+// signal periods whichever edges the line was requested for
+static void counter_add(LuaCounter *cnt, const struct gpiod_line_event *ev) {
+    int type = ev->event_type == GPIOD_LINE_EVENT_RISING_EDGE ? 0 : 1;
+    int64_t ts_ns = timespec_to_ns(&ev->ts);
+    
+    if (type == 0) {
+        cnt->rising++;
+    } else {
+        cnt->falling++;
     }
     
-    LuaLine *line = (LuaLine *)lua_newuserdata(L, sizeof(LuaLine));
-    line->line = gpiod_line_bulk_get_line(&bulk->bulk, index);
-    line->chip = bulk->chip;
-    
-    luaL_getmetatable(L, GPIOD_LINE_MT);
-    lua_setmetatable(L, -2);
+    if (cnt->last_ns[type] >= 0) {
+        int64_t interval_ns = ts_ns - cnt->last_ns[type];
+        
+        if (cnt->intervals == 0 || interval_ns < cnt->interval_min_ns) {
+            cnt->interval_min_ns = interval_ns;
+        }
+        if (interval_ns > cnt->interval_max_ns) {
+            cnt->interval_max_ns = interval_ns;
+        }
+        cnt->intervals++;
+        cnt->interval_total_ns += interval_ns;
+        cnt->window_intervals++;
+        cnt->window_total_ns += interval_ns;
+    }
+    cnt->last_ns[type] = ts_ns;
+}
+
+// Counter thread: block on the line's event fd and count edges
+static void *counter_thread(void *arg) {
+    LuaCounter *cnt = (LuaCounter *)arg;
+    struct pollfd pfds[2] = {
+        { .fd = cnt->fd, .events = POLLIN | POLLPRI },
+        { .fd = cnt->stop_fd, .events = POLLIN },
+    };
+    struct gpiod_line_event events[GPIOD_LUA_MAX_EVENTS];
+    
+    for (;;) {
+        int ret = poll(pfds, 2, debounce_timeout_ms(&cnt->debounce));
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            atomic_store(&cnt->error, errno);
+            break;
+        }
+        
+        if (pfds[1].revents) {
+            break;
+        }
+        
+        if (!pfds[0].revents && !cnt->debounce.in_burst) {
+            continue;
+        }
+        
+        // The chip was removed underneath the counter
+        if (pfds[0].revents & (POLLERR | POLLNVAL)) {
+            atomic_store(&cnt->error, EBADF);
+            break;
+        }
+        
+        int num_events = read_line_events(cnt->fd, &cnt->debounce, events, GPIOD_LUA_MAX_EVENTS, 0);
+        if (num_events < 0) {
+            atomic_store(&cnt->error, errno);
+            break;
+        }
+        
+        pthread_mutex_lock(&cnt->lock);
+        for (int i = 0; i < num_events; i++) {
+            counter_add(cnt, &events[i]);
+        }
+        pthread_mutex_unlock(&cnt->lock);
+    }
     
-    return 1;
+    return NULL;
 }
 
-// bulk:request_input(consumer, [flags])
-static int bulk_request_input(lua_State *L) {
-    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
-    const char *consumer = luaL_checkstring(L, 2);
-    int flags = luaL_optinteger(L, 3, 0);
+// Helper function: check a counter argument and raise its thread's error
+static LuaCounter *check_counter(lua_State *L, int idx) {
+    LuaCounter *cnt = (LuaCounter *)luaL_checkudata(L, idx, GPIOD_COUNTER_MT);
+    int error = atomic_load(&cnt->error);
     
-    int ret = gpiod_line_request_bulk_input_flags(&bulk->bulk, consumer, flags);
-    if (ret < 0) {
-        return luaL_error(L, "Failed to request bulk input mode");
+    if (error) {
+        luaL_error(L, "Counter failed: %s", strerror(error));
     }
-    
-    lua_pushboolean(L, 1);
-    return 1;
+    return cnt;
 }
 
-// bulk:request_output(consumer, default_vals, [flags])
-static int bulk_request_output(lua_State *L) {
-    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
-    const char *consumer = luaL_checkstring(L, 2);
-    luaL_checktype(L, 3, LUA_TTABLE);
-    int flags = luaL_optinteger(L, 4, 0);
+// gpiod.counter(line)
+// Starts a background thread counting the edges of an event-requested line
+static int gpiod_counter(lua_State *L) {
+    LuaLine *line = (LuaLine *)luaL_checkudata(L, 1, GPIOD_LINE_MT);
     
-    unsigned int num_lines = gpiod_line_bulk_num_lines(&bulk->bulk);
-    int *values = malloc(num_lines * sizeof(int));
+    if (!line->line) {
+        return luaL_error(L, "Line is released");
+    }
     
-    for (unsigned int i = 0; i < num_lines; i++) {
-        lua_rawgeti(L, 3, i + 1);
-        values[i] = luaL_checkinteger(L, -1);
-        lua_pop(L, 1);
+    int fd = gpiod_line_event_get_fd(line->line);
+    if (fd < 0) {
+        return luaL_error(L, "Line %d is not requested for events", gpiod_line_offset(line->line));
     }
     
-    int ret = gpiod_line_request_bulk_output_flags(&bulk->bulk, consumer, flags, values);
-    free(values);
+    LuaCounter *cnt = (LuaCounter *)lua_newuserdata(L, sizeof(LuaCounter));
+    cnt->started = 0;
+    cnt->stop_fd = -1;
+    cnt->fd = -1;
+    atomic_init(&cnt->error, 0);
+    pthread_mutex_init(&cnt->lock, NULL);
     
-    if (ret < 0) {
-        return luaL_error(L, "Failed to request bulk output mode");
-    }
+    luaL_getmetatable(L, GPIOD_COUNTER_MT);
+    lua_setmetatable(L, -2);
     
-    lua_pushboolean(L, 1);
-    return 1;
-}
-
-// bulk:get_values()
-static int bulk_get_values(lua_State *L) {
-    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+    // The thread filters with its own copy of the line's settings
+    debounce_init(&cnt->debounce, line->debounce.window_ns);
+    counter_clear(cnt);
     
-    unsigned int num_lines = gpiod_line_bulk_num_lines(&bulk->bulk);
-    int *values = malloc(num_lines * sizeof(int));
+    // The thread polls its own duplicate: releasing the line closes the
+    // line's fd, whose number may then be reused by an unrelated file
+    cnt->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (cnt->fd < 0) {
+        return luaL_error(L, "Failed to create counter: %s", strerror(errno));
+    }
     
-    int ret = gpiod_line_get_value_bulk(&bulk->bulk, values);
-    if (ret < 0) {
-        free(values);
-        return luaL_error(L, "Failed to read bulk GPIO values");
+    // Keep the line alive while the counter runs
+    lua_pushvalue(L, 1);
+    lua_setuservalue(L, -2);
+    
+    cnt->stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (cnt->stop_fd < 0) {
+        return luaL_error(L, "Failed to create counter: %s", strerror(errno));
     }
     
-    lua_newtable(L);
-    for (unsigned int i = 0; i < num_lines; i++) {
-        lua_pushinteger(L, values[i]);
-        lua_rawseti(L, -2, i + 1);
+    int ret = pthread_create(&cnt->thread, NULL, counter_thread, cnt);
+    if (ret != 0) {
+        return luaL_error(L, "Failed to start counter thread: %s", strerror(ret));
     }
+    cnt->started = 1;
     
-    free(values);
     return 1;
 }
 
-// bulk:set_values(values_table)
-static int bulk_set_values(lua_State *L) {
-    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
-    luaL_checktype(L, 2, LUA_TTABLE);
-    
-    unsigned int num_lines = gpiod_line_bulk_num_lines(&bulk->bulk);
-    int *values = malloc(num_lines * sizeof(int));
-    
-    for (unsigned int i = 0; i < num_lines; i++) {
-        lua_rawgeti(L, 2, i + 1);
-        values[i] = luaL_checkinteger(L, -1);
-        lua_pop(L, 1);
-    }
+// cnt:count()
+// Returns total, rising and falling edge counts
+static int counter_count(lua_State *L) {
+    LuaCounter *cnt = check_counter(L, 1);
+    
+    pthread_mutex_lock(&cnt->lock);
+    uint64_t rising = cnt->rising;
+    uint64_t falling = cnt->falling;
+    pthread_mutex_unlock(&cnt->lock);
+    
+    lua_pushinteger(L, (lua_Integer)(rising + falling));
+    lua_pushinteger(L, (lua_Integer)rising);
+    lua_pushinteger(L, (lua_Integer)falling);
+    return 3;
+}
+
+// cnt:reset()
+static int counter_reset(lua_State *L) {
+    LuaCounter *cnt = check_counter(L, 1);
     
-    int ret = gpiod_line_set_value_bulk(&bulk->bulk, values);
-    free(values);
+    pthread_mutex_lock(&cnt->lock);
+    counter_clear(cnt);
+    pthread_mutex_unlock(&cnt->lock);
     
-    if (ret < 0) {
-        return luaL_error(L, "Failed to set bulk GPIO values");
-    }
+    return 0;
+}
+
+// cnt:frequency()
+// Returns the signal frequency in Hz over the periods completed since the
+// previous call, and the number of those periods
+static int counter_frequency(lua_State *L) {
+    LuaCounter *cnt = check_counter(L, 1);
+    
+    pthread_mutex_lock(&cnt->lock);
+    uint64_t intervals = cnt->window_intervals;
+    int64_t total_ns = cnt->window_total_ns;
+    cnt->window_intervals = 0;
+    cnt->window_total_ns = 0;
+    pthread_mutex_unlock(&cnt->lock);
+    
+    lua_pushnumber(L, total_ns > 0 ? (lua_Number)intervals * 1e9 / (lua_Number)total_ns : 0.0);
+    lua_pushinteger(L, (lua_Integer)intervals);
+    return 2;
+}
+
+// cnt:period_stats()
+// Returns a table with count, min_ns, max_ns and mean_ns of the periods
+// measured since the counter was started or reset
+static int counter_period_stats(lua_State *L) {
+    LuaCounter *cnt = check_counter(L, 1);
+    
+    pthread_mutex_lock(&cnt->lock);
+    uint64_t intervals = cnt->intervals;
+    int64_t total_ns = cnt->interval_total_ns;
+    int64_t min_ns = cnt->interval_min_ns;
+    int64_t max_ns = cnt->interval_max_ns;
+    pthread_mutex_unlock(&cnt->lock);
+    
+    lua_createtable(L, 0, 4);
+    lua_pushinteger(L, (lua_Integer)intervals);
+    lua_setfield(L, -2, "count");
+    lua_pushinteger(L, min_ns);
+    lua_setfield(L, -2, "min_ns");
+    lua_pushinteger(L, max_ns);
+    lua_setfield(L, -2, "max_ns");
+    lua_pushinteger(L, intervals ? total_ns / (int64_t)intervals : 0);
+    lua_setfield(L, -2, "mean_ns");
     
-    lua_pushboolean(L, 1);
     return 1;
 }
 
-// bulk:release()
-static int bulk_release(lua_State *L) {
-    LuaLineBulk *bulk = (LuaLineBulk *)luaL_checkudata(L, 1, GPIOD_LINE_BULK_MT);
+// Helper function: stop and join the counter thread
+static void counter_stop(LuaCounter *cnt) {
+    fd_thread_stop(cnt->thread, &cnt->started, &cnt->stop_fd, &cnt->fd, 1);
+}
+
+// cnt:stop()
+// Stops the counter thread; the counts and statistics remain readable
+static int counter_close(lua_State *L) {
+    LuaCounter *cnt = (LuaCounter *)luaL_checkudata(L, 1, GPIOD_COUNTER_MT);
+    
+    counter_stop(cnt);
+    return 0;
+}
+
+// Counter __gc
+static int counter_gc(lua_State *L) {
+    LuaCounter *cnt = (LuaCounter *)luaL_checkudata(L, 1, GPIOD_COUNTER_MT);
     
-    gpiod_line_release_bulk(&bulk->bulk);
+    counter_stop(cnt);
+    pthread_mutex_destroy(&cnt->lock);
     return 0;
 }
 
 // ============================================================================
-// Line Event related functions
+// Quadrature Encoder related functions
 // ============================================================================
 
-// event:event_type()
-static int event_event_type(lua_State *L) {
-    LuaLineEvent *event = (LuaLineEvent *)luaL_checkudata(L, 1, GPIOD_LINE_EVENT_MT);
-    
-    int type = event->event.event_type;
-    switch (type) {
-        case GPIOD_LINE_EVENT_RISING_EDGE:
-            lua_pushstring(L, "rising_edge");
-            break;
-        case GPIOD_LINE_EVENT_FALLING_EDGE:
-            lua_pushstring(L, "falling_edge");
+// Position change for a transition from state (A << 1) | B to the next one;
+// 0 marks transitions that skip one state, i.e. a missed edge
+static const int8_t encoder_steps[16] = {
+     0, -1, +1,  0,
+    +1,  0,  0, -1,
+    -1,  0,  0, +1,
+     0, +1, -1,  0,
+};
+
+// Helper function: apply one phase edge (index 0 = A, 1 = B) to the state
+static void encoder_apply(LuaEncoder *enc, const CaptureRecord *edge, int64_t *position, uint64_t *errors) {
+    int bit = edge->offset == 0 ? 2 : 1;
+    int next = edge->event_type == GPIOD_LINE_EVENT_RISING_EDGE ? (enc->state | bit) : (enc->state & ~bit);
+    int step = encoder_steps[enc->state << 2 | next];
+    
+    // An edge that does not change the phase level means the opposite
+    // edge of that phase was missed
+    if (step == 0) {
+        (*errors)++;
+    }
+    *position += step;
+    enc->state = next;
+}
+
+// Maximum number of edges an encoder holds back between read passes
+#define GPIOD_LUA_ENCODER_MAX_HELD (2 * GPIOD_LUA_MAX_EVENTS)
+
+// Edges held back this far ahead of their clock cannot be in flight, they
+// mean the timestamps use another clock
+#define GPIOD_LUA_ENCODER_MAX_AHEAD_NS 1000000000
+
+// Encoder thread: merge the edges of both phases and decode them
+// Edges newer than the start of a read pass are held back to the next pass
+// so they cannot overtake an edge of the other phase still in its fd. The
+// readiness of both fds is refreshed once the cutoff is taken, so every
+// edge stamped before it is read in the same pass
+static void *encoder_thread(void *arg) {
+    LuaEncoder *enc = (LuaEncoder *)arg;
+    struct pollfd pfds[3] = {
+        { .fd = enc->fds[0], .events = POLLIN | POLLPRI },
+        { .fd = enc->fds[1], .events = POLLIN | POLLPRI },
+        { .fd = enc->stop_fd, .events = POLLIN },
+    };
+    struct gpiod_line_event events[GPIOD_LUA_MAX_EVENTS];
+    CaptureRecord edges[4 * GPIOD_LUA_MAX_EVENTS];
+    unsigned int held = 0;
+    int timeout_ms = -1;
+    
+    for (;;) {
+        int ret = poll(pfds, 3, timeout_ms);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            atomic_store(&enc->error, errno);
             break;
-        default:
-            lua_pushstring(L, "unknown");
+        }
+        
+        if (pfds[2].revents) {
             break;
+        }
+        
+        int64_t mono_ns = monotonic_ns();
+        int64_t real_ns = clock_now_ns(CLOCK_REALTIME);
+        unsigned int count = held;
+        
+        // The thread may have been delayed since poll() returned
+        while (poll(pfds, 2, 0) < 0) {
+            if (errno != EINTR) {
+                atomic_store(&enc->error, errno);
+                return NULL;
+            }
+        }
+        
+        // Newest edge of an fd read in full, whose later edges may still
+        // be due in this pass, -1 = none
+        int64_t partial_ns[2] = { -1, -1 };
+        for (int i = 0; i < 2; i++) {
+            if (!pfds[i].revents) {
+                continue;
+            }
+            
+            // The chip was removed underneath the encoder
+            if (pfds[i].revents & (POLLERR | POLLNVAL)) {
+                atomic_store(&enc->error, EBADF);
+                return NULL;
+            }
+            
+            int num_events = gpiod_line_event_read_fd_multiple(enc->fds[i], events, GPIOD_LUA_MAX_EVENTS);
+            if (num_events < 0) {
+                atomic_store(&enc->error, errno);
+                return NULL;
+            }
+            
+            for (int j = 0; j < num_events; j++) {
+                edges[count].timestamp_ns = timespec_to_ns(&events[j].ts);
+                edges[count].offset = i;
+                edges[count].event_type = events[j].event_type;
+                count++;
+            }
+            if (num_events == GPIOD_LUA_MAX_EVENTS) {
+                partial_ns[i] = edges[count - 1].timestamp_ns;
+            }
+        }
+        
+        if (count > 0 && enc->event_clock < 0) {
+            enc->event_clock = event_timestamp_clock(edges[held].timestamp_ns);
+        }
+        int64_t cutoff_ns = enc->event_clock == CLOCK_REALTIME ? real_ns : mono_ns;
+        
+        // Edges left in a full fd are not older than the last one read
+        for (int i = 0; i < 2; i++) {
+            if (partial_ns[i] >= 0 && partial_ns[i] < cutoff_ns) {
+                cutoff_ns = partial_ns[i];
+            }
+        }
+        
+        qsort(edges, count, sizeof(CaptureRecord), capture_record_compare);
+        
+        // Deliver the oldest edges beyond the hold limit even if they are
+        // not due yet, so the next pass always has room for both fds
+        unsigned int due = count > GPIOD_LUA_ENCODER_MAX_HELD ? count - GPIOD_LUA_ENCODER_MAX_HELD : 0;
+        int64_t position = 0;
+        uint64_t errors = 0;
+        unsigned int done = 0;
+        while (done < count && (done < due || edges[done].timestamp_ns <= cutoff_ns ||
+                                edges[done].timestamp_ns - cutoff_ns > GPIOD_LUA_ENCODER_MAX_AHEAD_NS)) {
+            encoder_apply(enc, &edges[done], &position, &errors);
+            done++;
+        }
+        
+        held = count - done;
+        memmove(edges, edges + done, held * sizeof(CaptureRecord));
+        
+        // Wake up once the newest held edge is due instead of polling
+        timeout_ms = -1;
+        if (held) {
+            timeout_ms = (int)((edges[held - 1].timestamp_ns - cutoff_ns) / 1000000) + 1;
+        }
+        
+        atomic_fetch_add_explicit(&enc->position, position, memory_order_relaxed);
+        atomic_fetch_add_explicit(&enc->edges, done, memory_order_relaxed);
+        if (errors) {
+            atomic_fetch_add_explicit(&enc->errors, errors, memory_order_relaxed);
+        }
     }
-    return 1;
+    
+    return NULL;
 }
 
-// event:timestamp()
-static int event_timestamp(lua_State *L) {
-    LuaLineEvent *event = (LuaLineEvent *)luaL_checkudata(L, 1, GPIOD_LINE_EVENT_MT);
+// Helper function: stop the encoder thread and release its lines
+static void encoder_stop(LuaEncoder *enc) {
+    fd_thread_stop(enc->thread, &enc->started, &enc->stop_fd, enc->fds, 2);
     
-    struct timespec ts = event->event.ts;
-    lua_pushnumber(L, ts.tv_sec + ts.tv_nsec / 1000000000.0);
-    return 1;
+    if (gpiod_line_bulk_num_lines(&enc->bulk) > 0) {
+        gpiod_line_release_bulk(&enc->bulk);
+        gpiod_line_bulk_init(&enc->bulk);
+    }
 }
 
-// ============================================================================
-// Chip Iterator related functions
-// ============================================================================
+// Helper function: check an encoder argument and raise its thread's error
+static LuaEncoder *check_encoder(lua_State *L, int idx) {
+    LuaEncoder *enc = (LuaEncoder *)luaL_checkudata(L, idx, GPIOD_ENCODER_MT);
+    int error = atomic_load(&enc->error);
+    
+    if (error) {
+        luaL_error(L, "Encoder failed: %s", strerror(error));
+    }
+    return enc;
+}
 
-// gpiod.chip_iter()
-static int gpiod_chip_iter(lua_State *L) {
-    LuaChipIter *iter = (LuaChipIter *)lua_newuserdata(L, sizeof(LuaChipIter));
-    iter->iter = gpiod_chip_iter_new();
+// gpiod.encoder(chip, a_offset, b_offset, [consumer], [flags])
+// Requests both-edges events on the A and B phase lines and starts a
+// background thread decoding them
+static int gpiod_encoder(lua_State *L) {
+    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+    unsigned int offsets[2] = { luaL_checkinteger(L, 2), luaL_checkinteger(L, 3) };
+    const char *consumer = luaL_optstring(L, 4, "gpiod-lua-encoder");
+    int flags = luaL_optinteger(L, 5, 0);
     
-    if (!iter->iter) {
-        lua_pushnil(L);
-        return 1;
+    if (!chip->chip) {
+        return luaL_error(L, "Chip is closed");
     }
     
-    luaL_getmetatable(L, GPIOD_CHIP_ITER_MT);
+    LuaEncoder *enc = (LuaEncoder *)lua_newuserdata(L, sizeof(LuaEncoder));
+    enc->started = 0;
+    enc->stop_fd = -1;
+    enc->fds[0] = -1;
+    enc->fds[1] = -1;
+    enc->event_clock = -1;
+    gpiod_line_bulk_init(&enc->bulk);
+    atomic_init(&enc->position, 0);
+    atomic_init(&enc->edges, 0);
+    atomic_init(&enc->errors, 0);
+    atomic_init(&enc->error, 0);
+    
+    luaL_getmetatable(L, GPIOD_ENCODER_MT);
     lua_setmetatable(L, -2);
     
-    return 1;
-}
-
-// iter:next()
-static int chip_iter_next(lua_State *L) {
-    LuaChipIter *iter = (LuaChipIter *)luaL_checkudata(L, 1, GPIOD_CHIP_ITER_MT);
+    struct gpiod_line_bulk lines;
+    gpiod_line_bulk_init(&lines);
+    for (int i = 0; i < 2; i++) {
+        struct gpiod_line *line = gpiod_chip_get_line(chip->chip, offsets[i]);
+        if (!line) {
+            return luaL_error(L, "Failed to get GPIO line: %d", offsets[i]);
+        }
+        gpiod_line_bulk_add(&lines, line);
+    }
     
-    if (!iter->iter) {
-        lua_pushnil(L);
-        return 1;
+    struct gpiod_line_request_config config = {
+        .consumer = consumer,
+        .request_type = GPIOD_LINE_REQUEST_EVENT_BOTH_EDGES,
+        .flags = flags,
+    };
+    
+    if (gpiod_line_request_bulk(&lines, &config, NULL) < 0) {
+        return luaL_error(L, "Failed to request encoder lines");
     }
+    enc->bulk = lines;
     
-    struct gpiod_chip *chip = gpiod_chip_iter_next_noclose(iter->iter);
-    if (!chip) {
-        lua_pushnil(L);
-        return 1;
+    // Keep the chip alive while the lines are requested, and let
+    // chip:close() stop the thread and release them first
+    lua_pushvalue(L, 1);
+    lua_setuservalue(L, -2);
+    track_thread(L, 1, -1, 1);
+    
+    int values[2];
+    if (gpiod_line_get_value_bulk(&enc->bulk, values) < 0) {
+        return luaL_error(L, "Failed to read encoder lines");
+    }
+    enc->state = values[0] << 1 | values[1];
+    
+    // The thread polls its own duplicates: releasing a line closes the
+    // line's fd, whose number may then be reused by an unrelated file
+    for (int i = 0; i < 2; i++) {
+        int fd = gpiod_line_event_get_fd(gpiod_line_bulk_get_line(&enc->bulk, i));
+        enc->fds[i] = fd < 0 ? -1 : fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (enc->fds[i] < 0) {
+            return luaL_error(L, "Failed to create encoder: %s", strerror(errno));
+        }
     }
+    enc->sample_position = 0;
+    enc->sample_ns = monotonic_ns();
     
-    LuaChip *lua_chip = (LuaChip *)lua_newuserdata(L, sizeof(LuaChip));
-    lua_chip->chip = chip;
+    enc->stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (enc->stop_fd < 0) {
+        return luaL_error(L, "Failed to create encoder: %s", strerror(errno));
+    }
     
-    luaL_getmetatable(L, GPIOD_CHIP_MT);
-    lua_setmetatable(L, -2);
+    int ret = pthread_create(&enc->thread, NULL, encoder_thread, enc);
+    if (ret != 0) {
+        return luaL_error(L, "Failed to start encoder thread: %s", strerror(ret));
+    }
+    enc->started = 1;
     
     return 1;
 }
 
-// iter:next_noclose()
-static int chip_iter_next_noclose(lua_State *L) {
-    LuaChipIter *iter = (LuaChipIter *)luaL_checkudata(L, 1, GPIOD_CHIP_ITER_MT);
+// enc:position()
+// Returns the position in quadrature counts (four per encoder cycle)
+static int encoder_position(lua_State *L) {
+    LuaEncoder *enc = check_encoder(L, 1);
     
-    if (!iter->iter) {
-        lua_pushnil(L);
-        return 1;
-    }
+    lua_pushinteger(L, atomic_load(&enc->position));
+    return 1;
+}
+
+// enc:set_position([position])
+static int encoder_set_position(lua_State *L) {
+    LuaEncoder *enc = check_encoder(L, 1);
+    lua_Integer position = luaL_optinteger(L, 2, 0);
     
-    struct gpiod_chip *chip = gpiod_chip_iter_next_noclose(iter->iter);
-    if (!chip) {
-        lua_pushnil(L);
-        return 1;
-    }
+    // Shift instead of store so steps decoded concurrently are not lost
+    int64_t delta = position - atomic_load(&enc->position);
+    atomic_fetch_add(&enc->position, delta);
+    enc->sample_position += delta;
+    
+    return 0;
+}
+
+// enc:velocity()
+// Returns the average speed in counts per second since the previous call
+static int encoder_velocity(lua_State *L) {
+    LuaEncoder *enc = check_encoder(L, 1);
     
-    LuaChip *lua_chip = (LuaChip *)lua_newuserdata(L, sizeof(LuaChip));
-    lua_chip->chip = chip;
+    int64_t now_ns = monotonic_ns();
+    int64_t position = atomic_load(&enc->position);
+    int64_t elapsed_ns = now_ns - enc->sample_ns;
     
-    luaL_getmetatable(L, GPIOD_CHIP_MT);
-    lua_setmetatable(L, -2);
+    lua_pushnumber(L, elapsed_ns > 0 ? (lua_Number)(position - enc->sample_position) * 1e9 / (lua_Number)elapsed_ns : 0.0);
+    enc->sample_position = position;
+    enc->sample_ns = now_ns;
     
     return 1;
 }
 
-// iter:close()
-static int chip_iter_close(lua_State *L) {
-    LuaChipIter *iter = (LuaChipIter *)luaL_checkudata(L, 1, GPIOD_CHIP_ITER_MT);
+// enc:errors()
+// Returns the number of illegal transitions (missed edges)
+static int encoder_errors(lua_State *L) {
+    LuaEncoder *enc = check_encoder(L, 1);
     
-    if (iter->iter) {
-        gpiod_chip_iter_free_noclose(iter->iter);
-        iter->iter = NULL;
+    lua_pushinteger(L, (lua_Integer)atomic_load(&enc->errors));
+    return 1;
+}
+
+// enc:stats()
+static int encoder_stats(lua_State *L) {
+    LuaEncoder *enc = (LuaEncoder *)luaL_checkudata(L, 1, GPIOD_ENCODER_MT);
+    
+    lua_createtable(L, 0, 5);
+    lua_pushinteger(L, atomic_load(&enc->position));
+    lua_setfield(L, -2, "position");
+    lua_pushinteger(L, (lua_Integer)atomic_load(&enc->edges));
+    lua_setfield(L, -2, "edges");
+    lua_pushinteger(L, (lua_Integer)atomic_load(&enc->errors));
+    lua_setfield(L, -2, "errors");
+    int error = atomic_load(&enc->error);
+    lua_pushboolean(L, enc->started && !error);
+    lua_setfield(L, -2, "running");
+    
+    if (error) {
+        lua_pushstring(L, strerror(error));
+        lua_setfield(L, -2, "error");
     }
     
+    return 1;
+}
+
+// enc:close()
+// Stops the encoder thread and releases both lines
+static int encoder_close(lua_State *L) {
+    LuaEncoder *enc = (LuaEncoder *)luaL_checkudata(L, 1, GPIOD_ENCODER_MT);
+    
+    encoder_stop(enc);
     return 0;
 }
 
@@ -935,6 +7753,108 @@ static int gpiod_sleep(lua_State *L) {
     return 0;
 }
 
+// gpiod.now_ns([clock])
+static int gpiod_now_ns(lua_State *L) {
+    int clock = check_event_clock(L, 1);
+    struct timespec ts;
+    
+    clock_gettime(clock, &ts);
+    lua_pushinteger(L, timespec_to_ns(&ts));
+    return 1;
+}
+
+// gpiod.latency_selftest(chip, output_offset, input_offset, [iterations], [timeout])
+// Loopback test for an output wired to an input: toggles the output and
+// waits for the input edge each time. Returns a table with histograms of
+// the toggle to kernel edge timestamp time (round_trip) and the kernel
+// timestamp to delivery time (delivery) of the first edge of each toggle.
+static int gpiod_latency_selftest(lua_State *L) {
+    LuaChip *chip = (LuaChip *)luaL_checkudata(L, 1, GPIOD_CHIP_MT);
+    unsigned int output_offset = luaL_checkinteger(L, 2);
+    unsigned int input_offset = luaL_checkinteger(L, 3);
+    lua_Integer iterations = luaL_optinteger(L, 4, 1000);
+    lua_Number timeout = luaL_optnumber(L, 5, 1.0);
+    
+    if (!chip->chip) {
+        return luaL_error(L, "Chip is closed");
+    }
+    luaL_argcheck(L, output_offset != input_offset, 3, "output and input must be different lines");
+    luaL_argcheck(L, iterations > 0, 4, "iterations must be positive");
+    
+    struct gpiod_line *output = gpiod_chip_get_line(chip->chip, output_offset);
+    struct gpiod_line *input = gpiod_chip_get_line(chip->chip, input_offset);
+    if (!output || !input) {
+        return luaL_error(L, "Failed to get GPIO line: %d", output ? input_offset : output_offset);
+    }
+    
+    if (gpiod_line_request_output_flags(output, "gpiod-lua-selftest", 0, 0) < 0) {
+        return luaL_error(L, "Failed to request line %d as output: %s", output_offset, strerror(errno));
+    }
+    if (gpiod_line_request_both_edges_events(input, "gpiod-lua-selftest") < 0) {
+        int err = errno;
+        gpiod_line_release(output);
+        return luaL_error(L, "Failed to request line %d for events: %s", input_offset, strerror(err));
+    }
+    
+    LatencyHistogram round_trip, delivery;
+    struct gpiod_line_event events[GPIOD_LUA_MAX_EVENTS];
+    struct pollfd pfd = { .fd = gpiod_line_event_get_fd(input), .events = POLLIN };
+    int timeout_ms = (int)(timeout * 1000 + 0.999);
+    lua_Integer timeouts = 0;
+    int err = 0;
+    
+    latency_reset(&round_trip);
+    latency_reset(&delivery);
+    
+    // No errors may be raised while the lines are requested
+    for (lua_Integer i = 0; i < iterations && !err; i++) {
+        int64_t toggled = monotonic_ns();
+        if (gpiod_line_set_value(output, (i & 1) == 0) < 0) {
+            err = errno;
+            break;
+        }
+        
+        int ret = poll(&pfd, 1, timeout_ms);
+        if (ret < 0) {
+            err = errno == EINTR ? 0 : errno;
+            continue;
+        }
+        if (ret == 0) {
+            timeouts++;
+            continue;
+        }
+        
+        int num_events = read_line_events(pfd.fd, NULL, events, GPIOD_LUA_MAX_EVENTS, 0);
+        int64_t now = monotonic_ns();
+        if (num_events < 0) {
+            err = errno;
+        } else if (num_events > 0) {
+            convert_event_clock(events, num_events, CLOCK_MONOTONIC);
+            latency_record(&round_trip, timespec_to_ns(&events[0].ts) - toggled);
+            latency_record(&delivery, now - timespec_to_ns(&events[0].ts));
+        }
+    }
+    
+    gpiod_line_release(input);
+    gpiod_line_release(output);
+    
+    if (err) {
+        return luaL_error(L, "Latency self-test failed: %s", strerror(err));
+    }
+    
+    lua_createtable(L, 0, 4);
+    lua_pushinteger(L, iterations);
+    lua_setfield(L, -2, "iterations");
+    lua_pushinteger(L, timeouts);
+    lua_setfield(L, -2, "timeouts");
+    push_latency_histogram(L, &round_trip);
+    lua_setfield(L, -2, "round_trip");
+    push_latency_histogram(L, &delivery);
+    lua_setfield(L, -2, "delivery");
+    
+    return 1;
+}
+
 // gpiod.version()
 static int gpiod_version(lua_State *L) {
     lua_pushstring(L, gpiod_version_string());
@@ -951,9 +7871,16 @@ static const luaL_Reg chip_methods[] = {
     {"get_lines", chip_get_lines},
     {"find_line", chip_find_line},
     {"get_all_lines", chip_get_all_lines},
+    {"get_line_range", chip_get_line_range},
+    {"get_lines_mask", chip_get_lines_mask},
+    {"find_lines", chip_find_lines},
     {"name", chip_name},
     {"label", chip_label},
     {"num_lines", chip_num_lines},
+    {"refresh", chip_refresh},
+    {"watch_line_info", chip_watch_line_info},
+    {"line_info_snapshot", chip_line_info_snapshot},
+    {"stats", object_stats},
     {"close", chip_close},
     {"__gc", chip_close},
     {NULL, NULL}
@@ -969,11 +7896,28 @@ static const luaL_Reg line_methods[] = {
     {"request_rising_edge_events_flags", line_request_rising_edge_events_flags},
     {"request_falling_edge_events_flags", line_request_falling_edge_events_flags},
     {"request_both_edges_events_flags", line_request_both_edges_events_flags},
+    {"set_config", line_set_config},
+    {"set_direction_input", line_set_direction_input},
+    {"set_direction_output", line_set_direction_output},
+    {"set_flags", line_set_flags},
     {"event_wait", line_event_wait},
     {"event_read", line_event_read},
+    {"event_read_multiple", line_event_read_multiple},
+    {"event_read_into", line_event_read_into},
+    {"event_try_read", line_event_try_read},
+    {"event_read_yield", line_event_read_yield},
+    {"pollfd", line_pollfd},
+    {"events", pollable_events},
+    {"timeout", line_timeout},
+    {"set_debounce", line_set_debounce},
+    {"debounce_stats", line_debounce_stats},
+    {"track_latency", line_track_latency},
+    {"latency_histogram", line_latency_histogram},
     {"event_get_fd", line_event_get_fd},
     {"get_value", line_get_value},
     {"set_value", line_set_value},
+    {"getter", line_getter},
+    {"setter", line_setter},
     {"offset", line_offset},
     {"name", line_name},
     {"consumer", line_consumer},
@@ -984,6 +7928,10 @@ static const luaL_Reg line_methods[] = {
     {"is_open_drain", line_is_open_drain},
     {"is_open_source", line_is_open_source},
     {"update", line_update},
+    {"pwm_start", line_pwm_start},
+    {"pwm_set_duty", line_pwm_set_duty},
+    {"pwm_stop", line_pwm_stop},
+    {"stats", object_stats},
     {"release", line_release},
     {"__gc", line_release},
     {NULL, NULL}
@@ -995,8 +7943,41 @@ static const luaL_Reg line_bulk_methods[] = {
     {"get_line", bulk_get_line},
     {"request_input", bulk_request_input},
     {"request_output", bulk_request_output},
+    {"set_config", bulk_set_config},
+    {"set_direction_input", bulk_set_direction_input},
+    {"set_direction_output", bulk_set_direction_output},
+    {"set_flags", bulk_set_flags},
     {"get_values", bulk_get_values},
     {"set_values", bulk_set_values},
+    {"get_mask", bulk_get_mask},
+    {"set_mask", bulk_set_mask},
+    {"getter", bulk_getter},
+    {"setter", bulk_setter},
+    {"load_waveform", bulk_load_waveform},
+    {"play", bulk_play},
+    {"sample", bulk_sample},
+    {"sampler", bulk_sampler},
+    {"pwm_start", bulk_pwm_start},
+    {"pwm_set_duty", bulk_pwm_set_duty},
+    {"pwm_stop", bulk_pwm_stop},
+    {"stats", object_stats},
+    {"request_rising_edge_events", bulk_request_rising_edge_events},
+    {"request_falling_edge_events", bulk_request_falling_edge_events},
+    {"request_both_edges_events", bulk_request_both_edges_events},
+    {"request_rising_edge_events_flags", bulk_request_rising_edge_events_flags},
+    {"request_falling_edge_events_flags", bulk_request_falling_edge_events_flags},
+    {"request_both_edges_events_flags", bulk_request_both_edges_events_flags},
+    {"event_wait", bulk_event_wait},
+    {"event_read_multiple", bulk_event_read_multiple},
+    {"event_read_into", bulk_event_read_into},
+    {"event_read_yield", bulk_event_read_yield},
+    {"pollfd", bulk_pollfd},
+    {"events", pollable_events},
+    {"timeout", bulk_timeout},
+    {"set_debounce", bulk_set_debounce},
+    {"debounce_stats", bulk_debounce_stats},
+    {"track_latency", bulk_track_latency},
+    {"latency_histogram", bulk_latency_histogram},
     {"release", bulk_release},
     {"__gc", bulk_release},
     {NULL, NULL}
@@ -1006,6 +7987,23 @@ static const luaL_Reg line_bulk_methods[] = {
 static const luaL_Reg line_event_methods[] = {
     {"event_type", event_event_type},
     {"timestamp", event_timestamp},
+    {"timestamp_ns", event_timestamp_ns},
+    {"delta_ns", event_delta_ns},
+    {"offset", event_offset},
+    {NULL, NULL}
+};
+
+// Event Buffer method table
+static const luaL_Reg event_buffer_methods[] = {
+    {"capacity", event_buffer_capacity},
+    {"count", event_buffer_count},
+    {"clear", event_buffer_clear},
+    {"event_type", event_buffer_event_type},
+    {"timestamp_ns", event_buffer_timestamp_ns},
+    {"offset", event_buffer_offset},
+    {"delta_ns", event_buffer_delta_ns},
+    {"get", event_buffer_get},
+    {"__len", event_buffer_count},
     {NULL, NULL}
 };
 
@@ -1018,11 +8016,179 @@ static const luaL_Reg chip_iter_methods[] = {
     {NULL, NULL}
 };
 
+// Event Loop method table
+static const luaL_Reg event_loop_methods[] = {
+    {"add", event_loop_add},
+    {"remove", event_loop_remove},
+    {"step", event_loop_step},
+    {"run", event_loop_run},
+    {"stop", event_loop_stop},
+    {"fd", event_loop_fd},
+    {"pollfd", event_loop_fd},
+    {"events", pollable_events},
+    {"timeout", event_loop_timeout},
+    {"close", event_loop_close},
+    {"__gc", event_loop_close},
+    {NULL, NULL}
+};
+
+// Ticker method table
+static const luaL_Reg ticker_methods[] = {
+    {"wait", ticker_wait},
+    {"stats", ticker_stats},
+    {"reset", ticker_reset},
+    {NULL, NULL}
+};
+
+// Background Capture method table
+static const luaL_Reg capture_methods[] = {
+    {"read", capture_read},
+    {"read_into", capture_read_into},
+    {"pending", capture_pending_count},
+    {"overflows", capture_overflows},
+    {"stats", capture_stats},
+    {"reset_stats", capture_reset_stats},
+    {"stop", capture_close},
+    {"__gc", capture_close},
+    {NULL, NULL}
+};
+
+// Line Group method table
+static const luaL_Reg line_group_methods[] = {
+    {"set_mask", group_set_mask},
+    {"get_mask", group_get_mask},
+    {"setter", group_setter},
+    {"num_lines", group_num_lines},
+    {"timing", group_timing},
+    {NULL, NULL}
+};
+
+// Line Info Watch method table
+static const luaL_Reg info_watch_methods[] = {
+    {"add", info_watch_add},
+    {"remove", info_watch_remove},
+    {"wait", info_watch_wait},
+    {"read", info_watch_read},
+    {"pollfd", info_watch_pollfd},
+    {"events", pollable_events},
+    {"timeout", info_watch_timeout},
+    {"close", info_watch_close},
+    {"__gc", info_watch_close},
+    {NULL, NULL}
+};
+
+// Shared Input method table
+static const luaL_Reg shared_input_methods[] = {
+    {"get_mask", shared_input_get_mask},
+    {"get_values", shared_input_get_values},
+    {"snapshot", shared_input_snapshot},
+    {"offsets", shared_input_offsets},
+    {"stats", shared_input_stats},
+    {"release", shared_input_release},
+    {"__gc", shared_input_release},
+    {NULL, NULL}
+};
+
+// Chip Registry method table
+static const luaL_Reg chip_registry_methods[] = {
+    {"update", chip_registry_update},
+    {"get", chip_registry_get},
+    {"open", chip_registry_open},
+    {"find", chip_registry_find},
+    {"chips", chip_registry_chips},
+    {"pollfd", chip_registry_pollfd},
+    {"events", pollable_events},
+    {"timeout", chip_registry_timeout},
+    {"close", chip_registry_close},
+    {"__gc", chip_registry_close},
+    {NULL, NULL}
+};
+
+// Line Info Snapshot method table
+static const luaL_Reg line_info_methods[] = {
+    {"num_lines", line_info_num_lines},
+    {"chip_name", line_info_chip_name},
+    {"timestamp_ns", line_info_timestamp_ns},
+    {"name", line_info_name},
+    {"consumer", line_info_consumer},
+    {"direction", line_info_direction},
+    {"active_state", line_info_active_state},
+    {"bias", line_info_bias},
+    {"is_used", line_info_is_used},
+    {"is_open_drain", line_info_is_open_drain},
+    {"is_open_source", line_info_is_open_source},
+    {"get", line_info_get},
+    {"column", line_info_column},
+    {"diff", line_info_diff},
+    {"__len", line_info_num_lines},
+    {NULL, NULL}
+};
+
+// Background Sampler method table
+static const luaL_Reg sampler_methods[] = {
+    {"read", sampler_read},
+    {"pending", sampler_pending_count},
+    {"stats", sampler_stats},
+    {"stop", sampler_close},
+    {"__gc", sampler_gc},
+    {NULL, NULL}
+};
+
+// Capture File Reader method table
+static const luaL_Reg recording_methods[] = {
+    {"info", recording_info},
+    {"read", recording_read},
+    {"read_into", recording_read_into},
+    {"rewind", recording_rewind},
+    {"export_vcd", recording_export_vcd},
+    {"close", recording_close},
+    {"__gc", recording_close},
+    {NULL, NULL}
+};
+
+// Edge Counter method table
+static const luaL_Reg counter_methods[] = {
+    {"count", counter_count},
+    {"reset", counter_reset},
+    {"frequency", counter_frequency},
+    {"period_stats", counter_period_stats},
+    {"stop", counter_close},
+    {"__gc", counter_gc},
+    {NULL, NULL}
+};
+
+// Quadrature Encoder method table
+static const luaL_Reg encoder_methods[] = {
+    {"position", encoder_position},
+    {"set_position", encoder_set_position},
+    {"velocity", encoder_velocity},
+    {"errors", encoder_errors},
+    {"stats", encoder_stats},
+    {"close", encoder_close},
+    {"__gc", encoder_close},
+    {NULL, NULL}
+};
+
 // Module function table
 static const luaL_Reg gpiod_functions[] = {
     {"chip_open", chip_open},
     {"chip_iter", gpiod_chip_iter},
+    {"chip_registry", gpiod_chip_registry},
+    {"group", gpiod_group},
+    {"shared_input", gpiod_shared_input},
+    {"latency_selftest", gpiod_latency_selftest},
+    {"event_loop", gpiod_event_loop},
+    {"event_buffer", gpiod_event_buffer},
+    {"capture", gpiod_capture},
+    {"record", gpiod_record},
+    {"recording", gpiod_recording},
+    {"counter", gpiod_counter},
+    {"encoder", gpiod_encoder},
+    {"ticker", gpiod_ticker},
+    {"stats", gpiod_stats},
+    {"stats_enable", gpiod_stats_enable},
     {"sleep", gpiod_sleep},
+    {"now_ns", gpiod_now_ns},
     {"version", gpiod_version},
     {NULL, NULL}
 };
@@ -1053,12 +8219,94 @@ int luaopen_gpiod(lua_State *L) {
     lua_setfield(L, -2, "__index");
     luaL_setfuncs(L, line_event_methods, 0);
     
+    // Create Waveform metatable
+    luaL_newmetatable(L, GPIOD_WAVEFORM_MT);
+    lua_pop(L, 1);
+    
+    // Create Event Buffer metatable
+    luaL_newmetatable(L, GPIOD_EVENT_BUFFER_MT);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_setfuncs(L, event_buffer_methods, 0);
+    
+    // Create Ticker metatable
+    luaL_newmetatable(L, GPIOD_TICKER_MT);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_setfuncs(L, ticker_methods, 0);
+    
+    // Create Background Capture metatable
+    luaL_newmetatable(L, GPIOD_CAPTURE_MT);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_setfuncs(L, capture_methods, 0);
+    
+    // Create Line Group metatable
+    luaL_newmetatable(L, GPIOD_LINE_GROUP_MT);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_setfuncs(L, line_group_methods, 0);
+    
+    // Create Line Info Watch metatable
+    luaL_newmetatable(L, GPIOD_INFO_WATCH_MT);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_setfuncs(L, info_watch_methods, 0);
+    
+    // Create Shared Input metatable
+    luaL_newmetatable(L, GPIOD_SHARED_INPUT_MT);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_setfuncs(L, shared_input_methods, 0);
+    
+    // Create Chip Registry metatable
+    luaL_newmetatable(L, GPIOD_CHIP_REGISTRY_MT);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_setfuncs(L, chip_registry_methods, 0);
+    
+    // Create Line Info Snapshot metatable
+    luaL_newmetatable(L, GPIOD_LINE_INFO_MT);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_setfuncs(L, line_info_methods, 0);
+    
+    // Create Background Sampler metatable
+    luaL_newmetatable(L, GPIOD_SAMPLER_MT);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_setfuncs(L, sampler_methods, 0);
+    
+    // Create Capture File Reader metatable
+    luaL_newmetatable(L, GPIOD_RECORDING_MT);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_setfuncs(L, recording_methods, 0);
+    
+    // Create Edge Counter metatable
+    luaL_newmetatable(L, GPIOD_COUNTER_MT);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_setfuncs(L, counter_methods, 0);
+    
+    // Create Quadrature Encoder metatable
+    luaL_newmetatable(L, GPIOD_ENCODER_MT);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_setfuncs(L, encoder_methods, 0);
+    
     // Create Chip Iterator metatable
     luaL_newmetatable(L, GPIOD_CHIP_ITER_MT);
     lua_pushvalue(L, -1);
     lua_setfield(L, -2, "__index");
     luaL_setfuncs(L, chip_iter_methods, 0);
     
+    // Create Event Loop metatable
+    luaL_newmetatable(L, GPIOD_EVENT_LOOP_MT);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaL_setfuncs(L, event_loop_methods, 0);
+    
     // Create module table
     luaL_newlib(L, gpiod_functions);
     
@@ -1115,5 +8363,12 @@ int luaopen_gpiod(lua_State *L) {
     lua_pushinteger(L, GPIOD_LINE_EVENT_FALLING_EDGE);
     lua_setfield(L, -2, "EVENT_FALLING_EDGE");
     
+    // Add event clock constants
+    lua_pushinteger(L, CLOCK_MONOTONIC);
+    lua_setfield(L, -2, "CLOCK_MONOTONIC");
+    
+    lua_pushinteger(L, CLOCK_REALTIME);
+    lua_setfield(L, -2, "CLOCK_REALTIME");
+    
     return 1;
 }
\ No newline at end of file